@@ -14,8 +14,9 @@ OVERLAPPED sendop, recop;
 /*!
  * @brief コンストラクタ
  */
-CComm::CComm() : com_port(0)
+CComm::CComm() : com_port(0), event_mask(0), is_waiting(0)
 {
+	memset(&waitop, 0, sizeof(waitop));
 }
 
 
@@ -52,6 +53,9 @@ bool CComm::Open(int port, int baudrate)
 		dcb.BaudRate = baudrate;
 		dcb.ByteSize = 8;
 		SetCommState(hComm,&dcb);
+		SetCommMask(hComm, EV_RXCHAR);						// 受信したらWaitCommEventを完了させる
+		waitop.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+		is_waiting = 0;
 	}
 	com_port = port;
 	return true;			// 正常終了
@@ -66,7 +70,11 @@ bool CComm::Open(int port, int baudrate)
  */
 bool CComm::Close(void)
 {
+	SetCommMask(hComm, 0);									// 完了待ちのWaitCommEventを終了させる
 	CloseHandle(hComm);
+	if (waitop.hEvent != NULL) CloseHandle(waitop.hEvent);
+	waitop.hEvent = NULL;
+	is_waiting = 0;
 	return true;
 }
 
@@ -128,3 +136,32 @@ bool CComm::ClearRecvBuf(void)
 	while(Recv(buf,buf_size) > 0);
 	return true;
 }
+
+/*!
+ * @brief データを受信するまで待つ
+ * 受信バッファにデータがあればすぐに戻る．無ければWaitCommEvent(EV_RXCHAR)で受信を待つ．
+ * タイムアウトした場合，WaitCommEventは完了待ちのまま次の呼び出しで引き続き待つ．
+ *
+ * @param[in] timeout タイムアウト(ms)
+ *
+ * @return 1:受信した, 0:タイムアウト, -1:エラー
+ */
+int CComm::WaitRecv(DWORD timeout)
+{
+	COMSTAT Comstat;
+	DWORD Error, dummy;
+
+	if ((hComm == INVALID_HANDLE_VALUE)||(waitop.hEvent == NULL)) return -1;
+	if (!is_waiting){
+		ClearCommError(hComm,&Error,&Comstat);
+		if (Comstat.cbInQue) return 1;						// 既に受信している場合
+		ResetEvent(waitop.hEvent);
+		if (WaitCommEvent(hComm, &event_mask, &waitop)) return 1;	// すぐに完了した場合
+		if (GetLastError() != ERROR_IO_PENDING) return -1;
+		is_waiting = 1;
+	}
+	if (WaitForSingleObject(waitop.hEvent, timeout) != WAIT_OBJECT_0) return 0;
+	is_waiting = 0;
+	if (!GetOverlappedResult(hComm, &waitop, &dummy, FALSE)) return -1;
+	return 1;
+}
@@ -11,10 +11,18 @@ public:
 public:
 	int com_port;											//! ポート番号
 	HANDLE hComm;											//! ハンドラ
+
+private:
+	OVERLAPPED waitop;										//! 受信待ち用のOVERLAPPED構造体
+	DWORD event_mask;										//! WaitCommEventで発生したイベント
+	int is_waiting;											//! WaitCommEventの完了待ち
+
+public:
 	
 	bool Open(int port, int baudrate = DEFAULT_BAUDRATE);	// COMポートのオープン
 	bool Close(void);										// COMポートのクローズ
 	int Send(char *data, int len = 0);						// データを送信する
 	int Recv(char *data, int max_len);						// データを受信する
 	bool ClearRecvBuf(void);								// データバッファをクリアする
+	int WaitRecv(DWORD timeout);							// データを受信するまで待つ
 };
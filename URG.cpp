@@ -4,16 +4,17 @@
 #include "stdafx.h"
 #include "URG.h"
 #include <math.h>
+#include <emmintrin.h>
 #include "logger.h"
 
 // CURG
 
 #define	M_PI	3.14159f
 
-/*!
- * @class CURG
- * @brief URGを使用するためのクラス
- * @author Y.Hayashibara
+/*!
+ * @class CURG
+ * @brief URGを使用するためのクラス
+ * @author Y.Hayashibara
  */
 
 /*!
@@ -39,6 +40,13 @@ CURG::~CURG()
  */
 int CURG::Init(int com_port)
 {
+	// 各ビームの方向は固定なので，スキャン毎にcos/sinを計算しないように予め求めておく
+	for(int i = 0; i < n_data; i ++){
+		float ang = 0.25f*(i-640/2)*M_PI/180.0f;	// URGスキャン面の角度
+		beam_cos[i] = cos(ang);
+		beam_sin[i] = sin(ang);
+	}
+
 	int res = comm.Open(com_port);
 	Sleep(100);
 //	comm.Send("BM\n");
@@ -76,13 +84,13 @@ int CURG::StartMeasure(){
  *
  * @param[out] data 距離データ
  *
- * @return 1以上：正常終了（データ数），0以下：異常終了
+ * @return 1以上：正常終了（データ数），0：１スキャン分のデータが揃っていない，0未満：異常終了
  */
 int CURG::GetData(int length[n_data], int intensity[n_data]){
 	const int max_no = n_data * 6 + 1000;
 	static char recv_buf[max_no], buf[max_no * 3], buf2[max_no];
 	static int pointer = 0;
-	int recv_num, i = 0, j = 0, num_lf = 0;
+	int recv_num, i = 0, j = 0, num_lf = 0, dp = 0;
 
 	do{
 		recv_num = comm.Recv(recv_buf, max_no);
@@ -91,7 +99,8 @@ int CURG::GetData(int length[n_data], int intensity[n_data]){
 		}
 		{
 			// 最後のデータ以外はすべて破棄する．
-			int dp = 0, dpp = 0;
+			int dpp = 0;
+			dp = 0;
 			for(int k = 0; k < pointer - 1; k ++){
 				if ((buf[k] == '\n')&&(buf[k+1] == '\n')){
 					dpp = dp;		// 一つ前のデリミタの位置を保存する．
@@ -106,6 +115,7 @@ int CURG::GetData(int length[n_data], int intensity[n_data]){
 			}
 		}
 	} while (recv_num > 0);
+	if (dp == 0) return 0;	// データの区切りまで受信していない（途中のデータはbufに残す）
 
 	while(i < pointer){		// データの最後になるまで繰り返す
 		if (num_lf < 3){	// 始めの4ラインのデータは無視（エラー処理無し）
@@ -134,9 +144,24 @@ int CURG::GetData(int length[n_data], int intensity[n_data]){
 }
 
 /*!
- * @brief デカルト座標系への変換
+ * @brief データを受信するまで待つ
+ * 計測開始後はURGがデータを送り続けるため，受信したらGetDataを呼び出す．
  *
- * @param[in]  tilt チルトの角度(rad)
+ * @param[in] timeout タイムアウト(ms)
+ *
+ * @return 1:受信した, 0:タイムアウト, -1:エラー
+ */
+int CURG::WaitData(unsigned long timeout)
+{
+	return comm.WaitRecv(timeout);
+}
+
+/*!
+ * @brief デカルト座標系への変換（整数に丸める）
+ * SoA形式で変換した後，従来のpos型(mm)に切り捨てて格納する．
+ * 作業領域はインスタンス毎に持つため，別のURGのインスタンスとは同時に呼び出せる．
+ *
+ * @param[in]  tilt チルトの角度(deg)
  * @param[in]  data 取得した距離データ[mm]
  * @param[out] p    デカルト座標系に変換した障害物の位置データ(mm)
  *
@@ -144,19 +169,64 @@ int CURG::GetData(int length[n_data], int intensity[n_data]){
  */
 int CURG::TranslateCartesian(float tilt, int data[n_data], pos p[n_data])
 {
-	float x, y, ang;
+	TranslateCartesian(tilt, data, &round_buf);
 	for(int i = 0; i < n_data; i ++){
-		if (data[i] < 20){
-			p[i].x = p[i].y = p[i].z = 0;
-			continue;
-		}
-		ang = 0.25f*(i-640/2)*M_PI/180.0f;		// URGスキャン面の角度
-		x = data[i]*cos(ang);
-		y = data[i]*sin(ang);
-		ang = tilt*M_PI/180.0f;					// URGチルト角度
-		p[i].x = (int)(x*cos(ang));
-		p[i].y = (int)(y         );
-		p[i].z = (int)(x*sin(ang));
+		p[i].x = (int)round_buf.x[i];
+		p[i].y = (int)round_buf.y[i];
+		p[i].z = (int)round_buf.z[i];
+	}
+	return n_data;
+}
+
+/*!
+ * @brief デカルト座標系への変換（SoA形式，SIMD）
+ * Init()で求めたビームの方向を用いて，4ビームずつSSE2で変換する．
+ * 20mm未満の距離データ（エラー値）は(0,0,0)とする．
+ * 走査中にチルトが動く場合は，tilt_stepにビーム毎の変化量を指定する．
+ * （i番目のビームのチルト角度は tilt + tilt_step * i）
+ * 1スキャン中の変化は小さい(1deg程度)ので，cos/sinは1次の近似で求める．
+ *
+ * @param[in]  tilt      最初のビームのチルトの角度(deg)
+ * @param[in]  data      取得した距離データ[mm]
+ * @param[out] p         デカルト座標系に変換した障害物の位置データ(mm)
+ * @param[in]  tilt_step ビーム毎のチルトの角度の変化量(deg)
+ *
+ * @return 取得したデータの数
+ */
+int CURG::TranslateCartesian(float tilt, int data[n_data], scan_xyz *p, float tilt_step)
+{
+	const float MIN_LENGTH = 20.0f;				// これ未満の距離データはエラー値
+	float ang = tilt*M_PI/180.0f;				// URGチルト角度
+	float step = tilt_step*M_PI/180.0f;			// ビーム毎のURGチルト角度の変化量
+	float ct = cos(ang), st = sin(ang);
+	int i;
+
+	const __m128 v_ct   = _mm_set1_ps(ct);
+	const __m128 v_st   = _mm_set1_ps(st);
+	const __m128 v_min  = _mm_set1_ps(MIN_LENGTH);
+	const __m128 v_step = _mm_set1_ps(step);
+	const __m128 v_four = _mm_set1_ps(4.0f);
+	__m128 v_i = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);	// ビームの番号
+	for(i = 0; i + 4 <= n_data; i += 4){
+		__m128 r = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)&data[i]));
+		r = _mm_and_ps(r, _mm_cmpge_ps(r, v_min));		// エラー値は0にする
+		__m128 d = _mm_mul_ps(v_i, v_step);				// 最初のビームからのチルトの変化量(rad)
+		__m128 c = _mm_sub_ps(v_ct, _mm_mul_ps(v_st, d));	// cos(ang + d)
+		__m128 s = _mm_add_ps(v_st, _mm_mul_ps(v_ct, d));	// sin(ang + d)
+		__m128 x = _mm_mul_ps(r, _mm_loadu_ps(&beam_cos[i]));
+		__m128 y = _mm_mul_ps(r, _mm_loadu_ps(&beam_sin[i]));
+		_mm_storeu_ps(&p->x[i], _mm_mul_ps(x, c));
+		_mm_storeu_ps(&p->y[i], y);
+		_mm_storeu_ps(&p->z[i], _mm_mul_ps(x, s));
+		v_i = _mm_add_ps(v_i, v_four);
+	}
+	for(; i < n_data; i ++){						// 4の倍数に満たない残りのビーム
+		float r = (data[i] < MIN_LENGTH) ? 0.0f : (float)data[i];
+		float d = step * i;
+		float x = r * beam_cos[i];
+		p->x[i] = x * (ct - st * d);
+		p->y[i] = r * beam_sin[i];
+		p->z[i] = x * (st + ct * d);
 	}
 	return n_data;
 }
@@ -14,11 +14,30 @@ public:
 	static const int n_data = 641;		// URGで取得するデータの個数 (10～170deg)
 	CComm comm;							// 通信のクラス
 
+	/*!
+	 * @struct scan_xyz_T
+	 * @brief 1スキャン分のデカルト座標（SoA形式）
+	 */
+	struct scan_xyz_T{
+		float x[n_data];				//!< x座標(mm)
+		float y[n_data];				//!< y座標(mm)
+		float z[n_data];				//!< z座標(mm)
+	};
+	typedef struct scan_xyz_T scan_xyz;
+
 	int Init(int com_port);				// 初期設定
 	int Close();						// 終了処理
 	int StartMeasure();					// URGの計測開始
 	int GetData(int length[n_data], int intensity[n_data]);
 										// 受信バッファにたまった距離データを取得する
+	int WaitData(unsigned long timeout);	// データを受信するまで待つ
 	int TranslateCartesian(float tilt, int data[n_data], pos p[n_data]);
-										// デカルト座標系への変換
+										// デカルト座標系への変換（整数に丸める）
+	int TranslateCartesian(float tilt, int data[n_data], scan_xyz *p, float tilt_step = 0.0f);
+										// デカルト座標系への変換（SoA形式，SIMD）
+
+private:
+	float beam_cos[n_data];				//! 各ビームのスキャン面内の方向の余弦（Initで計算）
+	float beam_sin[n_data];				//! 各ビームのスキャン面内の方向の正弦（Initで計算）
+	scan_xyz round_buf;					//! pos型に丸める前の座標（インスタンス毎の作業領域）
 };
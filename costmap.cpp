@@ -0,0 +1,308 @@
+﻿/*!
+ * @file  costmap.cpp
+ * @brief 障害物からの距離とコストのグリッド
+ *
+ * ロボットを中心とするグリッドをオドメトリの座標系に置き，ボクセル地図の障害物のボクセルが覆うセルを障害物とする．
+ * 障害物の保持と光線による消去はボクセル地図が3次元で行うため，低い障害物の上を通過した光線では消えない．
+ * 障害物からの距離はFelzenszwalbの方法（1次元の下側包絡線を行と列に適用）で厳密なユークリッド距離をセル数に比例する時間で求め，
+ * ロボットの半径で膨張させたコストを付ける．
+ * 足跡や円弧の衝突判定は各点で１回の参照で行える．
+ */
+
+#include "stdafx.h"
+#include "costmap.h"
+#include <math.h>
+
+/*!
+ * @class costmap
+ * @brief 障害物回避と局所経路計画で共有する距離とコストのグリッド
+ */
+
+static const float EDT_INF = 1.0e5f;				//! 障害物が無いセルの2乗距離（グリッド内の最大値より大きい）(セル^2)
+static const float FAR_DISTANCE = 1.0e6f;			//! 障害物が無い場合の距離(mm)
+
+/*!
+ * @brief コンストラクタ
+ */
+costmap::costmap():
+origin_ix(-GRID_NUM/2), origin_iy(-GRID_NUM/2), obstacle_num(0),
+robot_x(0), robot_y(0), robot_c(1.0f), robot_s(0)
+{
+	clear();
+}
+
+/*!
+ * @brief デストラクタ
+ */
+costmap::~costmap()
+{
+}
+
+/*!
+ * @brief 障害物を消去する
+ *
+ * @return 0
+ */
+int costmap::clear()
+{
+	obstacle_num = 0;
+	memset(hit, 0, sizeof(hit));
+	updateDistance(1);
+
+	return 0;
+}
+
+/*!
+ * @brief ボクセル地図の障害物とロボットの位置を設定して更新
+ * グリッドの範囲の障害物のボクセルが覆うセルを登録してから距離とコストを求める．
+ * ボクセル地図からの取得はハッシュテーブル全体の走査で，開発用PCで約0.2msかかる（距離変換を全て求め直すと約0.6ms）．
+ *
+ * @param[in] map ボクセル地図（オドメトリの座標系）
+ * @param[in] x,y 現在のロボットの位置(m) オドメトリ
+ * @param[in] the 現在のロボットの向き(rad) オドメトリ
+ *
+ * @return 0
+ */
+int costmap::setData(voxelMap *map, float x, float y, float the)
+{
+	static const int HALF_VOXEL = voxelMap::VOXEL_SIZE / 2;
+
+	setPose(x, y, the);
+	recenter();
+
+	int x0 = origin_ix * GRID_SIZE, y0 = origin_iy * GRID_SIZE;	// グリッドの範囲(mm) オドメトリの座標系
+	obstacle_num = map->getObstacles(x0, y0, x0 + GRID_NUM * GRID_SIZE - 1, y0 + GRID_NUM * GRID_SIZE - 1, obstacle, MAX_OBSTACLE);
+	memset(hit, 0, sizeof(hit));
+	for(int i = 0; i < obstacle_num; i ++){						// ボクセルが覆うセル
+		int ix0 = max((int)floor((float)(obstacle[i].x - HALF_VOXEL) / GRID_SIZE) - origin_ix, 0);
+		int iy0 = max((int)floor((float)(obstacle[i].y - HALF_VOXEL) / GRID_SIZE) - origin_iy, 0);
+		int ix1 = min((int)floor((float)(obstacle[i].x + HALF_VOXEL - 1) / GRID_SIZE) - origin_ix, GRID_NUM - 1);
+		int iy1 = min((int)floor((float)(obstacle[i].y + HALF_VOXEL - 1) / GRID_SIZE) - origin_iy, GRID_NUM - 1);
+		for(int ix = ix0; ix <= ix1; ix ++){
+			for(int iy = iy0; iy <= iy1; iy ++){
+				if (hit[ix][iy] < 0xffff) hit[ix][iy] ++;
+			}
+		}
+	}
+	updateDistance(0);
+
+	return 0;
+}
+
+/*!
+ * @brief 問い合わせの基準とするロボットの位置を設定
+ * グリッドはオドメトリの座標系に固定しているため，障害物の位置は移動しても変わらない．
+ *
+ * @param[in] x,y ロボットの位置(m) オドメトリ
+ * @param[in] the ロボットの向き(rad) オドメトリ
+ *
+ * @return 0
+ */
+int costmap::setPose(float x, float y, float the)
+{
+	robot_x = x * 1000.0f;
+	robot_y = y * 1000.0f;
+	robot_c = cos(the);
+	robot_s = sin(the);
+
+	return 0;
+}
+
+/*!
+ * @brief ロボット座標系の位置からセルを求める
+ *
+ * @param[in]  x,y   位置(mm) ロボット座標系
+ * @param[out] ix,iy セルの番号
+ *
+ * @return 1:グリッドの中，0:グリッドの外
+ */
+int costmap::toCell(float x, float y, int *ix, int *iy)
+{
+	float gx = robot_x + robot_c * x - robot_s * y;
+	float gy = robot_y + robot_s * x + robot_c * y;
+	*ix = (int)floor(gx / GRID_SIZE) - origin_ix;
+	*iy = (int)floor(gy / GRID_SIZE) - origin_iy;
+
+	return ((*ix >= 0)&&(*iy >= 0)&&(*ix < GRID_NUM)&&(*iy < GRID_NUM)) ? 1 : 0;
+}
+
+/*!
+ * @brief ロボットが移動したらグリッドの中心を移動する
+ * ロボットのセルが中心からRECENTER_CELLS以上離れたら，中心をロボットに合わせる．
+ * 障害物はこの後ボクセル地図から登録し直す．
+ *
+ * @return 1:移動した，0:移動していない
+ */
+int costmap::recenter()
+{
+	int new_ix = (int)floor(robot_x / GRID_SIZE) - GRID_NUM / 2;
+	int new_iy = (int)floor(robot_y / GRID_SIZE) - GRID_NUM / 2;
+	int dx = new_ix - origin_ix, dy = new_iy - origin_iy;
+	if ((abs(dx) < RECENTER_CELLS)&&(abs(dy) < RECENTER_CELLS)) return 0;
+
+	origin_ix = new_ix;
+	origin_iy = new_iy;
+
+	return 1;
+}
+
+/*!
+ * @brief 1次元の2乗距離変換
+ * edt_fの値を持つ放物線の下側包絡線を求め，edt_dに各点の2乗距離を出力する．
+ *
+ * @param[in] n 要素の数
+ *
+ * @return 0
+ */
+int costmap::transform1D(int n)
+{
+	int k = 0;
+	edt_v[0] = 0;
+	edt_z[0] = -EDT_INF;
+	edt_z[1] =  EDT_INF;
+	for(int q = 1; q < n; q ++){
+		float s;
+		for(;;){							// 交点がedt_z[0]より前になることは無い（EDT_INFの範囲）
+			int v = edt_v[k];
+			s = ((edt_f[q] + q * q) - (edt_f[v] + v * v)) / (2 * (q - v));
+			if (s > edt_z[k]) break;
+			k --;
+		}
+		k ++;
+		edt_v[k] = q;
+		edt_z[k] = s;
+		edt_z[k + 1] = EDT_INF;
+	}
+	k = 0;
+	for(int q = 0; q < n; q ++){
+		while(edt_z[k + 1] < q) k ++;
+		int v = edt_v[k];
+		edt_d[q] = (float)((q - v) * (q - v)) + edt_f[v];
+	}
+
+	return 0;
+}
+
+/*!
+ * @brief 距離とコストを求める
+ * 列方向と行方向に1次元の変換を行って2乗距離を求め，距離(mm)とコストに変換する．
+ * 列方向の変換はその列の障害物のセルだけで決まるため，前回から障害物のセルが変わった列だけ求め直す．
+ * どの列も変わっていなければ距離とコストは前回のままとする．行方向の変換は変わった列があれば全ての行で行い，
+ * コストは距離が変わったセルだけ求め直す．
+ * コストは障害物でLETHAL，ROBOT_RADIUSより近いとINSCRIBED，INFLATION_RADIUSまで指数関数的に減少する．
+ *
+ * @param[in] full 1:全ての列を求め直す（消去時），0:変わった列だけ
+ *
+ * @return 求め直した列の数
+ */
+int costmap::updateDistance(int full)
+{
+	static const float DECAY = 0.005f;				// コストの減衰率(1/mm)
+
+	int changed = 0;
+	for(int ix = 0; ix < GRID_NUM; ix ++){
+		int dirty = full;
+		for(int iy = 0; iy < GRID_NUM; iy ++){
+			unsigned char o = (hit[ix][iy] > 0) ? 1 : 0;
+			if (o != occupied[ix][iy]) occupied[ix][iy] = o, dirty = 1;
+		}
+		if (!dirty) continue;
+		for(int iy = 0; iy < GRID_NUM; iy ++) edt_f[iy] = occupied[ix][iy] ? 0.0f : EDT_INF;
+		transform1D(GRID_NUM);
+		for(int iy = 0; iy < GRID_NUM; iy ++) column[ix][iy] = edt_d[iy];
+		changed ++;
+	}
+	if (changed == 0) return 0;
+
+	for(int iy = 0; iy < GRID_NUM; iy ++){
+		for(int ix = 0; ix < GRID_NUM; ix ++) edt_f[ix] = column[ix][iy];
+		transform1D(GRID_NUM);
+		for(int ix = 0; ix < GRID_NUM; ix ++){
+			float d2 = edt_d[ix];
+			float d = (d2 >= EDT_INF) ? FAR_DISTANCE : sqrt(d2) * GRID_SIZE;
+			if (!full && (d == dist[ix][iy])) continue;
+			dist[ix][iy] = d;
+			if (d2 == 0){
+				cost[ix][iy] = LETHAL;
+			} else if (d < ROBOT_RADIUS){
+				cost[ix][iy] = INSCRIBED;
+			} else if (d < INFLATION_RADIUS){
+				cost[ix][iy] = (unsigned char)((INSCRIBED - 1) * exp(-DECAY * (d - ROBOT_RADIUS)));
+			} else {
+				cost[ix][iy] = 0;
+			}
+		}
+	}
+
+	return changed;
+}
+
+/*!
+ * @brief 最も近い障害物までの距離
+ *
+ * @param[in] x,y 位置(mm) ロボット座標系
+ *
+ * @return 障害物までの距離(mm) グリッドの外は障害物無し
+ */
+float costmap::getDistance(float x, float y)
+{
+	int ix, iy;
+	if (!toCell(x, y, &ix, &iy)) return FAR_DISTANCE;
+	return dist[ix][iy];
+}
+
+/*!
+ * @brief コスト
+ *
+ * @param[in] x,y 位置(mm) ロボット座標系
+ *
+ * @return コスト（0:自由～LETHAL:障害物） グリッドの外は0
+ */
+int costmap::getCost(float x, float y)
+{
+	int ix, iy;
+	if (!toCell(x, y, &ix, &iy)) return 0;
+	return cost[ix][iy];
+}
+
+/*!
+ * @brief ロボットの中心をおくと衝突するか
+ *
+ * @param[in] x,y ロボットの中心の位置(mm) ロボット座標系
+ *
+ * @return 1:衝突する，0:衝突しない
+ */
+int costmap::isCollision(float x, float y)
+{
+	return (getCost(x, y) >= INSCRIBED) ? 1 : 0;
+}
+
+/*!
+ * @brief ある領域に入る障害物のボクセルの個数
+ * 最後にsetDataで取得したボクセルの中心をロボット座標系に変換し，ボクセルの一部が領域に入るものを数える．
+ * 最も近いx座標はボクセルの手前の面とする（グリッドの距離と違い，横にずれた障害物も前方の距離になる）．
+ *
+ * @param[in]  x_min,y_min 領域の最小値(mm) ロボット座標系（後，右）
+ * @param[in]  x_max,y_max 領域の最大値(mm) ロボット座標系（前，左）
+ * @param[out] nearest_x   最も近い障害物のx座標(mm) 無い場合はx_max
+ *
+ * @return 障害物のボクセルの個数
+ */
+int costmap::getObstacleNum(float x_min, float y_min, float x_max, float y_max, int *nearest_x)
+{
+	static const float HALF_VOXEL = voxelMap::VOXEL_SIZE / 2.0f;
+
+	int num = 0;
+	float nearest = x_max;
+	for(int i = 0; i < obstacle_num; i ++){
+		float dx = obstacle[i].x - robot_x, dy = obstacle[i].y - robot_y;
+		float x =  robot_c * dx + robot_s * dy;
+		float y = -robot_s * dx + robot_c * dy;
+		if ((x + HALF_VOXEL < x_min)||(x - HALF_VOXEL >= x_max)||(y + HALF_VOXEL < y_min)||(y - HALF_VOXEL > y_max)) continue;
+		num ++;
+		nearest = min(nearest, max(x - HALF_VOXEL, x_min));
+	}
+	*nearest_x = (int)nearest;
+
+	return num;
+}
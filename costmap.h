@@ -0,0 +1,65 @@
+﻿#pragma once
+#include "dataType.h"
+#include "voxelMap.h"
+
+class costmap
+{
+public:
+	costmap();											// コンストラクタ
+	virtual ~costmap();									// デストラクタ
+
+	static const int ROBOT_RADIUS = 350;				//! ロボットの内接円の半径(mm) これより近い障害物とは衝突
+	static const int INFLATION_RADIUS = 1000;			//! コストを付ける障害物からの距離(mm)
+	static const unsigned char LETHAL = 254;			//! 障害物のセルのコスト
+	static const unsigned char INSCRIBED = 253;			//! ロボットが衝突するセルのコスト
+
+private:
+	static const int GRID_SIZE = 50;					//! セルの一辺(mm)
+	static const int GRID_NUM = 200;					//! 一辺のセル数（10m）
+	static const int RECENTER_CELLS = 20;				//! グリッドの中心を移動するロボットの移動量（セル数）
+	static const int MAX_OBSTACLE = 20000;				//! ボクセル地図から取得する障害物のボクセルの最大数
+
+	int origin_ix, origin_iy;							//! グリッドの左下のセルの番号（オドメトリの座標系）
+	float robot_x, robot_y, robot_c, robot_s;			//! ロボットの位置(mm)と向き(cos, sin)
+	pos obstacle[MAX_OBSTACLE];							//! ボクセル地図から取得した障害物のボクセル（オドメトリの座標系，mm）
+	int obstacle_num;									//! 障害物のボクセルの数
+	unsigned short hit[GRID_NUM][GRID_NUM];				//! セル内の障害物のボクセル数
+	unsigned char occupied[GRID_NUM][GRID_NUM];			//! 前回の距離変換で障害物としたセル
+	float column[GRID_NUM][GRID_NUM];					//! 列方向の2乗距離（障害物が変わった列だけ求め直す）(セル^2)
+	float dist[GRID_NUM][GRID_NUM];						//! 最も近い障害物までの距離(mm)
+	unsigned char cost[GRID_NUM][GRID_NUM];				//! コスト（0:自由～LETHAL:障害物）
+	float edt_f[GRID_NUM], edt_d[GRID_NUM], edt_z[GRID_NUM + 1];	//! 距離変換の作業領域
+	int edt_v[GRID_NUM];								//! 距離変換の作業領域
+
+	int recenter();										// ロボットが移動したらグリッドの中心を移動する
+	int transform1D(int n);								// 1次元の2乗距離変換
+	int updateDistance(int full);						// 距離とコストを求める
+	int toCell(float x, float y, int *ix, int *iy);		// ロボット座標系の位置からセルを求める
+
+public:
+	int setData(voxelMap *map, float x, float y, float the);
+														// ボクセル地図の障害物とロボットの位置を設定して更新
+	int clear();										// 障害物を消去する
+	int setPose(float x, float y, float the);			// 問い合わせの基準とするロボットの位置を設定
+	float getDistance(float x, float y);				// 最も近い障害物までの距離
+	int getCost(float x, float y);						// コスト
+	int isCollision(float x, float y);					// ロボットの中心をおくと衝突するか
+	int getObstacleNum(float x_min, float y_min, float x_max, float y_max, int *nearest_x);
+														// ある領域に入る障害物のボクセルの個数
+};
+
+/*
+ * 使い方
+ * 1) 障害物のデータを取得する毎にsetData(ボクセル地図, オドメトリ)を呼び出す．
+ *    グリッドの範囲の障害物のボクセルを取得する（ボクセル地図とグリッドは同じオドメトリの座標系）．
+ *    データが無い周期でもsetPose(オドメトリ)で現在の位置を設定すれば，移動に合わせて問い合わせられる．
+ * 2) ロボット座標系(mm)で問い合わせる（１回の参照で求まる）．
+ *    getDistance(x, y)  : 最も近い障害物までの距離
+ *    getCost(x, y)      : コスト（LETHAL:障害物, INSCRIBED:衝突, それ以下は距離に応じて減少）
+ *    isCollision(x, y)  : ロボットの中心をおくと衝突するか
+ *    getObstacleNum(...) : 領域に入る障害物のボクセルの個数と最も近いx座標（前方の箱での停止の判定）
+ * グリッドはオドメトリの座標系で固定し，ロボットを中心に置く．
+ * 障害物の保持と消去はボクセル地図が行い（観測が無いと一定時間で消え，3次元の光線が通過するとすぐに消える），
+ * グリッドは更新毎にボクセル地図から作り直すが，距離変換は障害物が変わった列だけを求め直し，
+ * 変わった列が無ければ行方向の変換とコストの計算も行わない（止まっていて周囲が静止している場合）．
+ */
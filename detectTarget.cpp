@@ -7,14 +7,19 @@
 
 #include "StdAfx.h"
 #include "detectTarget.h"
+#include <math.h>
+#include <mmsystem.h>
+#include "logger.h"
 
 /*!
  * @brief コンストラクタ
  */
 detectTarget::detectTarget(void):
-	intensity_data_no(0), slate_point_no(0), search_point_no(0),
-	integrated_point_no(0), terminate(0)
+	intensity_data_no(0), intensity_data_top(0), input_state(0), input_dropped(0), input_event(NULL),
+	slate_point_no(0), integrated_point_no(0), terminate(0)
 {
+	input_written[0] = input_written[1] = 0;
+	tracker.setHitInterval(WINDOW_TIME);		// 候補は直近のWINDOW_TIMEのデータから求めるため
 }
 
 /*!
@@ -32,6 +37,7 @@ detectTarget::~detectTarget(void)
 int detectTarget::Init()									// 初期化
 {
 	mutex = CreateMutex(NULL, FALSE, _T("DETECT_TARGET_RESULT"));
+	input_event = CreateEvent(NULL, FALSE, FALSE, NULL);	// 自動リセット
 
 	// 速度制御のスレッドを開始
 	DWORD threadId;	
@@ -51,12 +57,16 @@ int detectTarget::Close()									// 終了処理
 {
 	terminate = 1;											// 探索対象検出スレッドの停止
 	CloseHandle(mutex);
+	if (input_event != NULL) SetEvent(input_event);
 	return 0;
 }
 
 /*!
  * @brief 反射強度データをセット
  * 計算をする前に，必ず入力する．
+ * 書き込み中の入力バッファに排他制御無しで追加する（複数のスレッドから呼び出せる）．
+ * 書き込む位置はinput_stateへの加算で予約し，書き込み後にinput_writtenに加算して終了を知らせる．
+ * バッファがINPUT_WAKE_DATAを超えたらスレッドを起こし，溢れたデータは破棄して個数を記録する．
  *
  * @param[in] p   反射強度データ(m)（現在のワールド座標系）
  * @param[in] num 反射強度データの個数
@@ -65,14 +75,58 @@ int detectTarget::Close()									// 終了処理
  */
 int detectTarget::addIntensityData(pos_inten *p, int num)
 {
-	for(int i = 0; i < num; i ++){
-		intensity_data[intensity_data_no ++] = p[i];
-		if (intensity_data_no >= MAX_INTENSITY_DATA) break;
+	if (num <= 0) return 0;
+	unsigned long now = timeGetTime();
+
+	LONG state = InterlockedExchangeAdd(&input_state, num);
+	int b = (state >> INPUT_SHIFT) & 1;
+	int start = state & INPUT_COUNT_MASK;
+	int n = max(min(num, MAX_INPUT_DATA - start), 0);
+	for(int i = 0; i < n; i ++){
+		input_data[b][start + i] = p[i];
+		input_time[b][start + i] = now;
 	}
+	if (n < num) InterlockedExchangeAdd(&input_dropped, num - n);
+	InterlockedExchangeAdd(&input_written[b], num);
+
+	if ((start < INPUT_WAKE_DATA)&&(start + num >= INPUT_WAKE_DATA)&&(input_event != NULL)) SetEvent(input_event);
 
 	return 0;
 }
 
+/*!
+ * @brief 入力バッファを交換して反射強度データを取り出す
+ * 書き込むバッファを切り替え，予約された書き込みが終わるのを待ってからリングバッファに移す．
+ *
+ * @return 取り出したデータの個数
+ */
+int detectTarget::takeInputData()
+{
+	LONG state, next;
+	do{
+		state = input_state;
+		next = (((state >> INPUT_SHIFT) & 1) ^ 1) << INPUT_SHIFT;
+	} while(InterlockedCompareExchange(&input_state, next, state) != state);
+
+	int b = (state >> INPUT_SHIFT) & 1;
+	LONG reserved = state & INPUT_COUNT_MASK;
+	while(InterlockedCompareExchange(&input_written[b], 0, 0) < reserved) Sleep(0);	// 書き込み中のデータを待つ
+
+	int num = min((int)reserved, MAX_INPUT_DATA);
+	for(int i = 0; i < num; i ++){
+		intensity_data[intensity_data_top] = input_data[b][i];
+		intensity_time[intensity_data_top] = input_time[b][i];
+		intensity_data_top = (intensity_data_top + 1) % MAX_INTENSITY_DATA;
+	}
+	intensity_data_no = min(intensity_data_no + num, MAX_INTENSITY_DATA);
+	InterlockedExchange(&input_written[b], 0);
+
+	LONG dropped = InterlockedExchange(&input_dropped, 0);
+	if (dropped > 0) LOG("intensity_input_dropped:%ld\n", dropped);
+
+	return num;
+}
+
 /*!
  * @brief 探索対象の位置と確率を戻す
  *
@@ -94,6 +148,8 @@ int detectTarget::getTargetPos(pos_slate *p, int *num)
 
 /*!
  * @brief 最近棒の探索対象の位置
+ * 探索範囲内の確定したトラックを空間インデックスで近い順に取得し，
+ * 確からしさから距離に比例した値を引いた評価の最も大きいトラックの位置を戻す．
  *
  * @param[out] p   最近傍の探索対象の位置（現在のワールド座標系）
  * @param[in] self_loc   ロボットの現在位置（現在のワールド座標系）
@@ -105,15 +161,25 @@ int detectTarget::getSearchPos(pos *p, pos self_loc, float radius)
 {
 	const float MIN_PROBABILITY = 0.2f;		//! ToDo: 確率のしきい値（複数個発見することで，確率が上がる．数値を大きくすると誤認識が減る．）
 
+	static const float DISTANCE_WEIGHT = 0.5f;	// 探索範囲の端の候補の評価を下げる量
+	static const int MAX_CANDIDATE = 16;		// 評価する近傍の候補の数
+	pos_slate cand[MAX_CANDIDATE];
+	float distance[MAX_CANDIDATE];
+
 	int res = 0;
+	float best = -1.0f;
 
-	for(int i = 0; i < search_point_no; i ++){
-		if (distance_xy2(search_point[i].pos, self_loc) < radius){
-			if (search_point[i].probability > MIN_PROBABILITY){
-				*p = search_point[i].pos;
-				res = 1;
-				break;
-			}
+	WaitForSingleObject(mutex, INFINITE);
+	int num = search_index.query(self_loc, radius * 1000.0f, cand, distance, MAX_CANDIDATE);
+	ReleaseMutex(mutex);
+
+	for(int i = 0; i < num; i ++){
+		if (cand[i].probability <= MIN_PROBABILITY) continue;
+		float score = cand[i].probability - DISTANCE_WEIGHT * distance[i] / (radius * 1000.0f);
+		if (score > best){
+			best = score;
+			*p = cand[i].pos;
+			res = 1;
 		}
 	}
 
@@ -123,6 +189,7 @@ int detectTarget::getSearchPos(pos *p, pos self_loc, float radius)
 
 /*!
  * @brief 反射強度から探索対象の候補を計算する．
+ * 直近のWINDOW_TIMEの間の反射強度データを統合する（古いデータは破棄する）．
  *
  * @return 0
  */
@@ -132,13 +199,22 @@ int detectTarget::calculateIntensity()
 	const int DETECT_MIN_NUM = 5;
 	const int DETECT_MAX_NUM = 15;
 	
-	int num = 0;
+	static pos_inten window_data[MAX_INTENSITY_DATA];	// 直近の反射強度データ
+	int num = 0, i;
+
+	unsigned long now = timeGetTime();
+	for(i = 0; i < intensity_data_no; i ++){		// 新しい順にWINDOW_TIMEの間のデータを取り出す
+		int k = (intensity_data_top - 1 - i + MAX_INTENSITY_DATA) % MAX_INTENSITY_DATA;
+		if ((long)(now - intensity_time[k]) > WINDOW_TIME) break;
+		window_data[i] = intensity_data[k];
+	}
+	intensity_data_no = num = i;
 
-	integratePoints(intensity_data, intensity_data_no, integrated_point, &integrated_point_no, INTEGRATE_RADIUS);
-	intensity_data_no = 0;
+	integratePoints(window_data, num, integrated_point, &integrated_point_no, INTEGRATE_RADIUS);
 
 	WaitForSingleObject(mutex, INFINITE);
-	for(int i = 0; i < integrated_point_no; i++){
+	num = 0;
+	for(i = 0; i < integrated_point_no; i++){
 		if (integrated_point[i].count > DETECT_MIN_NUM){
 			slate_point[num].pos = integrated_point[i].pos;
 			slate_point[num].probability = min(max((float)(integrated_point[i].count - DETECT_MIN_NUM) / 
@@ -154,58 +230,45 @@ int detectTarget::calculateIntensity()
 
 /*!
  * @brief 探索対象ポイントを計算する．
+ * 候補でトラックを更新し，確定したトラックを探索点とする．
+ * 空間インデックスはトラックの番号で更新し，無くなったトラックだけを削除する．
+ *
+ * @param[in] time 候補を計算した時刻(ms)
  *
  * @return 0
  */
-int detectTarget::calculateSearchPoint()
+int detectTarget::calculateSearchPoint(unsigned long time)
 {
-	static const float INTEGRATE_RADIUS = 1.0f;		// 統合する半径(m)
-	static const float UP_PROBABILITY   = 0.1f;
-	static const float DOWN_PROBABILITY = 0.1f;
-
-	int i,j;
-
-	for(i = 0; i < slate_point_no; i ++){
-		for(j = 0; j < search_point_no; j ++){
-			if (distance_xy2(slate_point[i].pos, search_point[j].pos) <  INTEGRATE_RADIUS){
-				float prob_search = search_point[j].probability;
-				float prob_slate  = slate_point[i].probability;
-				search_point[j].pos.x = (int)((search_point[j].pos.x * prob_search + slate_point[i].pos.x * prob_slate) / (prob_search + prob_slate));
-				search_point[j].pos.y = (int)((search_point[j].pos.y * prob_search + slate_point[i].pos.y * prob_slate) / (prob_search + prob_slate));
-				search_point[j].pos.z = (int)((search_point[j].pos.z * prob_search + slate_point[i].pos.z * prob_slate) / (prob_search + prob_slate));
-				search_point[j].probability += (DOWN_PROBABILITY + UP_PROBABILITY * slate_point[i].probability);
-				break;
-			}
-		}
-		if (j == search_point_no){					// 同じ場所がなかった場合，探索ポイントを追加
-			if (search_point_no < MAX_SEARCH_POINT){
-				search_point[search_point_no] = slate_point[i];
-				search_point[search_point_no].probability = (DOWN_PROBABILITY + UP_PROBABILITY * slate_point[i].probability);
-				search_point_no ++;
-			}
-		}
-	}
-	qsort(search_point, search_point_no, sizeof(struct pos_slate_T), comp_slate);
-	
-	for(i = 0; i < search_point_no; i ++){		// 確率を下げて，0以下になったら探索対象から外す
-		search_point[i].probability -= DOWN_PROBABILITY;
-		if (search_point[i].probability <= 0.0f) break;
+	static pos_slate track_point[MAX_SEARCH_POINT];	// 確定したトラック
+	static int track_id[MAX_SEARCH_POINT];			// 確定したトラックの番号
+
+	tracker.update(slate_point, slate_point_no, time);
+	int num = tracker.getTracks(track_point, track_id, MAX_SEARCH_POINT);
+
+	WaitForSingleObject(mutex, INFINITE);
+	search_index.beginUpdate();
+	for(int i = 0; i < num; i ++){
+		search_index.update(track_id[i], track_point[i]);
 	}
-	search_point_no = i;
+	search_index.endUpdate();
+	ReleaseMutex(mutex);
 
 	return 0;
 }
 
 
 /*!
- * @brief 周期的な処理（1s程度）
+ * @brief 周期的な処理（UPDATE_PERIOD毎）
  *
  * @return 0
  */
 int detectTarget::update()
 {
+	unsigned long time = timeGetTime();
+
+	takeInputData();
 	calculateIntensity();
-	calculateSearchPoint();
+	calculateSearchPoint(time);
 
 	return 0;
 }
@@ -245,30 +308,57 @@ int detectTarget::comp_inten(const void *c1, const void *c2)
 
 
 /*!
- * @brief pos_slate型のソートのための比較関数
+ * @brief セルの集合の代表を求める（union-find）
+ * 経路を半分に縮めながら根をたどる．
  *
- * @param[in] c1 統合した位置１のポインタ
- * @param[in] c2 統合した位置２のポインタ
+ * @param[in,out] parent 親の番号の配列
+ * @param[in]     i      セルの番号
  *
- * @return 1:c1の個数が多い，0:個数が同じ，-1:c2の個数が少ない
+ * @return 代表のセルの番号
  */
-int detectTarget::comp_slate(const void *c1, const void *c2)
+int detectTarget::findRoot(int *parent, int i)
 {
-	const struct pos_slate_T *p1 = (struct pos_slate_T *)c1;
-	const struct pos_slate_T *p2 = (struct pos_slate_T *)c2;
-
-	if      (p2->probability > p1->probability) return 1;
-	else if (p2->probability < p1->probability) return -1;
-	else return 0;
+	while(parent[i] != i){
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
 }
 
+/*!
+ * @brief セルを探す（ハッシュの線形探査）
+ *
+ * @param[in,out] head      ハッシュの要素のセルの番号（-1:無し）
+ * @param[in]     hash_size ハッシュの大きさ（2のべき乗）
+ * @param[in,out] cell_x,cell_y セルの位置
+ * @param[in]     cx,cy     探すセルの位置
+ * @param[in,out] cell_num  セルの個数（NULLの場合は追加しない）
+ *
+ * @return セルの番号（無い場合は-1）
+ */
+int detectTarget::findCell(int *head, int hash_size, int *cell_x, int *cell_y, int cx, int cy, int *cell_num)
+{
+	unsigned int h = ((unsigned int)cx * 73856093u ^ (unsigned int)cy * 19349663u) & (hash_size - 1);
+	while(head[h] >= 0){
+		if ((cell_x[head[h]] == cx)&&(cell_y[head[h]] == cy)) return head[h];
+		h = (h + 1) & (hash_size - 1);
+	}
+	if (cell_num == NULL) return -1;
+	int c = head[h] = (*cell_num) ++;
+	cell_x[c] = cx, cell_y[c] = cy;
+	return c;
+}
 
 /*!
  * @brief 反射強度の大きい点を統合する．
+ * 一辺がradiusの半分のセル毎に点の個数と座標の和と点を囲む矩形を集計してから，セル同士をまとめる（占有されたセルの数に比例する時間）．
+ * 重心がradius以内の周囲のセルをunion-findで同じ集合にまとめ，集合毎の個数と重心を求める．
+ * 近いセルを辿って集合が連鎖的に広がらないように，まとめた集合を囲む矩形の対角線が2*radiusを越える結合は行わない
+ * （重心からradius以内の点を順に統合していた以前の方法と同じ広がり）．
  *
  * @param[in]  p   しきい値以上の反射強度データ(m)（現在のワールド座標系）
  * @param[in]  num しきい値以上の反射強度データの個数
- * @param[out] q   統合した反射強度の大きな位置(m)（現在のワールド座標系）
+ * @param[out] q   統合した反射強度の大きな位置(m)（現在のワールド座標系）個数の多い順
  * @param[out] num_pos_integrate 統合した反射強度の大きな位置の個数
  * @param[in]  radius 統合する半径
  *
@@ -276,35 +366,88 @@ int detectTarget::comp_slate(const void *c1, const void *c2)
  */
 int detectTarget::integratePoints(pos_inten *p, int num, pos_integrate *q, int *num_pos_integrate, float radius)
 {
-	int i, j, n, k = 0;
-	float radius2 = radius * radius;
-	
-	for(i = 0; i < num; i ++){
-		q[i].pos = p[i].pos;
-		q[i].count = 1;
+	static const int HASH_SIZE = 1 << 14;			// ハッシュの大きさ（2のべき乗，MAX_INTENSITY_DATAより大きい）
+	static const int REACH = 2;						// 調べる周囲のセルの範囲(セル数) radius / セルの一辺
+	static int head[HASH_SIZE];						// ハッシュの要素のセルの番号（-1:無し，線形探査）
+	static int cell_x[MAX_INTENSITY_DATA], cell_y[MAX_INTENSITY_DATA];	// セルの位置
+	static int count[MAX_INTENSITY_DATA];			// セルの点の個数
+	static double sum_x[MAX_INTENSITY_DATA], sum_y[MAX_INTENSITY_DATA], sum_z[MAX_INTENSITY_DATA];	// セルの座標の和
+	static pos center[MAX_INTENSITY_DATA];			// セルの重心(mm)
+	static int min_x[MAX_INTENSITY_DATA], min_y[MAX_INTENSITY_DATA], max_x[MAX_INTENSITY_DATA], max_y[MAX_INTENSITY_DATA];
+													// 点を囲む矩形(mm)（代表のセルは集合の値）
+	static int parent[MAX_INTENSITY_DATA];			// union-findの親
+	static int cluster[MAX_INTENSITY_DATA];			// 代表のセルの集合の番号（-1:未登録）
+	static double cluster_x[MAX_INTENSITY_DATA], cluster_y[MAX_INTENSITY_DATA], cluster_z[MAX_INTENSITY_DATA];
+													// 集合の座標の和
+
+	const float cell = radius * 1000.0f / REACH;	// mm
+	const float radius2 = radius * radius;
+	const float extent2 = 4.0f * radius2;
+	int i, cell_num = 0, n = 0;
+
+	num = min(num, MAX_INTENSITY_DATA);
+	for(i = 0; i < HASH_SIZE; i ++) head[i] = -1;
+	for(i = 0; i < num; i ++){						// セル毎に集計
+		int c = findCell(head, HASH_SIZE, cell_x, cell_y, (int)floor(p[i].pos.x / cell), (int)floor(p[i].pos.y / cell), &cell_num);
+		if (count[c] == 0){
+			sum_x[c] = sum_y[c] = sum_z[c] = 0;
+			min_x[c] = max_x[c] = p[i].pos.x;
+			min_y[c] = max_y[c] = p[i].pos.y;
+			parent[c] = c;
+		}
+		count[c] ++;
+		sum_x[c] += p[i].pos.x, sum_y[c] += p[i].pos.y, sum_z[c] += p[i].pos.z;
+		min_x[c] = min(min_x[c], p[i].pos.x), max_x[c] = max(max_x[c], p[i].pos.x);
+		min_y[c] = min(min_y[c], p[i].pos.y), max_y[c] = max(max_y[c], p[i].pos.y);
 	}
-	n = num;
-	for(i = 0; i < n; i ++){
-		if (!q[i].count) continue;
-		for(j = i + 1; j < n; j ++){
-			if (!q[j].count) continue;
-			if (distance_xy2(q[i].pos, q[j].pos) <= radius2){
-				int c = q[i].count;
-				q[i].pos.x = (q[i].pos.x * c + q[j].pos.x) / (c + 1);
-				q[i].pos.y = (q[i].pos.y * c + q[j].pos.y) / (c + 1);
-				q[i].pos.z = (q[i].pos.z * c + q[j].pos.z) / (c + 1);
-				q[i].count ++;
-				q[j].count = 0;
+	for(i = 0; i < cell_num; i ++){
+		center[i].x = (int)(sum_x[i] / count[i]);
+		center[i].y = (int)(sum_y[i] / count[i]);
+		center[i].z = (int)(sum_z[i] / count[i]);
+	}
+
+	for(i = 0; i < cell_num; i ++){					// 周囲のセルと結合
+		for(int dx = -REACH; dx <= REACH; dx ++){
+			for(int dy = -REACH; dy <= REACH; dy ++){
+				int j = findCell(head, HASH_SIZE, cell_x, cell_y, cell_x[i] + dx, cell_y[i] + dy, NULL);
+				if (j <= i) continue;				// 組は１回だけ調べる（無いセルは-1）
+				if (distance_xy2(center[i], center[j]) > radius2) continue;
+				int ri = findRoot(parent, i), rj = findRoot(parent, j);
+				if (ri == rj) continue;
+				pos lo = {0, 0, 0}, hi = {0, 0, 0};	// 結合した集合を囲む矩形
+				lo.x = min(min_x[ri], min_x[rj]), lo.y = min(min_y[ri], min_y[rj]);
+				hi.x = max(max_x[ri], max_x[rj]), hi.y = max(max_y[ri], max_y[rj]);
+				if (distance_xy2(lo, hi) > extent2) continue;
+				parent[rj] = ri;
+				min_x[ri] = lo.x, min_y[ri] = lo.y;
+				max_x[ri] = hi.x, max_y[ri] = hi.y;
 			}
 		}
 	}
 
-	// 個数によりソーティング
-	qsort(q, n, sizeof(struct pos_integrate_T), comp_inten);
-	for(i = 0; i < n; i ++){				// データを前に詰める
-		if (!q[i].count) break;
+	for(i = 0; i < cell_num; i ++) cluster[i] = -1;
+	for(i = 0; i < cell_num; i ++){					// 集合毎の個数と重心
+		int r = findRoot(parent, i);
+		if (cluster[r] < 0){
+			cluster[r] = n;
+			cluster_x[n] = cluster_y[n] = cluster_z[n] = 0;
+			q[n].count = 0;
+			n ++;
+		}
+		int k = cluster[r];
+		cluster_x[k] += sum_x[i], cluster_y[k] += sum_y[i], cluster_z[k] += sum_z[i];
+		q[k].count += count[i];
+		count[i] = 0;								// 次の呼び出しのために戻す
+	}
+	for(i = 0; i < n; i ++){
+		q[i].pos.x = (int)(cluster_x[i] / q[i].count);
+		q[i].pos.y = (int)(cluster_y[i] / q[i].count);
+		q[i].pos.z = (int)(cluster_z[i] / q[i].count);
 	}
-	*num_pos_integrate = i;
+
+	// 個数によりソーティング（集合の数だけ）
+	qsort(q, n, sizeof(struct pos_integrate_T), comp_inten);
+	*num_pos_integrate = n;
 
 	return 0;
 }
@@ -323,15 +466,23 @@ DWORD WINAPI detectTarget::ThreadFunc(LPVOID lpParameter)
 
 /*!
  * @brief 別スレッドで動作する関数
- * ロボットの制御を別スレッドで行う．
+ * 探索対象の検出を別スレッドで行う．
+ * UPDATE_PERIOD毎の期限か，入力バッファが一杯に近くなった時に計算する．
  *
  * @return S_OK
  */
 DWORD WINAPI detectTarget::ExecThread()
 {
+	unsigned long deadline = timeGetTime() + UPDATE_PERIOD;
+
 	while(!terminate){
+		long wait = (long)(deadline - timeGetTime());
+		if ((wait <= 0)||(WaitForSingleObject(input_event, wait) != WAIT_OBJECT_0)){
+			deadline += UPDATE_PERIOD;							// 期限で計算した場合は次の期限
+			if ((long)(deadline - timeGetTime()) < 0) deadline = timeGetTime() + UPDATE_PERIOD;
+		}
+		if (terminate) break;
 		update();
-		Sleep(1000);
 	}
 	return S_OK; 
 }
@@ -1,5 +1,7 @@
 ﻿#pragma once
 #include "dataType.h"
+#include "targetTracker.h"
+#include "searchIndex.h"
 
 class detectTarget
 {
@@ -10,8 +12,25 @@ public:
 private:
 	// 反射強度データ
 	static const int MAX_INTENSITY_DATA = 10000;	//! 反射強度のデータの最大個数
+	static const int WINDOW_TIME = 1000;			//! 候補の計算に使う反射強度のデータの時間(ms)
+	static const int UPDATE_PERIOD = 100;			//! 候補とトラックを更新する周期(ms)
 	int intensity_data_no;							//! 反射強度のデータの個数
-	pos_inten intensity_data[MAX_INTENSITY_DATA];	//! 反射強度のデータ
+	int intensity_data_top;							//! 次に反射強度のデータを書き込む位置（リングバッファ）
+	pos_inten intensity_data[MAX_INTENSITY_DATA];	//! 反射強度のデータ（スレッドだけが使う）
+	unsigned long intensity_time[MAX_INTENSITY_DATA];	//! 反射強度のデータをセットした時刻(ms)
+
+	// 反射強度データの入力（ダブルバッファ）
+	static const int MAX_INPUT_DATA = 10000;		//! 入力バッファ１つの反射強度のデータの最大個数
+	static const int INPUT_WAKE_DATA = MAX_INPUT_DATA / 2;	//! 期限の前に計算を始める入力のデータの個数
+	static const int INPUT_SHIFT = 30;				//! input_stateの書き込み中のバッファの番号のビット位置
+	static const LONG INPUT_COUNT_MASK = (1 << INPUT_SHIFT) - 1;	//! input_stateの予約した個数のマスク
+	pos_inten input_data[2][MAX_INPUT_DATA];		//! 入力バッファの反射強度のデータ
+	unsigned long input_time[2][MAX_INPUT_DATA];	//! 入力バッファのデータをセットした時刻(ms)
+	volatile LONG input_state;						//! 書き込み中のバッファの番号(bit30)と予約した個数
+	volatile LONG input_written[2];					//! バッファ毎の書き込みを終えた個数
+	volatile LONG input_dropped;					//! バッファが溢れて破棄した個数
+	HANDLE input_event;								//! 入力バッファが一杯に近いことを通知するイベント
+	int takeInputData();							// 入力バッファを交換して反射強度データを取り出す
 
 	// 探索対象の候補
 	static const int MAX_SLATE_POINT = 100;			//! 探索対象の候補の最大個数
@@ -20,8 +39,8 @@ private:
 
 	// 探索対象
 	static const int MAX_SEARCH_POINT = 100;		//! 探索点の最大個数
-	int search_point_no;							//! 探索点の個数
-	pos_slate search_point[MAX_SEARCH_POINT];		//! 探索点のデータ
+	searchIndex search_index;						//! 探索点（確定したトラック）の空間インデックス
+	targetTracker tracker;							//! 探索対象の候補の追跡
 
 	/*!
 	 * @struct pos_integrate_T
@@ -37,9 +56,11 @@ private:
 
 	float distance_xy2(pos p, pos q);				// 点の距離を求める(m)
 	static int comp_inten(const void *c1, const void *c2);	// pos_inten型のソートのための比較関数
-	static int comp_slate(const void *c1, const void *c2);	// pos_slate型のソートのための比較関数
 	int integratePoints(pos_inten *p, int num, pos_integrate *q, int *num_pos_integrate, float radius);
 													// 反射強度の大きい点を統合する
+	static int findCell(int *head, int hash_size, int *cell_x, int *cell_y, int cx, int cy, int *cell_num);
+													// セルを探す（ハッシュの線形探査）
+	static int findRoot(int *parent, int i);		// セルの集合の代表を求める（union-find）
 
 	int terminate;									//! スレッドを破棄（1:破棄, 0:継続）
 	static DWORD WINAPI ThreadFunc(LPVOID lpParameter);		// スレッドのエントリーポイント
@@ -53,6 +74,6 @@ public:
 	int getTargetPos(pos_slate *p, int *num);		// 探索対象の位置と確率セット
 	int getSearchPos(pos *p, pos self_loc, float radius);			// 探索範囲内の探索対象の位置（0:探索対象無し，1:有り）
 	int calculateIntensity();						// 反射強度データのセットから探索対象の候補を選定
-	int calculateSearchPoint();						// 探索対象ポイントを計算
-	int update();									// 周期的な処理（1s程度）
+	int calculateSearchPoint(unsigned long time);	// 探索対象ポイントを計算
+	int update();									// 周期的な処理（UPDATE_PERIOD毎）
 };
@@ -0,0 +1,202 @@
+﻿/*!
+ * @file  estimateGround.cpp
+ * @brief 地面の推定と点の分類
+ *
+ * URGの高さを基準とした固定の高さの帯では，坂で地面が障害物として検出される．
+ * チルトの掃引毎にセル毎の最小の高さから地面を推定し，点を地面からの高さで分類する．
+ */
+
+#include "stdafx.h"
+#include "estimateGround.h"
+#include <math.h>
+
+/*!
+ * @class estimateGround
+ * @brief 地面を推定して点を地面，障害物，ロボットより高い物体に分類するクラス
+ */
+
+/*!
+ * @brief コンストラクタ
+ */
+estimateGround::estimateGround()
+{
+	clear();
+}
+
+/*!
+ * @brief デストラクタ
+ */
+estimateGround::~estimateGround()
+{
+}
+
+/*!
+ * @brief データをクリアする
+ *
+ * @return 0
+ */
+int estimateGround::clear()
+{
+	for(int i = 0; i < GRID_NUM; i ++){
+		for(int j = 0; j < GRID_NUM; j ++){
+			cell[i][j].ix = cell[i][j].iy = 0x7fffffff;		// どのセルとも一致しない
+			cell[i][j].stamp = -1;
+		}
+	}
+	sweep_no = 0;
+	cur = 0;
+	ground_ix = ground_iy = 0;
+
+	return 0;
+}
+
+/*!
+ * @brief 座標からセルの番号を求める
+ *
+ * @param[in] v 座標(mm)
+ *
+ * @return セルの番号
+ */
+int estimateGround::toIndex(float v)
+{
+	return (int)floor(v / CELL_SIZE);
+}
+
+/*!
+ * @brief セルを取得（古いデータはクリア）
+ *
+ * @param[in] ix x方向のセルの番号
+ * @param[in] iy y方向のセルの番号
+ *
+ * @return セル
+ */
+struct estimateGround::cell_T *estimateGround::getCell(int ix, int iy)
+{
+	struct cell_T *c = &cell[((ix % GRID_NUM) + GRID_NUM) % GRID_NUM][((iy % GRID_NUM) + GRID_NUM) % GRID_NUM];
+
+	if ((c->ix != ix)||(c->iy != iy)){
+		c->ix = ix, c->iy = iy;
+		for(int k = 0; k < 2; k ++){
+			c->min_z[k] = NO_DATA, c->max_z[k] = -NO_DATA, c->num[k] = 0;
+		}
+		c->stamp = -1;
+	}
+	return c;
+}
+
+/*!
+ * @brief 地面の高さを取得
+ * 前回推定した範囲外では，ロボットと同じ高さの平らな地面とする．
+ *
+ * @param[in] ix x方向のセルの番号
+ * @param[in] iy y方向のセルの番号
+ *
+ * @return 地面の高さ(mm) URGの高さが基準
+ */
+float estimateGround::getGround(int ix, int iy)
+{
+	if ((sweep_no > 0)&&(abs(ix - ground_ix) <= GRID_HALF)&&(abs(iy - ground_iy) <= GRID_HALF)){
+		const struct cell_T *c = &cell[((ix % GRID_NUM) + GRID_NUM) % GRID_NUM][((iy % GRID_NUM) + GRID_NUM) % GRID_NUM];
+		if ((c->ix == ix)&&(c->iy == iy)&&(c->stamp == sweep_no - 1)) return c->ground;
+	}
+	return -URG_HEIGHT;
+}
+
+/*!
+ * @brief 1スキャン分の点を追加して分類する
+ * セル毎の最小と最大の高さを更新し，前回推定した地面からの高さで分類する．
+ *
+ * @param[in]  x,y,the  スキャンの時刻のオドメトリ(m, rad)
+ * @param[in]  px,py,pz ロボット座標系での点の位置(mm) 全て0の点は無効
+ * @param[in]  n        点の数
+ * @param[out] height   地面からの高さ(mm)
+ * @param[out] label    分類(LABEL_GROUND, LABEL_OBSTACLE, LABEL_OVERHANG)
+ *
+ * @return 0
+ */
+int estimateGround::addPoints(float x, float y, float the, const float *px, const float *py, const float *pz, int n,
+	short *height, unsigned char *label)
+{
+	float ox = x * 1000.0f, oy = y * 1000.0f;
+	float c = cos(the), s = sin(the);
+	int rx = toIndex(ox), ry = toIndex(oy);
+
+	for(int i = 0; i < n; i ++){
+		height[i] = 0, label[i] = LABEL_GROUND;
+		if ((px[i] == 0)&&(py[i] == 0)&&(pz[i] == 0)) continue;
+		int ix = toIndex(ox + c * px[i] - s * py[i]);
+		int iy = toIndex(oy + s * px[i] + c * py[i]);
+		if ((abs(ix - rx) <= GRID_HALF)&&(abs(iy - ry) <= GRID_HALF)){
+			struct cell_T *p = getCell(ix, iy);
+			short z = (short)max(min(pz[i], (float)NO_DATA - 1), (float)-NO_DATA + 1);
+			if (z < p->min_z[cur]) p->min_z[cur] = z;
+			if (z > p->max_z[cur]) p->max_z[cur] = z;
+			if (p->num[cur] < NO_DATA) p->num[cur] ++;
+		}
+
+		float h = pz[i] - getGround(ix, iy);
+		height[i] = (short)max(min(h, (float)NO_DATA), (float)-NO_DATA);
+		if      (h <= GROUND_TOLERANCE) label[i] = LABEL_GROUND;
+		else if (h >  OVERHANG_HEIGHT ) label[i] = LABEL_OVERHANG;
+		else                            label[i] = LABEL_OBSTACLE;
+	}
+	return 0;
+}
+
+/*!
+ * @brief 掃引が終わったら地面を推定する
+ * ロボットのセルを地面として，幅優先で隣のセルに地面を広げる．
+ * 点が十分にあって高さの幅が小さく，地面との差が傾斜の範囲内のセルは計測した高さを地面とする．
+ * それ以外のセル（障害物や計測していないセル）には隣の地面の高さを引き継ぐ．
+ * チルトは上向きのため近くの地面は見えないので，計測していないセルを越える時は差の許容量を増やす．
+ *
+ * @param[in] x,y 掃引が終わった時のオドメトリ(m)
+ *
+ * @return 地面を計測したセルの数
+ */
+int estimateGround::updateSweep(float x, float y)
+{
+	static const int dir[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+	int rx = toIndex(x * 1000.0f), ry = toIndex(y * 1000.0f);
+	int head = 0, tail = 0, ground_num = 0;
+
+	struct cell_T *c0 = getCell(rx, ry);
+	c0->ground = -URG_HEIGHT, c0->gap = 0, c0->stamp = sweep_no;
+	queue[tail ++] = GRID_HALF * GRID_NUM + GRID_HALF;
+	while(head < tail){
+		int dx = queue[head] / GRID_NUM - GRID_HALF, dy = queue[head] % GRID_NUM - GRID_HALF;
+		head ++;
+		const struct cell_T *c = getCell(rx + dx, ry + dy);
+		for(int k = 0; k < 4; k ++){
+			int nx = dx + dir[k][0], ny = dy + dir[k][1];
+			if ((abs(nx) > GRID_HALF)||(abs(ny) > GRID_HALF)) continue;
+			struct cell_T *p = getCell(rx + nx, ry + ny);
+			if (p->stamp == sweep_no) continue;
+
+			int num   = p->num[0] + p->num[1];
+			int min_z = min(p->min_z[0], p->min_z[1]);
+			int max_z = max(p->max_z[0], p->max_z[1]);
+			int allow = MAX_STEP * (c->gap + 1);
+			if ((num >= MIN_POINTS)&&(max_z - min_z <= FLAT_TOLERANCE)&&(abs(min_z - c->ground) <= allow)){
+				p->ground = (short)min_z, p->gap = 0;
+				ground_num ++;
+			} else {
+				p->ground = c->ground, p->gap = (short)min(c->gap + 1, MAX_GAP);
+			}
+			p->stamp = sweep_no;
+			queue[tail ++] = (nx + GRID_HALF) * GRID_NUM + (ny + GRID_HALF);
+		}
+	}
+	ground_ix = rx, ground_iy = ry;
+
+	// 次の掃引の準備（前回のデータは残して，２回分の掃引で推定する）
+	sweep_no ++;
+	cur ^= 1;
+	for(int i = 0; i < GRID_NUM; i ++){
+		for(int j = 0; j < GRID_NUM; j ++){
+			cell[i][j].min_z[cur] = NO_DATA, cell[i][j].max_z[cur] = -NO_DATA, cell[i][j].num[cur] = 0;
+		}
+	}
+
+	return ground_num;
+}
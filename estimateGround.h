@@ -0,0 +1,62 @@
+﻿#pragma once
+
+class estimateGround
+{
+public:
+	estimateGround();									// コンストラクタ
+	virtual ~estimateGround();							// デストラクタ
+
+	static const int URG_HEIGHT = 600;					//! 地面からURGまでの高さ(mm)（取付け高さを測って設定）
+	static const int GROUND_TOLERANCE = 100;			//! 地面とする地面からの高さ(mm)
+	static const int OVERHANG_HEIGHT = 1600;			//! これより高い点はロボットが下を通れるものとする(mm)
+
+	static const unsigned char LABEL_GROUND   = 0;		//! 地面
+	static const unsigned char LABEL_OBSTACLE = 1;		//! 障害物
+	static const unsigned char LABEL_OVERHANG = 2;		//! ロボットより高い物体
+
+private:
+	static const int CELL_SIZE = 200;					//! セルの一辺(mm)
+	static const int GRID_HALF = 50;					//! ロボットから片側のセル数（±10m）
+	static const int GRID_NUM = GRID_HALF * 2 + 1;		//! 一辺のセル数
+	static const int FLAT_TOLERANCE = 100;				//! 地面の候補とするセル内の高さの幅(mm)
+	static const int MIN_POINTS = 3;					//! 地面の候補とするセル内の最小の点数
+	static const int MAX_STEP = 30;						//! 隣のセルとの地面の高さの最大差(mm) 傾斜約8.5deg
+	static const int MAX_GAP = 40;						//! 計測していないセルを越えて傾斜を許容する最大セル数
+	static const short NO_DATA = 32767;					//! データ無し
+
+	/*!
+	 * @struct cell_T
+	 * @brief グリッドのセル（オドメトリの座標系で固定，リングバッファで再利用）
+	 */
+	struct cell_T{
+		int ix, iy;										//!< セルの番号（一致しない場合は古いデータ）
+		short min_z[2], max_z[2];						//!< 現在と前回の掃引での最小と最大の高さ(mm) URGの高さが基準
+		short num[2];									//!< 現在と前回の掃引での点の数
+		short ground;									//!< 推定した地面の高さ(mm) URGの高さが基準
+		short gap;										//!< 地面を計測したセルからの距離（セル数）
+		int stamp;										//!< 地面を推定した掃引の番号
+	} cell[GRID_NUM][GRID_NUM];
+	int sweep_no;										//! 掃引の番号
+	int cur;											//! 現在の掃引のデータの番号(0,1)
+	int ground_ix, ground_iy;							//! 地面を推定した時のロボットのセル
+	int queue[GRID_NUM * GRID_NUM];						//! 地面の推定で使う待ち行列
+
+	static int toIndex(float v);						// 座標からセルの番号を求める
+	struct cell_T *getCell(int ix, int iy);				// セルを取得（古いデータはクリア）
+	float getGround(int ix, int iy);					// 地面の高さを取得
+
+public:
+	int clear();										// データをクリアする
+	int addPoints(float x, float y, float the, const float *px, const float *py, const float *pz, int n,
+		short *height, unsigned char *label);			// 1スキャン分の点を追加して分類する
+	int updateSweep(float x, float y);					// 掃引が終わったら地面を推定する
+};
+
+/*
+ * 使い方
+ * 1) スキャン毎にaddPoints(オドメトリ, 点群, 地面からの高さ, ラベル)を呼び出す．
+ *    点はロボット座標系(mm)，オドメトリはスキャンの時刻の値(m, rad)．
+ *    点は前回の掃引で推定した地面を基準に分類される（推定前は平らな地面とする）．
+ * 2) チルトが折り返すたびにupdateSweep(オドメトリ)を呼び出す．
+ *    ロボットの下を地面として，傾斜が小さく平らなセルを辿って地面を広げる．
+ */
@@ -1,7 +1,14 @@
 ﻿// IMUに独自仕様の基板とプロトコルで通信している
+// "e"を送ると，x,y,z軸の角度を16bitの16進数4文字ずつで返す
 
 #include "stdafx.h"
+#include <math.h>
+#include <mmsystem.h>
 #include "imu.h"
+#include "megaRover.h"
+#include "logger.h"
+
+#define	M_PI	3.14159f
 
 /*!
  * @class imu
@@ -9,10 +16,14 @@
  * @author Y.Hayashibara
  */
 
+const float imu::COEF = -0.00836181640625f;
+
 /*!
  * @brief コンストラクタ
  */
-imu::imu()
+imu::imu():
+terminate(0), pause(0), thread(NULL), rover(NULL), is_first(1), last_z(0), sum_z(0),
+timeouts(0), errors(0)
 {
 }
 
@@ -25,6 +36,7 @@ imu::~imu()
 
 /*!
  * @brief 初期化
+ * 角度を受信するスレッドを開始する．
  *
  * @param[in] com_port 通信ポートの番号(1-)
  *
@@ -35,6 +47,10 @@ int imu::Init(int com_port)
 	int res = comm.Open(com_port, 115200);
 	comm.Send("0");
 
+	DWORD threadId;								// スレッド ID
+	thread = CreateThread(NULL, 0, ThreadFunc, (LPVOID)this, 0, &threadId);
+	SetThreadPriority(thread, THREAD_PRIORITY_ABOVE_NORMAL);
+
 	return res;
 }
 
@@ -45,6 +61,13 @@ int imu::Init(int com_port)
  */
 int imu::Close()
 {
+	terminate = 1;
+	if (thread != NULL){
+		WaitForSingleObject(thread, 1000);
+		CloseHandle(thread);
+		thread = NULL;
+	}
+	LOG("imu samples:%d, timeouts:%d, errors:%d\n", ring.size(), timeouts, errors);
 	comm.Close();
 	return 0;
 }
@@ -52,61 +75,218 @@ int imu::Close()
 /*!
  * @brief IMUのリセット
  * IMUのオフセットのリセット (7秒間停止)
+ * 受信スレッドの要求を止めてから行う．
  *
  * @return 0
  */
 int imu::Reset()
 {
+	InterlockedExchange(&pause, 1);
+	Sleep(REQUEST_PERIOD + REPLY_TIMEOUT);	// 要求中の応答を待つ
 	comm.Send("a");
 	Sleep(7000);			// resetに6.6秒かかる
 	comm.ClearRecvBuf();	// 受信用バッファをクリア
+	is_first = 1;
+	InterlockedExchange(&pause, 0);
 
 	return 0;
 }
 
 /*!
- * @brief 角度の取得の開始
+ * @brief 受信する毎に方位を入力するロボットを設定
+ *
+ * @param[in] rover ロボットのクラスのポインタ（NULLの場合は入力しない）
  *
  * @return 0
  */
-int imu::GetAngleStart()
+int imu::setRover(megaRover *rover)
 {
-	comm.Send("e");
+	this->rover = rover;
 
 	return 0;
 }
 
 /*!
- * @brief 角度の取得
+ * @brief スレッドのエントリーポイント
  *
- * @param[in] x x軸方向の角度(rad)
- * @param[in] y y軸方向の角度(rad)
- * @param[in] z z軸方向の角度(rad)
+ * @param[in] lpParameter インスタンスのポインタ
+ *
+ * @return S_OK
+ */
+DWORD WINAPI imu::ThreadFunc(LPVOID lpParameter)
+{
+	return ((imu*)lpParameter)->ExecThread();
+}
+
+/*!
+ * @brief 別スレッドで動作する関数
+ * REQUEST_PERIOD毎に角度を要求し，受信した角度を履歴に追加する．
+ *
+ * @return S_OK
+ */
+DWORD WINAPI imu::ExecThread()
+{
+	while(!terminate){
+		unsigned long start = timeGetTime();
+		if (!InterlockedCompareExchange(&pause, 0, 0)){
+			sample_T s;
+			if (requestAngle(&s) == 0){
+				ring.add(s);
+				if (rover != NULL) rover->setGyroAngle(s.z * M_PI / 180.0f, s.time);
+			}
+		}
+		long rest = REQUEST_PERIOD - (long)(timeGetTime() - start);
+		if (rest > 0) Sleep(rest);
+	}
+	return S_OK;
+}
+
+/*!
+ * @brief 角度を要求して応答を受信
+ * 前の応答の残りを捨ててから要求し，16進数がFRAME_LEN文字揃ったら１つの応答とする．
+ * 途中で16進数以外の文字が来た場合は途切れた応答として捨てる．
+ * 計測した時刻は要求と受信の中間とする．
+ *
+ * @param[out] s 時刻付きの角度
+ *
+ * @return 0:成功，-1:タイムアウトか通信のエラー
+ */
+int imu::requestAngle(sample_T *s)
+{
+	const int max_no = 100;
+	char buf[max_no], hex[FRAME_LEN + 1];
+	int n = 0;
+
+	comm.ClearRecvBuf();
+	unsigned long t0 = timeGetTime();
+	comm.Send("e");
+	for(;;){
+		long rest = REPLY_TIMEOUT - (long)(timeGetTime() - t0);
+		if ((rest <= 0)||(comm.WaitRecv(rest) <= 0)){
+			timeouts ++;
+			return -1;
+		}
+		int len = comm.Recv(buf, max_no);
+		for(int i = 0; i < len; i ++){
+			char c = buf[i];
+			if (((c >= '0')&&(c <= '9'))||((c >= 'a')&&(c <= 'f'))||((c >= 'A')&&(c <= 'F'))){
+				hex[n ++] = c;
+				if (n == FRAME_LEN){
+					unsigned long t1 = timeGetTime();
+					hex[n] = '\0';
+					s->time = t0 + (t1 - t0) / 2;
+					return parseFrame(hex, s);
+				}
+			} else if (n > 0){								// 途切れた応答
+				errors ++;
+				n = 0;
+			}
+		}
+	}
+}
+
+/*!
+ * @brief 応答の16進数を角度に変換
+ * z軸は16bitの数値が一周するので，前回からの変化を積算して連続した角度にしてから-180～180度にする．
+ *
+ * @param[in]  hex FRAME_LEN文字の16進数
+ * @param[out] s   角度（timeはそのまま）
  *
  * @return 0
  */
+int imu::parseFrame(const char *hex, sample_T *s)
+{
+	char w[5];
+	int v[3];
+
+	for(int i = 0; i < 3; i ++){
+		strncpy(w, hex + i * 4, 4);
+		w[4] = '\0';
+		v[i] = strtol(w, NULL, 0x10);
+	}
+	if (v[0] >= 0x8000) v[0] -= 0x10000;
+	if (v[1] >= 0x8000) v[1] -= 0x10000;
+
+	if (is_first){
+		is_first = 0;
+		sum_z = (v[2] >= 0x8000) ? v[2] - 0x10000 : v[2];
+	} else {
+		sum_z += (short)(v[2] - last_z);				// 16bitの差で一周を越えた変化も正しく積算する
+	}
+	last_z = v[2];
+
+	float z = COEF * sum_z;
+	z -= 360.0f * floor((z + 180.0f) / 360.0f);
+	s->x = COEF * v[0];
+	s->y = COEF * v[1];
+	s->z = z;
+
+	return 0;
+}
+
+/*!
+ * @brief 最新の時刻付きの角度
+ *
+ * @param[out] s 時刻付きの角度
+ *
+ * @return 0:成功，-1:受信していない
+ */
+int imu::getLatest(sample_T *s)
+{
+	return ring.latest(s);
+}
+
+/*!
+ * @brief 最新の角度の取得
+ *
+ * @param[out] x x軸周りの角度(deg)
+ * @param[out] y y軸周りの角度(deg)
+ * @param[out] z z軸周りの角度(deg)
+ *
+ * @return 0:成功，-1:受信していない
+ */
 int imu::GetAngle(float *x, float *y, float *z)
 {
-	const float COEF = -0.00836181640625f;
-	const int max_no = 100;
-	static char buf[max_no];
-	char w[10], *e;
-	int x1, y1, z1;
-
-	if (comm.Recv(buf, max_no) <= 0) return -1;
-	strncpy(w, buf  , 4);
-	x1 = strtol(w, &e, 0x10);
-	if (x1 >= 0x8000) x1 -= 0x10000;
-	strncpy(w, buf+4, 4);
-	y1 = strtol(w, &e, 0x10);
-	if (y1 >= 0x8000) y1 -= 0x10000;
-	strncpy(w, buf+8, 4);
-	z1 = strtol(w, &e, 0x10);
-	if (z1 >= 0x8000) z1 -= 0x10000;
-
-	*x = COEF * x1;
-	*y = COEF * y1;
-	*z = COEF * z1;
+	sample_T s;
+	if (getLatest(&s)) return -1;
+	*x = s.x, *y = s.y, *z = s.z;
+
+	return 0;
+}
+
+/*!
+ * @brief 指定した時刻の角度
+ * 時刻を挟む２つの角度を線形に補間する（z軸は-180～180度の境界を考慮）．
+ * 範囲外の時刻は端の角度を戻す．
+ *
+ * @param[in]  time  時刻(ms) timeGetTime()の値
+ * @param[out] x,y,z 角度(deg)
+ *
+ * @return 0:範囲内，1:範囲外のため端の値，-1:受信していない
+ */
+int imu::getAngleAt(unsigned long time, float *x, float *y, float *z)
+{
+	sample_T a, b;
+	int res = ring.find(time, &a, &b);
+	if (res < 0) return -1;
+	if (res == ring.NEWER){								// 最新より新しい
+		*x = b.x, *y = b.y, *z = b.z;
+		return ((long)(time - b.time) > REQUEST_PERIOD) ? 1 : 0;
+	}
+	if (res == ring.OLDER){								// 最も古いものより古い
+		*x = a.x, *y = a.y, *z = a.z;
+		return 1;
+	}
+
+	float r = (b.time != a.time) ? (float)(long)(time - a.time) / (float)(long)(b.time - a.time) : 0;
+	float dz = b.z - a.z;
+	if (dz >  180.0f) dz -= 360.0f;
+	if (dz < -180.0f) dz += 360.0f;
+	*x = a.x + r * (b.x - a.x);
+	*y = a.y + r * (b.y - a.y);
+	*z = a.z + r * dz;
+	if (*z >  180.0f) *z -= 360.0f;
+	if (*z < -180.0f) *z += 360.0f;
 
 	return 0;
 }
@@ -1,20 +1,66 @@
 ﻿#pragma once
 #include "comm.h"
+#include "timedRing.h"
 
 #define	IMU_COM_PORT	4
 
+class megaRover;
+
 class imu
 {
 public:
 	imu();										// コンストラクタ
 	virtual ~imu();								// デストラクタ
 
+	static const int MAX_SAMPLE = 256;			//! 角度の履歴の最大個数（10ms周期で約2.5秒分）
+
+	/*!
+	 * @struct sample_T
+	 * @brief 時刻付きの角度
+	 */
+	struct sample_T{
+		unsigned long time;						//!< 計測した時刻(ms) timeGetTime()の値
+		float x, y, z;							//!< x,y,z軸周りの角度(deg) -180～180
+	};
+
+private:
+	static const int REQUEST_PERIOD = 10;		//! 角度を要求する周期(ms)
+	static const int REPLY_TIMEOUT = 50;		//! 応答を待つ最大の時間(ms)
+	static const int FRAME_LEN = 12;			//! 応答の16進数の文字数（x,y,z各4文字）
+	static const float COEF;					//! 角度の数値から角度(deg)への係数
+
+	timedRing<sample_T, MAX_SAMPLE> ring;		//! 角度の履歴（受信スレッドだけが書き込み，ロック無しで読む）
+
+	int terminate;								//! スレッドの破棄（1:破棄, 0:継続）
+	volatile LONG pause;						//! 角度の要求の一時停止（1:停止）
+	HANDLE thread;								//! 受信スレッドのハンドル
+	megaRover *rover;							//! 方位を入力するロボット（NULLの場合は入力しない）
+	int is_first;								//! 最初の応答を待っている（z軸の連続した角度の初期化）
+	int last_z;									//! 前回のz軸の角度の数値（16bit）
+	long sum_z;									//! 一周を超えて連続したz軸の角度の数値
+	int timeouts, errors;						//! 応答が無かった回数，途中で途切れた応答の数
+
+	static DWORD WINAPI ThreadFunc(LPVOID lpParameter);	// スレッドのエントリーポイント
+	DWORD WINAPI ExecThread();					// 別スレッドで動作する関数
+	int requestAngle(sample_T *s);				// 角度を要求して応答を受信
+	int parseFrame(const char *hex, sample_T *s);	// 応答の16進数を角度に変換
+
 public:
 	CComm comm;									// 通信ポートのクラス
 
-	int Init(int com_port);						// 初期化
+	int Init(int com_port);						// 初期化（受信スレッドを開始）
 	int Close();								// 終了処理
 	int Reset();								// IMUのリセット
-	int GetAngleStart();						// 角度の取得の開始
-	int GetAngle(float *x, float *y, float *z);	// 角度の取得
+	int setRover(megaRover *rover);				// 受信する毎に方位を入力するロボットを設定
+	int GetAngle(float *x, float *y, float *z);	// 最新の角度の取得(deg)
+	int getLatest(sample_T *s);					// 最新の時刻付きの角度
+	int getAngleAt(unsigned long time, float *x, float *y, float *z);	// 指定した時刻の角度(deg)
 };
+
+/*
+ * 使い方
+ * 1) Init(ポート番号)で受信スレッドを開始する．スレッドはREQUEST_PERIOD毎に角度を要求し，
+ *    応答を受信した時刻で履歴に追加する
+ * 2) setRover(&mega_rover)を設定すると，受信する毎にmegaRover::setGyroAngle()で方位を入力する
+ * 3) GetAngle()で最新の角度，getAngleAt(時刻)で前後の角度から補間した角度をロック無しで取得する
+ */
@@ -0,0 +1,204 @@
+﻿/*!
+ * @file  localPlanner.cpp
+ * @brief Dynamic Window Approachによる局所経路計画
+ *
+ * 加速度の制限内で到達できる速度と角速度の組を候補として，それぞれの円弧の軌道を予測し，
+ * 障害物からの距離，目標の方向，速度で評価して最も良い組を選ぶ．
+ * 軌道の予測と評価は4つの候補ずつSSEで行い，障害物からの距離は各点でcostmapを１回参照して求める．
+ */
+
+#include "stdafx.h"
+#include "localPlanner.h"
+#include <math.h>
+#include <mmsystem.h>
+#include <emmintrin.h>
+
+/*!
+ * @class localPlanner
+ * @brief 障害物を避けながら目標に向かう速度を求めるクラス
+ */
+
+/*!
+ * @brief コンストラクタ
+ */
+localPlanner::localPlanner():
+cmap(NULL), max_speed(0.5f), max_acc(0.5f), plan_time(0)
+{
+}
+
+/*!
+ * @brief デストラクタ
+ */
+localPlanner::~localPlanner()
+{
+}
+
+/*!
+ * @brief ホイールの最大速度と最大加速度を設定
+ *
+ * @param[in] max_speed ホイールの最大速度(m/s)
+ * @param[in] max_acc   ホイールの最大加速度(m/s^2)
+ *
+ * @return 0
+ */
+int localPlanner::setLimit(float max_speed, float max_acc)
+{
+	this->max_speed = max_speed;
+	this->max_acc   = max_acc;
+
+	return 0;
+}
+
+/*!
+ * @brief 障害物からの距離のグリッドを設定
+ *
+ * @param[in] cmap 障害物からの距離のグリッド
+ *
+ * @return 0
+ */
+int localPlanner::setCostmap(costmap *cmap)
+{
+	this->cmap = cmap;
+
+	return 0;
+}
+
+/*!
+ * @brief 候補の軌道を予測して評価する
+ * 候補毎にSIM_STEPSだけ円弧を進め，障害物からの最小距離と衝突するまでの距離を求める．
+ * 停止距離より先に衝突する候補は不可とし，それ以外は
+ *   目標の方向(終点での向きと目標の方向の差)，クリアランス，速度の重み付き和で評価する．
+ *
+ * @param[in] tx,ty 目標の位置(mm) ロボット座標系
+ *
+ * @return 評価した候補の数
+ */
+int localPlanner::evaluate(float tx, float ty)
+{
+	static const float HEADING_WEIGHT   = 1.0f;		// 目標の方向の重み
+	static const float CLEARANCE_WEIGHT = 0.6f;		// クリアランスの重み
+	static const float VELOCITY_WEIGHT  = 0.4f;		// 速度の重み
+	const float dt = SIM_PERIOD / 1000.0f;
+	const float big = 1.0e6f;
+	const float acc = max_acc * 1000.0f;			// mm/s^2
+	const float d0 = cmap->getDistance(0, 0);		// 現在の位置の障害物からの距離
+	__m128 radius = _mm_set1_ps((float)costmap::ROBOT_RADIUS), start = _mm_set1_ps(d0), bigs = _mm_set1_ps(big);
+	__m128 one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f), zero = _mm_setzero_ps();
+
+	for(int i = 0; i < SAMPLE_NUM; i += 4){
+		__m128 v  = _mm_loadu_ps(&sample_v[i]);
+		__m128 cr = _mm_loadu_ps(&sample_cos[i]), sr = _mm_loadu_ps(&sample_sin[i]);
+		__m128 step = _mm_mul_ps(v, _mm_set1_ps(dt));
+		__m128 x = zero, y = zero, c = one, s = zero, traveled = zero;
+		__m128 min_d = bigs, collision = bigs;
+
+		for(int k = 0; k < SIM_STEPS; k ++){
+			__m128 c1 = _mm_sub_ps(_mm_mul_ps(c, cr), _mm_mul_ps(s, sr));	// 1ステップ分回転
+			s = _mm_add_ps(_mm_mul_ps(s, cr), _mm_mul_ps(c, sr));
+			c = c1;
+			x = _mm_add_ps(x, _mm_mul_ps(step, c));
+			y = _mm_add_ps(y, _mm_mul_ps(step, s));
+
+			float px[4], py[4], pd[4];
+			_mm_storeu_ps(px, x);
+			_mm_storeu_ps(py, y);
+			for(int j = 0; j < 4; j ++) pd[j] = cmap->getDistance(px[j], py[j]);
+			__m128 d = _mm_loadu_ps(pd);
+			min_d = _mm_min_ps(min_d, d);
+			// 現在より障害物に近づいてROBOT_RADIUSより近くなったら衝突（それまでの移動距離を保存）
+			__m128 hit = _mm_and_ps(_mm_cmplt_ps(d, radius), _mm_cmplt_ps(d, start));
+			collision = _mm_min_ps(collision, _mm_or_ps(_mm_and_ps(hit, traveled), _mm_andnot_ps(hit, bigs)));
+			traveled = _mm_add_ps(traveled, step);
+		}
+
+		// 停止距離 v^2/(2a) + STOP_MARGIN が衝突までの距離より短い候補だけ許可
+		__m128 stop = _mm_add_ps(_mm_div_ps(_mm_mul_ps(v, v), _mm_set1_ps(2.0f * acc)), _mm_set1_ps((float)STOP_MARGIN));
+		__m128 admissible = _mm_cmple_ps(stop, collision);
+
+		// 目標の方向 (1 + cos(終点での向きと目標の方向の差)) / 2
+		__m128 dx = _mm_sub_ps(_mm_set1_ps(tx), x), dy = _mm_sub_ps(_mm_set1_ps(ty), y);
+		__m128 len = _mm_add_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))), one);
+		__m128 heading = _mm_mul_ps(half, _mm_add_ps(one, _mm_div_ps(_mm_add_ps(_mm_mul_ps(c, dx), _mm_mul_ps(s, dy)), len)));
+
+		// クリアランス (0～1)
+		__m128 clearance = _mm_div_ps(_mm_sub_ps(min_d, radius), _mm_set1_ps((float)CLEARANCE_MAX));
+		clearance = _mm_min_ps(_mm_max_ps(clearance, zero), one);
+
+		// 速度 (0～1)
+		__m128 velocity = _mm_div_ps(v, _mm_set1_ps(max_speed * 1000.0f));
+
+		__m128 score = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_set1_ps(HEADING_WEIGHT), heading),
+			_mm_mul_ps(_mm_set1_ps(CLEARANCE_WEIGHT), clearance)),
+			_mm_mul_ps(_mm_set1_ps(VELOCITY_WEIGHT), velocity));
+		__m128 limited = _mm_cmplt_ps(_mm_loadu_ps(&sample_score[i]), zero);	// ホイールの速度の制限で不可となった候補
+		__m128 valid = _mm_andnot_ps(limited, admissible);
+		score = _mm_or_ps(_mm_and_ps(valid, score), _mm_andnot_ps(valid, _mm_set1_ps(-1.0f)));
+		_mm_storeu_ps(&sample_score[i], score);
+	}
+	return SAMPLE_NUM;
+}
+
+/*!
+ * @brief 目標に向かう速度と角速度を求める
+ * 現在の速度から前回の計画からの時間で到達できる範囲(dynamic window)で候補を作り，最も評価の良い候補を選ぶ．
+ *
+ * @param[in]  tx,ty       目標の位置(m) ロボット座標系
+ * @param[in]  right_speed 右ホイールの速度(m/s)
+ * @param[in]  left_speed  左ホイールの速度(m/s)
+ * @param[out] front       前後の速度(m/s)
+ * @param[out] rotate      角速度(rad/s)
+ *
+ * @return 0:成功, -1:進める候補が無い（停止）
+ */
+int localPlanner::plan(float tx, float ty, float right_speed, float left_speed, float *front, float *rotate)
+{
+	const float tread = TREAD / 1000.0f;
+	unsigned long time = timeGetTime();
+	float period = (plan_time == 0) ? 0.1f : (float)(long)(time - plan_time) / 1000.0f;
+	period = min(max(period, 0.05f), 0.3f);
+	plan_time = time;
+
+	// dynamic window
+	float v0 = (right_speed + left_speed) / 2.0f, w0 = (right_speed - left_speed) / tread;
+	float max_w = 2.0f * max_speed / tread, acc_w = 2.0f * max_acc / tread;
+	float v_min = max(v0 - max_acc * period, 0.0f), v_max = min(v0 + max_acc * period, max_speed);
+	float w_min = max(w0 - acc_w * period, -max_w), w_max = min(w0 + acc_w * period, max_w);
+	if (v_min > v_max) v_min = v_max = max(min(v0, max_speed), 0.0f);
+	if (w_min > w_max) w_min = w_max = min(max(w0, -max_w), max_w);
+
+	for(int i = 0; i < SAMPLE_V; i ++){
+		float v = v_min + (v_max - v_min) * i / (SAMPLE_V - 1);
+		for(int j = 0; j < SAMPLE_W; j ++){
+			float w = w_min + (w_max - w_min) * j / (SAMPLE_W - 1);
+			int k = i * SAMPLE_W + j;
+			sample_v[k]   = v * 1000.0f;
+			sample_w[k]   = w;
+			sample_cos[k] = cos(w * SIM_PERIOD / 1000.0f);
+			sample_sin[k] = sin(w * SIM_PERIOD / 1000.0f);
+			sample_score[k] = (v + fabs(w) * tread / 2.0f > max_speed * 1.001f) ? -1.0f : 0.0f;	// ホイールの速度の制限
+		}
+	}
+	if (cmap == NULL){
+		*front = *rotate = 0.0f;
+		return -1;
+	}
+	evaluate(tx * 1000.0f, ty * 1000.0f);
+
+	int best = -1;
+	float best_score = 0.0f;
+	for(int k = 0; k < SAMPLE_NUM; k ++){
+		if ((sample_score[k] >= 0.0f)&&((best < 0)||(sample_score[k] > best_score))){
+			best = k;
+			best_score = sample_score[k];
+		}
+	}
+	if (best < 0){
+		*front = *rotate = 0.0f;
+		return -1;
+	}
+	*front  = sample_v[best] / 1000.0f;
+	*rotate = sample_w[best];
+
+	return 0;
+}
@@ -0,0 +1,48 @@
+﻿#pragma once
+#include "dataType.h"
+#include "costmap.h"
+
+class localPlanner
+{
+public:
+	localPlanner();										// コンストラクタ
+	virtual ~localPlanner();							// デストラクタ
+
+private:
+	static const int TREAD = 280;						//! トレッド（ホイールの距離）(mm)
+	static const int CLEARANCE_MAX = 1000;				//! 評価するクリアランスの最大値（これ以上は同じ評価）(mm)
+	static const int STOP_MARGIN = 100;					//! 停止距離に加える余裕(mm)
+
+	costmap *cmap;										//! 障害物からの距離のグリッド（障害物回避と共有）
+
+	// 速度と角速度の候補
+	static const int SAMPLE_V = 12;						//! 速度の候補の数
+	static const int SAMPLE_W = 32;						//! 角速度の候補の数
+	static const int SAMPLE_NUM = SAMPLE_V * SAMPLE_W;	//! 候補の数（4の倍数）
+	static const int SIM_STEPS = 20;					//! 軌道を予測するステップ数
+	static const int SIM_PERIOD = 100;					//! 軌道を予測する1ステップの時間(ms)
+	float sample_v[SAMPLE_NUM];							//! 候補の速度(mm/s)
+	float sample_w[SAMPLE_NUM];							//! 候補の角速度(rad/s)
+	float sample_cos[SAMPLE_NUM], sample_sin[SAMPLE_NUM];	//! 1ステップの回転(cos, sin)
+	float sample_score[SAMPLE_NUM];						//! 候補の評価（負の場合は不可）
+
+	float max_speed;									//! ホイールの最大速度(m/s)
+	float max_acc;										//! ホイールの最大加速度(m/s^2)
+	unsigned long plan_time;							//! 前回計画した時刻(ms)
+
+	int evaluate(float tx, float ty);					// 候補の軌道を予測して評価する
+
+public:
+	int setLimit(float max_speed, float max_acc);		// ホイールの最大速度と最大加速度を設定
+	int setCostmap(costmap *cmap);						// 障害物からの距離のグリッドを設定
+	int plan(float tx, float ty, float right_speed, float left_speed, float *front, float *rotate);
+														// 目標に向かう速度と角速度を求める
+};
+
+/*
+ * 使い方（Dynamic Window Approach）
+ * 1) setLimit(最大速度, 最大加速度)でホイールの制限を設定
+ * 2) setCostmap(obstacleAvoidance::getCostmap())で障害物からの距離のグリッドを設定
+ * 3) 制御周期毎にplan(目標のx, y(m, ロボット座標系), 右と左のホイールの速度, &front, &rotate)
+ *    求めたfront(m/s), rotate(rad/s)をmegaRover::setSpeedに入力
+ */
@@ -0,0 +1,254 @@
+﻿/*!
+ * @file  logDecoder.cpp
+ * @brief loggerのバイナリログをテキストに変換するツール
+ *
+ * 使い方: logDecoder [-u] [-t] log.bin [log.txt]
+ *   -u 時刻で並べ替えない（ファイルの順）
+ *   -t スレッドの番号を表示する
+ * 出力先を省略した場合は標準出力に書く．
+ * Windowsの関数を使わないので，VisualStudioでもgccでも単体でビルドできる（cl logDecoder.cpp / g++ logDecoder.cpp）．
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../logFormat.h"
+
+#ifdef _MSC_VER
+#define snprintf _snprintf
+#endif
+
+/*!
+ * @struct event_T
+ * @brief 並べ替えるためのイベントの位置
+ */
+struct event_T{
+	unsigned int time;								//!< 時刻(ms) 時刻無しのイベントは同じスレッドの前のイベントの時刻
+	unsigned short thread;							//!< 書き込んだスレッドの番号
+	size_t offset;									//!< ファイルの中のレコードの位置
+};
+
+/*!
+ * @brief 時刻とスレッドで比較（stable_sortで同じ時刻と同じスレッドはファイルの順）
+ * 同じ時刻の他のスレッドのイベントが時刻無しのイベント（前のイベントの続き）の間に入らないように，
+ * 同じ時刻ではスレッド毎にまとめる．
+ */
+static bool lessTime(const event_T &a, const event_T &b)
+{
+	if (a.time != b.time) return (int)(a.time - b.time) < 0;
+	return a.thread < b.thread;
+}
+
+/*!
+ * @brief イベントをテキストに変換
+ * フォーマットの変換指定子毎に，保存した引数の値で書式化する．
+ *
+ * @param[in]  format フォーマットの文字列
+ * @param[in]  arg    引数の値の先頭
+ * @param[in]  size   引数の値のサイズ(byte)
+ * @param[out] out    テキスト
+ *
+ * @return 0:成功，-1:引数が足りない
+ */
+static int render(const std::string &format, const char *arg, int size, std::string *out)
+{
+	const char *p = format.c_str(), *begin;
+	const char *end = arg + size;
+	log_spec_T spec;
+	char sub[64], buf[512];
+
+	while((begin = logNextSpec(p, &spec)) != NULL){
+		out->append(p, begin - p);
+		p = spec.end;
+		int width = spec.width, precision = spec.precision;
+		if (spec.width == -2){
+			if (arg + 4 > end) return -1;
+			memcpy(&width, arg, 4), arg += 4;
+		}
+		if (spec.precision == -2){
+			if (arg + 4 > end) return -1;
+			memcpy(&precision, arg, 4), arg += 4;
+		}
+		std::string f = "%";
+		f += spec.flags;
+		if (spec.width != -1){
+			if (width < 0) snprintf(sub, sizeof(sub), "-%d", -width);	// *で負の幅は左寄せ
+			else           snprintf(sub, sizeof(sub), "%d", width);
+			f += sub;
+		}
+		if ((spec.precision != -1)&&(precision >= 0)){
+			snprintf(sub, sizeof(sub), ".%d", precision);
+			f += sub;
+		}
+
+		buf[0] = '\0';
+		switch(spec.type){
+		case LOG_ARG_INT:{
+			int v;
+			if (arg + 4 > end) return -1;
+			memcpy(&v, arg, 4), arg += 4;
+			f += spec.conv;
+			snprintf(buf, sizeof(buf), f.c_str(), v);
+			break;
+		}
+		case LOG_ARG_INT64:{
+			long long v;
+			if (arg + 8 > end) return -1;
+			memcpy(&v, arg, 8), arg += 8;
+			f += "ll";
+			f += spec.conv;
+			snprintf(buf, sizeof(buf), f.c_str(), v);
+			break;
+		}
+		case LOG_ARG_DOUBLE:{
+			double v;
+			if (arg + 8 > end) return -1;
+			memcpy(&v, arg, 8), arg += 8;
+			f += spec.conv;
+			snprintf(buf, sizeof(buf), f.c_str(), v);
+			break;
+		}
+		case LOG_ARG_STRING:{
+			unsigned short len;
+			if (arg + 2 > end) return -1;
+			memcpy(&len, arg, 2), arg += 2;
+			if (arg + len > end) return -1;
+			std::string s(arg, len);
+			arg += len;
+			f += 's';
+			snprintf(buf, sizeof(buf), f.c_str(), s.c_str());
+			break;
+		}
+		case LOG_ARG_POINTER:{
+			unsigned long long v;
+			if (arg + 8 > end) return -1;
+			memcpy(&v, arg, 8), arg += 8;
+			if (spec.conv == 'p') snprintf(buf, sizeof(buf), "0x%llx", v);	// %nは何も出力しない
+			break;
+		}
+		default:
+			if (spec.conv == '%') strcpy(buf, "%");
+			break;
+		}
+		buf[sizeof(buf) - 1] = '\0';
+		out->append(buf);
+	}
+	out->append(p);
+
+	return 0;
+}
+
+/*!
+ * @brief メイン
+ *
+ * @return 0:成功，1:失敗
+ */
+int main(int argc, char *argv[])
+{
+	int is_sort = 1, is_thread = 0;
+	const char *in_name = NULL, *out_name = NULL;
+
+	for(int i = 1; i < argc; i ++){
+		if      (!strcmp(argv[i], "-u")) is_sort = 0;
+		else if (!strcmp(argv[i], "-t")) is_thread = 1;
+		else if (in_name == NULL) in_name = argv[i];
+		else out_name = argv[i];
+	}
+	if (in_name == NULL){
+		fprintf(stderr, "usage: logDecoder [-u] [-t] log.bin [log.txt]\n");
+		return 1;
+	}
+
+	FILE *in = fopen(in_name, "rb");
+	if (in == NULL){
+		fprintf(stderr, "cannot open %s\n", in_name);
+		return 1;
+	}
+	std::vector<char> data;
+	char tmp[65536];
+	size_t n;
+	while((n = fread(tmp, 1, sizeof(tmp), in)) > 0) data.insert(data.end(), tmp, tmp + n);
+	fclose(in);
+	if ((data.size() < 8)||memcmp(&data[0], "BINLOG01", 8)){
+		fprintf(stderr, "%s is not a binary log\n", in_name);
+		return 1;
+	}
+
+	std::vector<std::string> format(65536);
+	std::vector<event_T> events;
+	std::vector<unsigned int> last_time(65536, 0);
+	size_t off = 8;
+	while(off + sizeof(log_record_T) <= data.size()){
+		log_record_T h;
+		memcpy(&h, &data[off], sizeof(h));
+		if ((h.size < sizeof(h))||(off + h.size > data.size())){
+			fprintf(stderr, "truncated record at %lu\n", (unsigned long)off);
+			break;
+		}
+		if (h.type == LOG_RECORD_FORMAT){
+			log_format_T f;
+			memcpy(&f, &data[off], sizeof(f));
+			format[f.id].assign(&data[off + sizeof(f)], f.length);
+		} else if ((h.type == LOG_RECORD_EVENT)||(h.type == LOG_RECORD_NO_TIME)||(h.type == LOG_RECORD_LOST)){
+			log_event_T e;
+			memcpy(&e, &data[off], sizeof(e));
+			event_T ev;
+			ev.offset = off;
+			if (h.type == LOG_RECORD_LOST){
+				log_lost_T l;
+				memcpy(&l, &data[off], sizeof(l));
+				ev.thread = l.thread;
+			} else {
+				ev.thread = e.thread;
+			}
+			if (h.type == LOG_RECORD_NO_TIME){
+				ev.time = last_time[e.thread];			// 前のイベントの続き
+			} else {
+				ev.time = h.time;
+				if (h.type == LOG_RECORD_EVENT) last_time[e.thread] = h.time;
+			}
+			events.push_back(ev);
+		}
+		off += h.size;
+	}
+	if (is_sort) std::stable_sort(events.begin(), events.end(), lessTime);
+
+	FILE *out = stdout;
+	if ((out_name != NULL)&&((out = fopen(out_name, "w")) == NULL)){
+		fprintf(stderr, "cannot open %s\n", out_name);
+		return 1;
+	}
+	for(size_t i = 0; i < events.size(); i ++){
+		const char *rec = &data[events[i].offset];
+		log_record_T h;
+		memcpy(&h, rec, sizeof(h));
+		std::string text;
+		if (h.type == LOG_RECORD_LOST){
+			log_lost_T l;
+			memcpy(&l, rec, sizeof(l));
+			snprintf(tmp, sizeof(tmp), "time(ms):%u,log_lost thread:%d count:%u\n", h.time, l.thread, l.count);
+			text = tmp;
+		} else {
+			log_event_T e;
+			memcpy(&e, rec, sizeof(e));
+			if (is_thread){
+				snprintf(tmp, sizeof(tmp), "[%d]", e.thread);
+				text += tmp;
+			}
+			if (h.type == LOG_RECORD_EVENT){
+				snprintf(tmp, sizeof(tmp), "time(ms):%u,", h.time);
+				text += tmp;
+			}
+			if (render(format[e.id], rec + sizeof(e), h.size - (int)sizeof(e), &text)){
+				text += "(broken record)\n";
+			}
+		}
+		fputs(text.c_str(), out);
+	}
+	if (out != stdout) fclose(out);
+
+	return 0;
+}
@@ -0,0 +1,170 @@
+﻿#pragma once
+#include <string.h>
+
+/*
+ * バイナリログ(logger)のファイルの形式
+ * 先頭に"BINLOG01"(8byte)，その後にレコードが続く．
+ * 各レコードはlog_record_Tで始まり，typeとsizeで種類と長さがわかる．
+ * イベントはフォーマットの番号と引数の値だけを保存し，フォーマットの文字列は最初に使われる前に１回だけ保存する．
+ * Windowsの関数を使わないので，logDecoderと共有する．
+ */
+
+static const unsigned short LOG_RECORD_FORMAT  = 1;		//! フォーマットの定義 (log_format_T + 文字列)
+static const unsigned short LOG_RECORD_EVENT   = 2;		//! タイムスタンプ有のイベント (log_event_T + 引数)
+static const unsigned short LOG_RECORD_NO_TIME = 3;		//! タイムスタンプ無のイベント (log_event_T + 引数)
+static const unsigned short LOG_RECORD_LOST    = 4;		//! バッファが一杯で捨てたイベントの数 (log_lost_T)
+
+static const unsigned char LOG_ARG_NONE    = 0;			//! 引数無し（%%）
+static const unsigned char LOG_ARG_INT     = 1;			//! 32bitの整数 (4byte)
+static const unsigned char LOG_ARG_INT64   = 2;			//! 64bitの整数 (8byte)
+static const unsigned char LOG_ARG_DOUBLE  = 3;			//! 浮動小数点 (8byte)
+static const unsigned char LOG_ARG_STRING  = 4;			//! 文字列 (長さ2byte + 文字)
+static const unsigned char LOG_ARG_POINTER = 5;			//! ポインタ (8byte)
+
+static const int LOG_MAX_ARGS   = 16;					//! １つのフォーマットの引数の最大数（*の幅と精度を含む）
+static const int LOG_MAX_STRING = 64;					//! 文字列の引数を保存する最大の長さ(byte)
+
+/*!
+ * @struct log_record_T
+ * @brief バイナリログのレコードのヘッダ
+ */
+struct log_record_T{
+	unsigned short type;								//!< レコードの種類(LOG_RECORD_*)
+	unsigned short size;								//!< ヘッダを含むレコードのサイズ(byte)
+	unsigned int time;									//!< 時刻(ms) timeGetTime()の値
+};
+
+/*!
+ * @struct log_format_T
+ * @brief フォーマットの定義（文字列が続く）
+ */
+struct log_format_T{
+	struct log_record_T header;							//!< ヘッダ
+	unsigned short id;									//!< フォーマットの番号
+	unsigned short length;								//!< 文字列の長さ(byte)
+};
+
+/*!
+ * @struct log_event_T
+ * @brief イベント（フォーマットの順に引数の値が続く）
+ */
+struct log_event_T{
+	struct log_record_T header;							//!< ヘッダ
+	unsigned short id;									//!< フォーマットの番号
+	unsigned short thread;								//!< 書き込んだスレッドの番号（バッファの番号）
+};
+
+/*!
+ * @struct log_lost_T
+ * @brief 捨てたイベントの数
+ */
+struct log_lost_T{
+	struct log_record_T header;							//!< ヘッダ
+	unsigned short thread;								//!< スレッドの番号
+	unsigned short reserved;							//!< 未使用
+	unsigned int count;									//!< 前のレコードから捨てたイベントの数
+};
+
+/*!
+ * @struct log_spec_T
+ * @brief フォーマットの変換指定子１つ分
+ */
+struct log_spec_T{
+	char flags[8];										//!< フラグ（-+ #0）
+	int width;											//!< 幅（-1:無し，-2:*）
+	int precision;										//!< 精度（-1:無し，-2:*）
+	char conv;											//!< 変換文字（%%の場合は'%'）
+	unsigned char type;									//!< 引数の種類(LOG_ARG_*)
+	const char *end;									//!< 変換指定子の次の文字
+};
+
+/*!
+ * @brief 次の変換指定子を探す
+ * 長さ修飾子は引数の大きさだけに使う（Windowsのlongは32bit，ll,I64,jは64bit）．
+ *
+ * @param[in]  p    探し始める位置
+ * @param[out] spec 変換指定子
+ *
+ * @return 変換指定子の'%'の位置，NULL:無し
+ */
+inline const char *logNextSpec(const char *p, log_spec_T *spec)
+{
+	const char *begin = strchr(p, '%');
+	if (begin == NULL) return NULL;
+
+	int nf = 0, is64 = 0;
+	p = begin + 1;
+	while((*p != '\0')&&(strchr("-+ #0", *p) != NULL)){
+		if (nf < 7) spec->flags[nf ++] = *p;
+		p ++;
+	}
+	spec->flags[nf] = '\0';
+	spec->width = -1;
+	if (*p == '*'){
+		spec->width = -2, p ++;
+	} else if ((*p >= '0')&&(*p <= '9')){
+		spec->width = 0;
+		while((*p >= '0')&&(*p <= '9')) spec->width = spec->width * 10 + (*p ++ - '0');
+	}
+	spec->precision = -1;
+	if (*p == '.'){
+		p ++;
+		if (*p == '*'){
+			spec->precision = -2, p ++;
+		} else {
+			spec->precision = 0;
+			while((*p >= '0')&&(*p <= '9')) spec->precision = spec->precision * 10 + (*p ++ - '0');
+		}
+	}
+	for(;;){											// 長さ修飾子
+		if ((p[0] == 'l')&&(p[1] == 'l')) is64 = 1, p += 2;
+		else if ((p[0] == 'I')&&(p[1] == '6')&&(p[2] == '4')) is64 = 1, p += 3;
+		else if ((p[0] == 'I')&&(p[1] == '3')&&(p[2] == '2')) p += 3;
+		else if (*p == 'j') is64 = 1, p ++;
+		else if ((*p != '\0')&&(strchr("hlLIzt", *p) != NULL)) p ++;
+		else break;
+	}
+	spec->conv = *p;
+	if (*p == '\0'){
+		spec->type = LOG_ARG_NONE;						// 途中で終わったフォーマット
+	} else if (strchr("diouxXc", *p) != NULL){
+		spec->type = is64 ? LOG_ARG_INT64 : LOG_ARG_INT;
+	} else if (strchr("fFeEgGaA", *p) != NULL){
+		spec->type = LOG_ARG_DOUBLE;
+	} else if (*p == 's'){
+		spec->type = LOG_ARG_STRING;
+	} else if ((*p == 'p')||(*p == 'n')){
+		spec->type = LOG_ARG_POINTER;
+	} else {
+		spec->type = LOG_ARG_NONE;						// %% など
+	}
+	spec->end = (*p == '\0') ? p : p + 1;
+
+	return begin;
+}
+
+/*!
+ * @brief フォーマットから引数の種類の並びを求める
+ *
+ * @param[in]  format フォーマットの文字列
+ * @param[out] sig    引数の種類(LOG_ARG_*)の並び
+ *
+ * @return 引数の数，-1:LOG_MAX_ARGSを超える
+ */
+inline int logParseFormat(const char *format, unsigned char *sig)
+{
+	log_spec_T spec;
+	int n = 0;
+	const char *p = format;
+
+	while(logNextSpec(p, &spec) != NULL){
+		p = spec.end;
+		if (spec.width     == -2){ if (n >= LOG_MAX_ARGS) return -1; sig[n ++] = LOG_ARG_INT; }
+		if (spec.precision == -2){ if (n >= LOG_MAX_ARGS) return -1; sig[n ++] = LOG_ARG_INT; }
+		if (spec.type == LOG_ARG_NONE) continue;
+		if (n >= LOG_MAX_ARGS) return -1;
+		sig[n ++] = spec.type;
+	}
+
+	return n;
+}
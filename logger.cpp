@@ -3,36 +3,62 @@
 #include <mmsystem.h>
 #include <time.h>
 
+/*!
+ * @class logger
+ * @brief ログをバイナリで保存するクラス
+ * 各スレッドはフォーマットの番号と引数の値を自分のバッファに追加するだけで，ロックも文字列への変換も行わない．
+ * 書き込みのスレッドが全てのバッファをまとめてファイルに書き込む．テキストへの変換はlogDecoderで行う．
+ */
+
+logger::ring_T logger::ring[MAX_THREADS];
+volatile LONG logger::ring_num = 0;
+DWORD logger::tls_index = TLS_OUT_OF_INDEXES;
+const char * volatile logger::format_key[MAX_FORMAT];
+unsigned char logger::format_sig[MAX_FORMAT][LOG_MAX_ARGS];
+int logger::format_argc[MAX_FORMAT];
+volatile LONG logger::format_ready[MAX_FORMAT];
+char logger::format_written[MAX_FORMAT];
 FILE* logger::fp = NULL;
+volatile LONG logger::is_running = 0;
+HANDLE logger::thread = NULL;
+HANDLE logger::wake_event = NULL;
 
 /*!
  * @brief 初期化
+ * ファイルを開いて書き込みのスレッドを開始する．
  *
  * @param[in] filename	ファイル名
  */
 void logger::Init(CString filename)
 {
-	if (NULL == (fp = fopen(filename,"wt"))){
+	if (NULL == (fp = fopen(filename,"wb"))){
 		AfxMessageBox("Cannot Open Log file");
 		exit(1);
 	}
+	setvbuf(fp, NULL, _IOFBF, BUFFER_SIZE);
+	fwrite("BINLOG01", 1, 8, fp);
+
+	tls_index = TlsAlloc();
+	wake_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+	InterlockedExchange(&is_running, 1);
+	DWORD threadId;
+	thread = CreateThread(NULL, 0, ThreadFunc, NULL, 0, &threadId);
+	SetThreadPriority(thread, THREAD_PRIORITY_BELOW_NORMAL);
 }
 
 /*!
  * @brief ログファイルへの追加書き込み
  * タイムスタンプの後，指定された文字データを書き込む．
- * 
- * @param[in] str	書き込む文字列（フォーマット指定子を使用可能）
+ *
+ * @param[in] str	書き込む文字列（フォーマット指定子を使用可能，文字列リテラル）
  */
 void logger::Write(const char* str, ...)
 {
 	va_list args;
 
-	if (fp != NULL){
-		long time = timeGetTime();
-		fprintf(fp, "time(ms):%ld,", time);
+	if (is_running){
 		va_start(args, str);
-		vfprintf(fp, str, args);
+		Record(LOG_RECORD_EVENT, str, args);
 		va_end(args);
 	}
 }
@@ -41,23 +67,259 @@ void logger::Write(const char* str, ...)
  * @brief ログファイルへの追加書き込み
  * タイムスタンプ無しで，指定された文字データを書き込む．
  *
- * @param[in] str	書き込む文字列（フォーマット指定子を使用可能）
+ * @param[in] str	書き込む文字列（フォーマット指定子を使用可能，文字列リテラル）
  */
 void logger::WriteWithoutTime(const char* str, ...)
 {
 	va_list args;
 
-	if (fp != NULL){
+	if (is_running){
 		va_start(args, str);
-		vfprintf(fp, str, args);
+		Record(LOG_RECORD_NO_TIME, str, args);
 		va_end(args);
 	}
 }
 
+/*!
+ * @brief このスレッドのバッファ
+ * 最初に呼び出した時に空いているバッファを割り当ててTLSに保存する．
+ *
+ * @return バッファのポインタ，NULL:MAX_THREADSを超えた
+ */
+logger::ring_T *logger::getRing()
+{
+	ring_T *r = (ring_T*)TlsGetValue(tls_index);
+	if (r != NULL) return r;
+
+	for(;;){
+		LONG n = InterlockedCompareExchange(&ring_num, 0, 0);
+		if (n >= MAX_THREADS) return NULL;
+		if (InterlockedCompareExchange(&ring_num, n + 1, n) == n){
+			r = &ring[n];
+			TlsSetValue(tls_index, r);
+			return r;
+		}
+	}
+}
+
+/*!
+ * @brief フォーマットの番号
+ * 文字列のアドレスのハッシュ表で探し，無ければ登録して引数の種類の並びを求める．
+ *
+ * @param[in] format フォーマットの文字列
+ *
+ * @return 番号，-1:表が一杯
+ */
+int logger::getFormat(const char *format)
+{
+	unsigned int h = (unsigned int)((size_t)format >> 2) * 2654435761u;
+	int i = (h >> 16) & (MAX_FORMAT - 1);
+
+	for(int n = 0; n < MAX_FORMAT; ){
+		const char *key = format_key[i];
+		if (key == format){
+			while(!format_ready[i]) Sleep(0);			// 他のスレッドが登録中
+			return i;
+		}
+		if (key == NULL){
+			if (InterlockedCompareExchangePointer((void* volatile*)&format_key[i], (void*)format, NULL) == NULL){
+				format_argc[i] = logParseFormat(format, format_sig[i]);
+				InterlockedExchange(&format_ready[i], 1);
+				return i;
+			}
+			continue;									// 他のスレッドが先に登録したので同じ場所を調べ直す
+		}
+		i = (i + 1) & (MAX_FORMAT - 1);
+		n ++;
+	}
+
+	return -1;
+}
+
+/*!
+ * @brief イベントをバッファに追加
+ * フォーマットの引数の種類の順に値をそのままコピーする（文字列はLOG_MAX_STRINGまで）．
+ * バッファが一杯の場合は捨てて数を数える．
+ *
+ * @param[in] type レコードの種類(LOG_RECORD_EVENT, LOG_RECORD_NO_TIME)
+ * @param[in] str  フォーマットの文字列
+ * @param[in] args 引数
+ */
+void logger::Record(unsigned short type, const char *str, va_list args)
+{
+	ring_T *r = getRing();
+	if (r == NULL) return;
+	int id = getFormat(str);
+	if ((id < 0)||(format_argc[id] < 0)){
+		InterlockedIncrement(&r->lost);
+		return;
+	}
+
+	DWORD rec_buf[MAX_RECORD / sizeof(DWORD)];
+	char *rec = (char *)rec_buf;
+	log_event_T *e = (log_event_T *)rec;
+	int size = sizeof(log_event_T);
+	e->header.type = type;
+	e->header.time = (type == LOG_RECORD_EVENT) ? timeGetTime() : 0;
+	e->id = (unsigned short)id;
+	e->thread = (unsigned short)(r - ring);
+	for(int i = 0; i < format_argc[id]; i ++){
+		switch(format_sig[id][i]){
+		case LOG_ARG_INT:{
+			int v = va_arg(args, int);
+			memcpy(rec + size, &v, sizeof(v)), size += sizeof(v);
+			break;
+		}
+		case LOG_ARG_INT64:{
+			LONGLONG v = va_arg(args, LONGLONG);
+			memcpy(rec + size, &v, sizeof(v)), size += sizeof(v);
+			break;
+		}
+		case LOG_ARG_DOUBLE:{
+			double v = va_arg(args, double);
+			memcpy(rec + size, &v, sizeof(v)), size += sizeof(v);
+			break;
+		}
+		case LOG_ARG_STRING:{
+			const char *s = va_arg(args, const char *);
+			if (s == NULL) s = "(null)";
+			unsigned short len = 0;
+			while((len < LOG_MAX_STRING)&&(s[len] != '\0')) len ++;
+			memcpy(rec + size, &len, sizeof(len)), size += sizeof(len);
+			memcpy(rec + size, s, len), size += len;
+			break;
+		}
+		case LOG_ARG_POINTER:{
+			LONGLONG v = (LONGLONG)(size_t)va_arg(args, void *);
+			memcpy(rec + size, &v, sizeof(v)), size += sizeof(v);
+			break;
+		}
+		}
+	}
+	e->header.size = (unsigned short)size;
+
+	LONG head = r->head;
+	LONG tail = InterlockedCompareExchange(&r->tail, 0, 0);
+	if (RING_SIZE - (head - tail) < size){
+		InterlockedIncrement(&r->lost);
+		return;
+	}
+	int pos = head & (RING_SIZE - 1);
+	int first = min(size, RING_SIZE - pos);
+	memcpy(r->buf + pos, rec, first);
+	memcpy(r->buf, rec + first, size - first);
+	InterlockedExchange(&r->head, head + size);		// 書き終わってから書き込みのスレッドに見せる
+	if ((head - tail < RING_SIZE / 2)&&(head + size - tail >= RING_SIZE / 2)){
+		SetEvent(wake_event);							// 半分を超えたら周期を待たずに書き込ませる
+	}
+}
+
+/*!
+ * @brief 書き込みのスレッド
+ * FLUSH_PERIOD毎（バッファが半分を超えた場合はすぐ）にバッファをファイルに書き込み，止める時に残りを書き込む．
+ *
+ * @param[in] lpParameter 未使用
+ *
+ * @return S_OK
+ */
+DWORD WINAPI logger::ThreadFunc(LPVOID lpParameter)
+{
+	while(is_running){
+		WaitForSingleObject(wake_event, FLUSH_PERIOD);
+		Flush();
+	}
+	Flush();
+
+	return S_OK;
+}
+
+/*!
+ * @brief バッファをファイルに書き込む
+ * 初めて使われたフォーマットはイベントの前に定義を書き込む．書き込みのスレッドだけが呼び出す．
+ *
+ * @return 0
+ */
+int logger::Flush()
+{
+	static char chunk[RING_SIZE];
+	int num = min((int)InterlockedCompareExchange(&ring_num, 0, 0), MAX_THREADS);
+
+	for(int i = 0; i < num; i ++){
+		ring_T *r = &ring[i];
+		LONG head = InterlockedCompareExchange(&r->head, 0, 0);
+		LONG tail = r->tail;
+		int avail = head - tail;
+		if (avail > 0){
+			int pos = tail & (RING_SIZE - 1);
+			int first = min(avail, RING_SIZE - pos);
+			memcpy(chunk, r->buf + pos, first);
+			memcpy(chunk + first, r->buf, avail - first);
+			InterlockedExchange(&r->tail, head);
+
+			for(int off = 0; off < avail; ){				// 定義を書いていないフォーマットを探す
+				log_event_T e;
+				memcpy(&e, chunk + off, sizeof(e));
+				if (!format_written[e.id]) writeFormat(e.id);
+				off += e.header.size;
+			}
+			fwrite(chunk, 1, avail, fp);
+		}
+
+		LONG lost = InterlockedCompareExchange(&r->lost, 0, 0);
+		if (lost != r->reported){
+			log_lost_T l;
+			l.header.type = LOG_RECORD_LOST;
+			l.header.size = sizeof(l);
+			l.header.time = timeGetTime();
+			l.thread = (unsigned short)i;
+			l.reserved = 0;
+			l.count = lost - r->reported;
+			fwrite(&l, sizeof(l), 1, fp);
+			r->reported = lost;
+		}
+	}
+	fflush(fp);
+
+	return 0;
+}
+
+/*!
+ * @brief フォーマットの定義をファイルに書き込む
+ *
+ * @param[in] id フォーマットの番号
+ *
+ * @return 0
+ */
+int logger::writeFormat(int id)
+{
+	const char *s = format_key[id];
+	int len = min((int)strlen(s), 0xffff - (int)sizeof(log_format_T));
+	log_format_T f;
+	f.header.type = LOG_RECORD_FORMAT;
+	f.header.size = (unsigned short)(sizeof(f) + len);
+	f.header.time = 0;
+	f.id = (unsigned short)id;
+	f.length = (unsigned short)len;
+	fwrite(&f, sizeof(f), 1, fp);
+	fwrite(s, 1, len, fp);
+	format_written[id] = 1;
+
+	return 0;
+}
+
 /*!
  * @brief 終了処理
+ * 書き込みのスレッドが残りを書き込んでからファイルを閉じる．
  */
 void logger::Close()
 {
+	if (!is_running) return;
+	InterlockedExchange(&is_running, 0);
+	SetEvent(wake_event);
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+	CloseHandle(wake_event);
+	thread = wake_event = NULL;
 	fclose(fp);
-}
\ No newline at end of file
+	fp = NULL;
+}
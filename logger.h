@@ -1,17 +1,64 @@
 ﻿#pragma once
+#include "logFormat.h"
 
 class logger
 {
 public:
 	logger(void);											// コンストラクタ
 	~logger(void);											// デストラクタ
-	static void Init(CString filename);						// 初期化
+	static void Init(CString filename);						// 初期化（書き込みのスレッドを開始）
 	static void Write(const char* str, ...);				// ログファイルへの追加書き込み（タイムスタンプ有）
 	static void WriteWithoutTime(const char* str, ...);		// ログファイルへの追加書き込み（タイムスタンプ無）
 	static void Close();									// 終了処理
 protected:
+	static const int MAX_THREADS = 16;						//! バッファを持てるスレッドの最大数
+	static const int RING_SIZE = 64 * 1024;					//! スレッド毎のバッファのサイズ(byte) 2のべき乗
+	static const int MAX_FORMAT = 1024;						//! フォーマットの最大数 2のべき乗
+	static const int MAX_RECORD = 1152;						//! １イベントの最大のサイズ(byte) 引数が全て最大の文字列でも入る
+	static const int FLUSH_PERIOD = 50;						//! バッファをファイルに書き込む周期(ms)
+	static const int BUFFER_SIZE = 256 * 1024;				//! ファイルの書き込みバッファのサイズ(byte)
+
+	/*!
+	 * @struct ring_T
+	 * @brief スレッド毎のバッファ（書き込むスレッドと書き込みのスレッドの間でロック無し）
+	 */
+	struct ring_T{
+		char buf[RING_SIZE];								//!< イベントのレコード
+		volatile LONG head;									//!< 書き込んだバイト数の合計（書き込むスレッドだけが更新）
+		volatile LONG tail;									//!< ファイルに書いたバイト数の合計（書き込みのスレッドだけが更新）
+		volatile LONG lost;									//!< 一杯で捨てたイベントの数の合計
+		LONG reported;										//!< ファイルに記録した捨てたイベントの数
+	};
+	static ring_T ring[MAX_THREADS];						//! スレッド毎のバッファ
+	static volatile LONG ring_num;							//! 使用中のバッファの数
+	static DWORD tls_index;									//! スレッドのバッファのポインタを保存するTLSの番号
+
+	static const char * volatile format_key[MAX_FORMAT];	//! フォーマットの文字列のアドレス（ハッシュ表）
+	static unsigned char format_sig[MAX_FORMAT][LOG_MAX_ARGS];	//! フォーマットの引数の種類の並び
+	static int format_argc[MAX_FORMAT];						//! フォーマットの引数の数（-1:多すぎるので記録しない）
+	static volatile LONG format_ready[MAX_FORMAT];			//! 引数の種類を求め終わったか（1:終了）
+	static char format_written[MAX_FORMAT];					//! ファイルに定義を書いたか（書き込みのスレッドだけが使う）
+
 	static FILE* fp;										//! ファイルポインタ
+	static volatile LONG is_running;						//! 書き込みのスレッドが動作中（1:動作中）
+	static HANDLE thread;									//! 書き込みのスレッドのハンドル
+	static HANDLE wake_event;								//! 書き込みのスレッドを起こすイベント（バッファが半分を超えた時と終了時）
+
+	static ring_T *getRing();								// このスレッドのバッファ
+	static int getFormat(const char *format);				// フォーマットの番号
+	static void Record(unsigned short type, const char *str, va_list args);	// イベントをバッファに追加
+	static DWORD WINAPI ThreadFunc(LPVOID lpParameter);		// 書き込みのスレッド
+	static int Flush();										// バッファをファイルに書き込む
+	static int writeFormat(int id);							// フォーマットの定義をファイルに書き込む
 };
 
 #define LOG( ... ) { logger::Write( __VA_ARGS__ ); }							// ログ書き込みマクロ（タイムスタンプ有）
 #define LOG_WITHOUT_TIME( ... ) { logger::WriteWithoutTime( __VA_ARGS__ ); }	// ログ書き込みマクロ（タイムスタンプ無）
+
+/*
+ * 使い方
+ * 1) logger::Init(ファイル名)で開始する．Closeまでバイナリで書き込む（テキストはlogDecoderで変換する）
+ * 2) LOG(フォーマット, 引数...)はフォーマットの番号と引数の値をスレッド毎のバッファに追加するだけで，
+ *    文字列への変換とファイルへの書き込みは書き込みのスレッドがFLUSH_PERIOD毎にまとめて行う
+ * 3) フォーマットは文字列リテラルにする（アドレスで番号を決め，書き込みのスレッドが後で参照する）
+ */
@@ -3,11 +3,20 @@
 #include <mmsystem.h>
 #include "memoryMap.h"
 #include "megaRover.h"
-#include "Library/WRC003LVHID.h"
+#include "logger.h"
+#ifdef ROVER_SIMULATION
+#include "simRover.h"
+#else
+#include "wrcTransport.h"
+#endif
 
 #define	M_PI	3.14159f
 
-#pragma	comment(lib,"Library/CWRC003LVHID.lib")
+#ifdef ROVER_SIMULATION
+static simRover default_transport;			//! 実機の代わりに使うボードのシミュレーション
+#else
+static wrcTransport default_transport;		//! 実機のボード
+#endif
 
 /*!
  * @class megaRover
@@ -20,13 +29,20 @@
  */
 megaRover::megaRover():
 is_speed_control_mode(0), refSpeedRight(0), refSpeedLeft(0),terminate(0),
-odoX(0), odoY(0), odoThe(0),deltaL(0),deltaR(0), mutex(NULL), comMutex(NULL),
+odoX(0), odoY(0), odoThe(0),deltaL(0),deltaR(0), mutex(NULL), thread(NULL), transport(&default_transport),
+motor_command(0), servo_command(-1),
+frame_x(0), frame_y(0), frame_the(0),
+gyro_frame(0), gyro_angle(0), gyro_time(0), gyro_done(0), gyro_angle0(0), gyro_time0(0), is_gyro_heading(0), reset_request(0),
+speed_cap(-1), cap_time(0), cap_event(NULL),
 #ifdef MEGA_ROVER_1_1
-	MAX_SPEED(0.625f)
+	MAX_SPEED(0.625f),
 #else
-	MAX_SPEED(0.3)
+	MAX_SPEED(0.3),
 #endif
+controller(MAX_SPEED)
 {
+	memset(&board_state, 0, sizeof(board_state));
+	memset(pose_cov, 0, sizeof(pose_cov));
 }
 
 /*!
@@ -43,48 +59,71 @@ megaRover::~megaRover()
  */
 int megaRover::init()
 {
-	if(!CWRC_Connect()) return -1;
+	if (transport->connect()) return -1;
 
 	// 排他処理
 	mutex = CreateMutex(NULL, FALSE, _T("MEGA_ROVER_ODOMETORY"));
-	comMutex = CreateMutex(NULL, FALSE, _T("MEGA_ROVER_COM_MUTEX"));
+	cap_event = CreateEvent(NULL, FALSE, FALSE, NULL);	// 自動リセット
 
 	// エンコーダの初期化
-	SetMem_UByte(Flag, 0x02);	// エンコーダをONにする
-	CWRC_WriteExecute(FALSE);
+	transport->setByte(Flag, 0x02);	// エンコーダをONにする
+	transport->write();
 
-	SetMem_SWord(EncoderA, 0);	// 現在のエンコーダ値を0に戻す
-	SetMem_SWord(EncoderB, 0);
-	CWRC_WriteExecute(FALSE);
+	transport->setWord(EncoderA, 0);	// 現在のエンコーダ値を0に戻す
+	transport->setWord(EncoderB, 0);
+	transport->write();
 
 	// 速度制御のスレッドを開始
 	DWORD threadId;	
-	HANDLE hThread = CreateThread(NULL, 0, ThreadFunc, (LPVOID)this, 0, &threadId); 
+	thread = CreateThread(NULL, 0, ThreadFunc, (LPVOID)this, 0, &threadId); 
 	// スレッドの優先順位を上げる
-	SetThreadPriority(hThread, THREAD_PRIORITY_TIME_CRITICAL);
+	SetThreadPriority(thread, THREAD_PRIORITY_TIME_CRITICAL);
 	
 	return 0;
 }
 
 /*!
  * @brief 終了処理
+ * 速度制御のスレッドが終わってから，このスレッドでモータを止めて書き込む．
  *
  * @return 0
  */
 int megaRover::close()
 {
 	terminate = 1;				// 速度制御スレッドの停止
-	CloseHandle(mutex);
-	CloseHandle(comMutex);
+	if (cap_event != NULL) SetEvent(cap_event);
+	if (thread != NULL){
+		WaitForSingleObject(thread, 1000);
+		CloseHandle(thread);
+		thread = NULL;
+	}
 	setMotor(0, 0);				// ロボットを止める
 	servoOn(0);					// モータをOFFにする
-	CWRC_Disconnect();			// ロボットとの通信を切断する
+	writeMemoryMap();
+	CloseHandle(mutex);
+	transport->disconnect();	// ロボットとの通信を切断する
+
+	return 0;
+}
+
+/*!
+ * @brief ボードとの通信の方法を設定
+ * init()の前に呼び出す．設定しない場合は実機（ROVER_SIMULATIONを定義した場合はシミュレーション）と通信する．
+ *
+ * @param[in] transport 通信の方法（simRoverなど）
+ *
+ * @return 0
+ */
+int megaRover::setTransport(roverTransport *transport)
+{
+	if (transport != NULL) this->transport = transport;
 
 	return 0;
 }
 
 /*!
  * @brief サーボON/OFF
+ * 指令を置くだけで，速度制御のスレッドが次の周期で書き込む（最新の指令だけが有効）．
  *
  * @param[in] gain 0:OFF, 1-255:on (servo gain)
  *
@@ -92,14 +131,7 @@ int megaRover::close()
  */
 int megaRover::servoOn(int gain)
 {
-	// モータをONにするためには、メモリマップの0x04（Mode）を1に、0x08,0x09（左右車輪のゲイン）を一定以上の値に書き換えます
-	SetMem_UByte(CpuMode     , gain > 0);
-	SetMem_UByte(MotorGainCh1, gain);
-	SetMem_UByte(MotorGainCh2, gain);
-	if (comMutex == NULL) return -1;
-	WaitForSingleObject(comMutex, INFINITE); 
-	CWRC_WriteExecute(FALSE);
-	ReleaseMutex(comMutex);
+	InterlockedExchange(&servo_command, min(max(gain, 0), 255));
 
 	return 0;
 }
@@ -121,8 +153,29 @@ int megaRover::setDelta(int right, int left)
 	return 0;
 }
 
+/*!
+ * @brief ホイールの最大速度と最大加速度を取得
+ * 加速度はsetDeltaで指定した１周期あたりのトルクの変化量から換算する（トルク1000で最大速度）．
+ *
+ * @param[out] max_speed ホイールの最大速度(m/s)
+ * @param[out] max_acc   ホイールの最大加速度(m/s^2)
+ *
+ * @return 0
+ */
+int megaRover::getLimit(float *max_speed, float *max_acc)
+{
+	int delta = min(deltaR, deltaL);
+
+	*max_speed = MAX_SPEED;
+	if (delta > 0) *max_acc = delta / 1000.0f * MAX_SPEED / (UPDATE_PERIOD / 1000.0f);
+	else           *max_acc = MAX_SPEED / (UPDATE_PERIOD / 1000.0f);	// 制限無し（１周期で最大速度）
+
+	return 0;
+}
+
 /*!
  * @brief モータ速度の設定
+ * 指令を置くだけで，速度制御のスレッドが次の周期で書き込む（最新の指令だけが有効）．
  *
  * @param[in] right 右ホイールのトルク　(-1000~1000)
  * @param[in] left  左ホイールのトルク　(-1000~1000)
@@ -132,41 +185,50 @@ int megaRover::setDelta(int right, int left)
 int megaRover::setMotor(int right, int left)
 {
 	static const int limit = 1000;
-	static int right0, left0;
-	if (deltaR != 0){
-		if ((right - right0) > 0){
-			right = min(right0 + deltaR, right);
-		} else if ((right - right0) < 0){
-			right = max(right0 - deltaR, right);
-		}
-	}
-	if (deltaL != 0){
-		if ((left - left0) > 0){
-			left = min(left0 + deltaL, left);
-		} else if ((left - left0) < 0){
-			left = max(left0 - deltaL, left);
-		}
-	}
-	
+
 	right = min(max(right, -limit), limit);
 	left  = min(max(left,  -limit), limit);
+	InterlockedExchange(&motor_command, (LONG)(((right & 0xffff) << 16) | (left & 0xffff)));
 
-	if (comMutex == NULL) return -1;
-	WaitForSingleObject(comMutex, INFINITE); 
-//	SetMem_SWord(MotorSpeedCh1, (int)(right * 0.93f));	// ToDo バランスを取る
-	SetMem_SWord(MotorSpeedCh1, (int)(right * 1.00f));	// ToDo バランスを取る
-	SetMem_SWord(MotorSpeedCh2, (int)(left  * 1.00f));
-	CWRC_WriteExecute(FALSE);
-	ReleaseMutex(comMutex);
+	return 0;
+}
 
-	right0 = right;
-	left0  = left;
+/*!
+ * @brief 指令を反映して１回で書き込む
+ * サーボのゲインとモータのトルクの指令をメモリマップに設定してから１回だけ書き込む．
+ * トルクは１周期の変化量をsetDeltaの値で制限する（速度の上限で止める場合は制限しない）．
+ * 速度制御のスレッド（スレッドの開始前と終了後は呼び出したスレッド）だけが呼び出す．
+ *
+ * @param[in] is_ramp 1:変化量を制限する，0:指令のトルクをそのまま書き込む
+ *
+ * @return 0
+ */
+int megaRover::writeMemoryMap(int is_ramp)
+{
+	LONG gain = InterlockedExchange(&servo_command, -1);
+	if (gain >= 0){
+		// モータをONにするためには、メモリマップの0x04（Mode）を1に、0x08,0x09（左右車輪のゲイン）を一定以上の値に書き換えます
+		transport->setByte(CpuMode     , gain > 0);
+		transport->setByte(MotorGainCh1, (unsigned char)gain);
+		transport->setByte(MotorGainCh2, (unsigned char)gain);
+	}
+
+	LONG command = InterlockedCompareExchange(&motor_command, 0, 0);
+	int right = (short)(command >> 16), left = (short)(command & 0xffff);
+	if (is_ramp) controller.rampTorque(&right, &left, deltaR, deltaL);
+	else         controller.rampTorque(&right, &left, 0, 0);
+	
+//	transport->setWord(MotorSpeedCh1, (int)(right * 0.93f));	// ToDo バランスを取る
+	transport->setWord(MotorSpeedCh1, (int)(right * 1.00f));	// ToDo バランスを取る
+	transport->setWord(MotorSpeedCh2, (int)(left  * 1.00f));
+	transport->write();
 
 	return 0;
 }
 
 /*!
  * @brief エンコーダの値の取得
+ * この周期にreadMemoryMapで読み込んだ値を戻す（速度制御のスレッドから呼び出す）．
  *
  * @param[out] right 右ホイールのエンコーダの値
  * @param[out] left  左ホイールのエンコーダの値
@@ -175,15 +237,51 @@ int megaRover::setMotor(int right, int left)
  */
 int megaRover::getEncoder(unsigned int *right, unsigned int *left)
 {
-	// エンコーダの現在値を取得
-	if (comMutex == NULL) return -1;
-	WaitForSingleObject(comMutex, INFINITE); 
-	CWRC_ReadMemMap(EncoderA, 4);
-	CWRC_ReadExecute();
+	*right = board_state.encoder_a;
+	*left  = board_state.encoder_b;
+
+	return 0;
+}
+
+/*!
+ * @brief 電源電圧からエンコーダまでを１回で読み込む
+ * メモリマップのPowerVoltage(40)からEncoderB(88)までを１回の通信で読み込み，ボードの状態を更新する．
+ * 他のスレッドが書き込み中の値を使わないように，書き込みの前後でboard_seqを増やす．
+ *
+ * @return 0
+ */
+int megaRover::readMemoryMap()
+{
+	transport->read(PowerVoltage, EncoderB + 2 - PowerVoltage);
+
+	board_seq.beginWrite();
+	board_state.encoder_a = (unsigned short)transport->getWord(EncoderA);
+	board_state.encoder_b = (unsigned short)transport->getWord(EncoderB);
+	board_state.button    = transport->getWord(GamePadButton);
+	board_state.joy_ud    = transport->getWord(GamePadLJoyUD);
+	board_state.joy_lr    = transport->getWord(GamePadRJoyLR);
+	board_state.voltage   = transport->getWord(PowerVoltage);
+	board_state.sw        = transport->getWord(Switch);
+	board_seq.endWrite();
+
+	return 0;
+}
 
-	*right = (unsigned short)GetMem_SWord(EncoderA);
-	*left  = (unsigned short)GetMem_SWord(EncoderB);
-	ReleaseMutex(comMutex);
+/*!
+ * @brief ボードの状態を取得
+ * 待たずに読み，読んでいる間に書き込まれた場合は読み直す．
+ *
+ * @param[out] state ボードの状態
+ *
+ * @return 0
+ */
+int megaRover::getBoardState(board_state_T *state)
+{
+	LONG seq;
+	do {
+		seq = board_seq.beginRead();
+		*state = board_state;
+	} while(board_seq.retry(seq));
 
 	return 0;
 }
@@ -262,14 +360,122 @@ int megaRover::setArcSpeed(float front, float radius)
 int megaRover::getOdometory(float *x, float *y, float *the, int is_clear)
 {
 	if (mutex == NULL) return -1;
-	WaitForSingleObject(mutex, INFINITE);
-	*x   = odoX;
-	*y   = odoY;
-	*the = odoThe;
+	float px, py, pthe;
+	getLatestPose(&px, &py, &pthe);
+	*x = px, *y = py, *the = pthe;
+	toOutputFrame(x, y, the);
 	if (is_clear){
-		odoX = odoY = odoThe = 0;
+		WaitForSingleObject(mutex, INFINITE);
+		setOutputFrame(px, py, pthe, 0, 0, 0);
+		ReleaseMutex(mutex);
 	}
-	ReleaseMutex(mutex);
+
+	return 0;
+}
+
+/*!
+ * @brief 指定した時刻のオドメトリの取得
+ * 制御周期(20ms)毎に保存した履歴を一定の曲率の動きで補間して求める（ロック無し）．
+ * 最新の履歴より新しい時刻は少しだけ速度で外挿し，範囲外の時刻は端の値を戻す．
+ *
+ * @param[in]  time 時刻(ms) timeGetTime()の値
+ * @param[out] x    オドメトリのx座標(m)
+ * @param[out] y    オドメトリのy座標(m)
+ * @param[out] the  オドメトリの角度(rad)
+ *
+ * @return 0
+ */
+int megaRover::getOdometoryAt(unsigned long time, float *x, float *y, float *the)
+{
+	if (history.poseAt(time, x, y, the) < 0){				// 履歴が無い場合は原点
+		*x = *y = *the = 0;
+	}
+	toOutputFrame(x, y, the);
+
+	return 0;
+}
+
+/*!
+ * @brief t1のオドメトリをt0のロボット座標系で取得
+ * 出力の座標系の変換（クリアや角度の設定）に関係なく，実際に動いた量を戻す（ロック無し）．
+ *
+ * @param[in]  t0,t1 時刻(ms) timeGetTime()の値
+ * @param[out] dx,dy t0のロボット座標系のt1の位置(m)
+ * @param[out] dthe  t0からt1への回転(rad)
+ *
+ * @return 0:成功，-1:履歴が無い
+ */
+int megaRover::getOdometoryDelta(unsigned long t0, unsigned long t1, float *dx, float *dy, float *dthe)
+{
+	return (history.delta(t0, t1, dx, dy, dthe) < 0) ? -1 : 0;
+}
+
+/*!
+ * @brief 最新の連続した座標系の位置
+ *
+ * @param[out] x,y,the 位置(m)，姿勢(rad) 履歴が無い場合は原点
+ *
+ * @return 0
+ */
+int megaRover::getLatestPose(float *x, float *y, float *the)
+{
+	poseHistory::pose_T p;
+	if (history.latest(&p)){
+		*x = *y = *the = 0;
+	} else {
+		*x = p.x, *y = p.y, *the = p.the;
+	}
+
+	return 0;
+}
+
+/*!
+ * @brief 連続した座標系の位置を出力の座標系に変換
+ * 変換を読んでいる間に書き込まれた場合は読み直す（ロック無し）．
+ *
+ * @param[in,out] x,y,the 位置(m)，姿勢(rad)
+ *
+ * @return 0
+ */
+int megaRover::toOutputFrame(float *x, float *y, float *the)
+{
+	float fx, fy, fthe;
+	LONG seq;
+	do {
+		seq = frame_seq.beginRead();
+		fx = frame_x, fy = frame_y, fthe = frame_the;
+	} while(frame_seq.retry(seq));
+
+	float c = cos(fthe), s = sin(fthe);
+	float px = *x, py = *y;
+	*x    = fx + c * px - s * py;
+	*y    = fy + s * px + c * py;
+	*the += fthe;
+	if (*the >  M_PI) *the -= 2.0f*M_PI;
+	if (*the < -M_PI) *the += 2.0f*M_PI;
+
+	return 0;
+}
+
+/*!
+ * @brief 連続した座標系の位置が出力の座標系の位置になるように変換を設定
+ * mutexを取得した状態で呼び出す．
+ *
+ * @param[in] x,y,the             連続した座標系の位置(m)，姿勢(rad)
+ * @param[in] out_x,out_y,out_the 出力の座標系の位置(m)，姿勢(rad)
+ *
+ * @return 0
+ */
+int megaRover::setOutputFrame(float x, float y, float the, float out_x, float out_y, float out_the)
+{
+	float fthe = out_the - the;
+	float c = cos(fthe), s = sin(fthe);
+
+	frame_seq.beginWrite();
+	frame_the = fthe;
+	frame_x = out_x - (c * x - s * y);
+	frame_y = out_y - (s * x + c * y);
+	frame_seq.endWrite();
 
 	return 0;
 }
@@ -304,90 +510,133 @@ DWORD WINAPI megaRover::ThreadFunc(LPVOID lpParameter)
 /*!
  * @brief 別スレッドで動作する関数
  * ロボットの制御を別スレッドで行う．
+ * 周期はschedulerが開始からの絶対時刻の期限で決め，処理の時間で周期がずれないようにする．
  *
  * @return S_OK
  */
 DWORD WINAPI megaRover::ExecThread()
 {
+	scheduler.start(UPDATE_PERIOD);
 	while(!terminate){
 		Update();
-		Sleep(20);
+		while((!terminate)&&scheduler.wait(cap_event)){
+			applySpeedCap();				// 速度の上限が変わったら周期を待たずに反映
+		}
 	}
 	return S_OK; 
 }
 
+/*!
+ * @brief 前進の速度の上限を設定
+ * URGのスレッドから呼び出すため，Interlockedで書き込み，変わった場合はイベントで制御スレッドを起こす．
+ *
+ * @param[in] max_front 前進の速度の上限(m/s) 負の場合は解除
+ * @param[in] time      上限を要求した原因のスキャンの時刻(ms) 停止までの遅れの計測に使用
+ *
+ * @return 0
+ */
+int megaRover::setSpeedCap(float max_front, unsigned long time)
+{
+	LONG cap = (max_front < 0) ? -1 : (LONG)(max_front * 1000.0f);
+	InterlockedExchange(&cap_time, (LONG)time);
+	if (InterlockedExchange(&speed_cap, cap) != cap){
+		if (cap_event != NULL) SetEvent(cap_event);
+	}
+
+	return 0;
+}
+
+/*!
+ * @brief 速度の上限で左右ホイールの目標速度を制限する
+ * 前後の成分だけを制限し，回転の成分は残す（その場での旋回は許可）．
+ *
+ * @param[in,out] right 右ホイールの目標速度(m/s)
+ * @param[in,out] left  左ホイールの目標速度(m/s)
+ *
+ * @return 1:制限した，0:制限していない
+ */
+int megaRover::limitSpeed(float *right, float *left)
+{
+	LONG cap = InterlockedCompareExchange(&speed_cap, 0, 0);
+	if (cap < 0) return 0;
+
+	float v = (*right + *left) / 2.0f, w = (*right - *left) / 2.0f;
+	float v_max = cap / 1000.0f;
+	if (v <= v_max) return 0;
+	*right = v_max + w;
+	*left  = v_max - w;
+
+	return 1;
+}
+
+/*!
+ * @brief 上限が変わったときに制御周期を待たずにモータを止める
+ * 目標速度が制限される場合は，次の制御周期まで待たずにトルクを0にする．
+ * setDeltaの変化量の制限を通すと0になるまで数十周期かかるため，制限せずに１回の書き込みで0にする．
+ * 要求したスキャンの時刻からトルク0を書き込むまでの時間を停止までの遅れとしてLogに書き出す．
+ *
+ * @return 0
+ */
+int megaRover::applySpeedCap()
+{
+	float right = refSpeedRight, left = refSpeedLeft;
+	if (limitSpeed(&right, &left)){
+		setMotor(0, 0);
+		writeMemoryMap(0);
+		LOG("stop_latency:%ld ms\n", (long)(timeGetTime() - (unsigned long)InterlockedCompareExchange(&cap_time, 0, 0)));
+	}
+
+	return 0;
+}
+
 /*!
  * @brief 定期的(20ms)に呼び出す関数
+ * ボードとの通信は最初のreadMemoryMapと最後のwriteMemoryMapの２回だけ行う．
+ * 周期は実際に経過した時間とし，シミュレーションの場合はreadで進めた時間とする（実時間に関係なく同じ結果にする）．
  *
  * @return 0
  */
 int megaRover::Update()
 {
-	const float coef = 1.0f;					// 要調整個体差あり
-
-	const int MAX_SHORT = 256 * 256;
-	static unsigned int r0 = 0, l0 = 0;
-	static unsigned long time0 = 0;
-	static const float kp = 50000.0f, ki = 1000.0f;
 	unsigned int r = 0, l = 0;
-	int rd, ld;
 	float right, left;
 	float v, w;
 
+	readMemoryMap();								// この周期の通信（読み込み）
 	getEncoder(&r, &l);
-	rd =    r - r0;
-	ld  = -(int)(l - l0);	// 左はマイナスが前進
-	r0 = r, l0 = l;
-	if (rd >= ( MAX_SHORT / 2)) rd -= MAX_SHORT;
-	if (rd <= (-MAX_SHORT / 2)) rd += MAX_SHORT;
-	if (ld >= ( MAX_SHORT / 2)) ld -= MAX_SHORT;
-	if (ld <= (-MAX_SHORT / 2)) ld += MAX_SHORT;
-#ifdef MEGA_ROVER_1_1
-	right = (float)rd / (13 * 71.2f * 4) * 150 * M_PI / 1000.0f;		// 右車輪の移動量(m)
-	left  = (float)ld / (13 * 71.2f * 4) * 150 * M_PI / 1000.0f * coef;	// 左車輪の移動量(m)
-#else
-	right = (float)rd / (48 * 104 * 4) * 150 * M_PI / 1000.0f;			// 右車輪の移動量(m)
-	left  = (float)ld / (48 * 104 * 4) * 150 * M_PI / 1000.0f * coef;	// 左車輪の移動量(m)
-#endif
+	controller.getWheelDistance(r, l, &right, &left);	// 左右の車輪の移動量(m)
 	v = (right + left) / 2.0f;						// 前後の速度
 	w = (right - left) / (TREAD / 1000.0f);			// 回転速度
 
-	if (mutex == NULL) return -1;
-	WaitForSingleObject(mutex, INFINITE);
-	odoX += v * cos(odoThe);
-	odoY += v * sin(odoThe);
-	odoThe += w;
+	float period = transport->getSimulatedPeriod();	// シミュレーションで進めた時間(s)
+	if (period <= 0) period = scheduler.getPeriod();	// 前の周期から実際に経過した時間(s)
+	if (period <= 0) period = UPDATE_PERIOD / 1000.0f;
 
-	if (odoThe >  M_PI) odoThe -= 2.0f*M_PI;
-	if (odoThe < -M_PI) odoThe += 2.0f*M_PI;
-	ReleaseMutex(mutex);
+	filter.predict(v, w, period);					// 連続した座標系で円弧として積分（履歴はこのスレッドだけが書き込む）
+	updateHeading();								// 新しいジャイロの角度があれば補正
+	if (InterlockedExchange(&reset_request, 0)) filter.resetPosition();
+	filter.getPose(&odoX, &odoY, &odoThe);
+	poseHistory::pose_T pose = {timeGetTime(), odoX, odoY, odoThe, v / period, w / period};
+	history.add(pose);
+
+	float cov[9];
+	filter.getCovariance(cov);
+	cov_seq.beginWrite();
+	memcpy(pose_cov, cov, sizeof(pose_cov));
+	cov_seq.endWrite();
 
 	
 	if (is_speed_control_mode){
-		static int is_first = 1;
-		if (is_first){
-			time0 = timeGetTime();
-			is_first = 0;
-		} else {
-			unsigned long time = timeGetTime();
-			static float errIntRight = 0, errIntLeft = 0; 
-			float period = (time - time0) / 1000.0f;
-			time0 = time;
+		float refRight = refSpeedRight, refLeft = refSpeedLeft;
+		limitSpeed(&refRight, &refLeft);				// safetyMonitorが設定した前進の速度の上限
+		int rightTorque, leftTorque;
+		if (controller.control(right, left, period, refRight, refLeft, &rightTorque, &leftTorque)){
 			speedRight = right / period;
 			speedLeft  = left  / period;
-			float errRight = (refSpeedRight - speedRight);
-			float errLeft  = (refSpeedLeft  - speedLeft );
-			errIntRight += (errRight * period);
-			errIntLeft  += (errLeft  * period);
-			if ((refSpeedRight != 0.0f) || (refSpeedLeft != 0.0f)){
-				float rightTorque =   kp * errRight + ki * errIntRight + refSpeedRight / MAX_SPEED * 1000;
-				float leftTorque  = - kp * errLeft  - ki * errIntLeft  - refSpeedLeft  / MAX_SPEED * 1000;
-				setMotor((int)rightTorque, (int)leftTorque);
-			} else {
-				setMotor(0, 0);
-			}
+			setMotor(rightTorque, leftTorque);
 		}
 	}
+	writeMemoryMap();								// この周期の通信（書き込み）
 
 	return 0;
 }
@@ -405,15 +654,30 @@ int megaRover::Update()
  */
 int megaRover::getJoyStick(float *x, float *y, int *b)
 {
-	if (comMutex == NULL) return -1;
-	WaitForSingleObject(comMutex, INFINITE); 
-	CWRC_ReadMemMap(GamePadButton, 10);
-	CWRC_ReadExecute();
+	board_state_T state;
+	getBoardState(&state);
 
-	*b = GetMem_SWord(GamePadButton);
-	*x = (float)GetMem_SWord(GamePadLJoyUD)/128.0f;
-	*y = (float)GetMem_SWord(GamePadRJoyLR)/128.0f;
-	ReleaseMutex(comMutex);
+	*b = state.button;
+	*x = (float)state.joy_ud/128.0f;
+	*y = (float)state.joy_lr/128.0f;
+
+	return 0;
+}
+
+/*!
+ * @brief 電源電圧の取得
+ * 速度制御のスレッドが周期毎に読み込んだ値を戻す．
+ *
+ * @param[out] voltage 電源電圧(V)
+ *
+ * @return 0
+ */
+int megaRover::getPowerVoltage(float *voltage)
+{
+	board_state_T state;
+	getBoardState(&state);
+
+	*voltage = state.voltage * 6.6f / 1024.0f;
 
 	return 0;
 }
@@ -429,7 +693,7 @@ int megaRover::getReferenceSpeed(float *right, float *left){
 
 /*!
  * @brief オドメトリの角度の設定
- * ジャイロオドメトリのために方位を設定する(rad)
+ * 出力の方位を設定する．ジャイロの角度はsetGyroAngleで入力する．
  *
  * @param[in] angle オドメトリの角度(rad)
  *
@@ -439,9 +703,11 @@ int megaRover::setOdometoryAngle(float angle)
 {
 	if (mutex == NULL) return -1;
 	WaitForSingleObject(mutex, INFINITE);
-	odoThe = angle;
-	if (odoThe >  M_PI) odoThe -= 2.0f*M_PI;
-	if (odoThe < -M_PI) odoThe += 2.0f*M_PI;
+	float x, y, the;									// 現在位置を中心に回転させるので，履歴の相対的な動きは保たれる
+	getLatestPose(&x, &y, &the);
+	float ox = x, oy = y, othe = the;
+	toOutputFrame(&ox, &oy, &othe);
+	setOutputFrame(x, y, the, ox, oy, angle);
 	ReleaseMutex(mutex);
 	
 	return 0;
@@ -456,9 +722,123 @@ int megaRover::clearOdometory()
 {
 	if (mutex == NULL) return -1;
 	WaitForSingleObject(mutex, INFINITE);
-	odoX = odoY = odoThe = 0;
+	float x, y, the;
+	getLatestPose(&x, &y, &the);
+	float ox = x, oy = y, othe = the;
+	toOutputFrame(&ox, &oy, &othe);
+	if (!InterlockedCompareExchange(&is_gyro_heading, 0, 0)) othe = 0;	// ジャイロを使っている場合は方位はそのまま
+	setOutputFrame(x, y, the, 0, 0, othe);
+	InterlockedExchange(&reset_request, 1);				// 新しい原点からの共分散にする
 	ReleaseMutex(mutex);		
 
 	return 0;
 }
 
+/*!
+ * @brief ジャイロの角度を入力
+ * 制御スレッドが次の周期にフィルタで使う（最新の値だけを使う）．
+ * 最初の角度でオドメトリの方位をジャイロの角度に合わせ，その後はジャイロのずれを推定しながら統合する．
+ *
+ * @param[in] angle ジャイロの角度(rad)
+ * @param[in] time  計測した時刻(ms) timeGetTime()の値
+ *
+ * @return 0
+ */
+int megaRover::setGyroAngle(float angle, unsigned long time)
+{
+	gyro_seq.beginWrite();
+	gyro_angle = angle;
+	gyro_time = time;
+	gyro_seq.endWrite();
+
+	return 0;
+}
+
+/*!
+ * @brief 受け取ったジャイロの角度でフィルタを補正
+ * 計測した時刻からの回転は履歴から求める．制御スレッドから呼び出す．
+ * 前の角度との差から求めた角速度は，次の周期の予測でホイールの回転と統合する．
+ *
+ * @return 0:補正，1:新しい角度無しか外れ値
+ */
+int megaRover::updateHeading()
+{
+	LONG seq = gyro_seq.current();
+	if ((seq == gyro_done)||(seq & 1)) return 1;			// 新しい角度が無いか書き込み中（待たずに次の周期に読む）
+	float angle = gyro_angle;
+	unsigned long time = gyro_time;
+	if (gyro_seq.retry(seq)) return 1;					// 書き込まれたので次の周期に読む
+	gyro_done = seq;
+
+	static const long MAX_RATE_INTERVAL = 100;		// 角速度を求める２つの角度の最大の間隔(ms)
+	static const float MAX_RATE = 6.0f;				// これより速い角速度は角度が飛んだとして使わない(rad/s) 最大の旋回は約4.4rad/s
+	long interval = (long)(time - gyro_time0);
+	if ((gyro_time0 != 0)&&(interval > 0)&&(interval <= MAX_RATE_INTERVAL)){
+		float d = angle - gyro_angle0;
+		if (d >  M_PI) d -= 2.0f*M_PI;
+		if (d < -M_PI) d += 2.0f*M_PI;
+		float rate = d / (interval / 1000.0f);
+		if (fabs(rate) < MAX_RATE) filter.setGyroRate(rate);
+	}
+	gyro_angle0 = angle;
+	gyro_time0 = time;
+
+	float x, y, the, t_x, t_y, t_the, lag = 0;
+	filter.getPose(&x, &y, &the);
+	if (history.poseAt(time, &t_x, &t_y, &t_the) >= 0){
+		lag = the - t_the;
+		if (lag >  M_PI) lag -= 2.0f*M_PI;
+		if (lag < -M_PI) lag += 2.0f*M_PI;
+	}
+
+	if (!filter.isGyroUsed()){						// 最初は出力の方位をジャイロの角度に合わせる
+		WaitForSingleObject(mutex, INFINITE);
+		float ox = x, oy = y, othe = the;
+		toOutputFrame(&ox, &oy, &othe);
+		setOutputFrame(x, y, the, ox, oy, angle + lag);
+		gyro_frame = frame_the;
+		ReleaseMutex(mutex);
+		filter.initHeading(angle - gyro_frame, lag);
+		InterlockedExchange(&is_gyro_heading, 1);
+		return 0;
+	}
+
+	return filter.correctHeading(angle - gyro_frame, lag);
+}
+
+/*!
+ * @brief オドメトリの位置と姿勢の共分散
+ * 位置は最後にクリアした位置からの不確かさ（ロック無し）．
+ *
+ * @param[out] cov (x,y,the)の共分散 3x3の行列を行の順に9個 (m^2, m rad, rad^2)
+ *
+ * @return 0
+ */
+int megaRover::getOdometoryCovariance(float *cov)
+{
+	float c[9];
+	LONG seq;
+	do {
+		seq = cov_seq.beginRead();
+		memcpy(c, pose_cov, sizeof(c));
+	} while(cov_seq.retry(seq));
+
+	float r = frame_the;								// 出力の座標系に回転 R C R^T
+	float rc = cos(r), rs = sin(r);
+	float m[3][3] = {{rc, -rs, 0}, {rs, rc, 0}, {0, 0, 1.0f}}, t[3][3];
+	for(int i = 0; i < 3; i ++){
+		for(int j = 0; j < 3; j ++){
+			t[i][j] = 0;
+			for(int l = 0; l < 3; l ++) t[i][j] += m[i][l] * c[l * 3 + j];
+		}
+	}
+	for(int i = 0; i < 3; i ++){
+		for(int j = 0; j < 3; j ++){
+			cov[i * 3 + j] = 0;
+			for(int l = 0; l < 3; l ++) cov[i * 3 + j] += t[i][l] * m[j][l];
+		}
+	}
+
+	return 0;
+}
+
@@ -1,8 +1,12 @@
 ﻿#pragma once
 
 #include <windows.h>
-
-#define MEGA_ROVER_1_1
+#include "periodicScheduler.h"
+#include "seqlock.h"
+#include "roverTransport.h"
+#include "poseHistory.h"
+#include "odometryFilter.h"
+#include "speedController.h"
 
 #define UP_BUTTON		0x10
 #define DOWN_BUTTON		0x40
@@ -14,38 +18,104 @@ class megaRover
 private:
 	static const int TREAD = 280;				//! トレッド（ホイールの距離）(mm)
 	const float MAX_SPEED;						//! 最大速度(m/s)
+	static const int UPDATE_PERIOD = 20;		//! 制御の周期(ms)
 
 	int is_speed_control_mode;					//! 速度制御モード（1:速度制御モード，0:その他）
 	float refSpeedRight, refSpeedLeft;			//! 左右ホイールの目標速度(m/s)
 	float speedRight, speedLeft;				//! 左右ホイールの速度(m/s)
-	float odoX, odoY, odoThe;					//! オドメトリの位置(m)，姿勢(rad)
+	float odoX, odoY, odoThe;					//! オドメトリの位置(m)，姿勢(rad) 制御スレッドだけが使う連続した座標系
 	int deltaR, deltaL;							//! 左右ホイールの加速度(m/s^2)
+	speedController controller;					//! 速度制御の計算（制御スレッドだけが使う）
 	int terminate;								//! スレッドの破棄（1:破棄, 0:継続）
 	static DWORD WINAPI ThreadFunc(LPVOID lpParameter);	// スレッドのエントリーポイント
 	DWORD WINAPI ExecThread();					// 別スレッドで動作する関数
 	int Update();								// 周期的に行う処理
-	HANDLE mutex, comMutex;						// COMポートの排他制御
+	periodicScheduler scheduler;				//! 制御の周期の期限と実際の周期の計測
+	HANDLE mutex;								// オドメトリの排他制御
+	HANDLE thread;								//! 速度制御のスレッドのハンドル
+	roverTransport *transport;					//! ボードとの通信（実機またはシミュレーション）
 	int getEncoder(unsigned int *right, unsigned int *left);
 												// エンコーダの値の取得
+
+	// メモリマップの読み書き（通信は速度制御のスレッドだけが行う）
+	/*!
+	 * @struct board_state_T
+	 * @brief 周期毎に読み込んだボードの状態
+	 */
+	struct board_state_T{
+		unsigned short encoder_a, encoder_b;	//!< エンコーダの値
+		short button;							//!< ゲームパッドのボタン
+		short joy_ud, joy_lr;					//!< ゲームパッドの左の上下，右の左右の傾き
+		short voltage;							//!< 電源電圧（メモリの数値）
+		short sw;								//!< CPUボードのスイッチ入力
+	} board_state;
+	seqlock board_seq;							//! board_stateの書き込みの回数
+	volatile LONG motor_command;				//! 左右のモータのトルクの指令（上位16bit:右，下位16bit:左）
+	volatile LONG servo_command;				//! サーボのゲインの指令（負の場合は指令無し）
+	int readMemoryMap();						// 電源電圧からエンコーダまでを１回で読み込む
+	int writeMemoryMap(int is_ramp = 1);		// 指令を反映して１回で書き込む
+	int getBoardState(board_state_T *state);	// ボードの状態を取得（他のスレッドから呼び出せる）
+
+	// オドメトリの履歴（センサデータを計測した時刻の位置に合わせるために使用）
+	// 履歴はクリアや角度の設定で変わらない連続した座標系(odoX,odoY,odoThe)で保存し，
+	// 取得する時に出力の座標系への変換(frame_*)を掛ける
+	poseHistory history;						//! オドメトリの履歴（制御スレッドが書き込み，ロック無しで読む）
+	float frame_x, frame_y, frame_the;			//! 連続した座標系から出力の座標系への変換(m, rad)
+	seqlock frame_seq;							//! frame_*の書き込みの回数
+	int toOutputFrame(float *x, float *y, float *the);	// 連続した座標系の位置を出力の座標系に変換
+	int setOutputFrame(float x, float y, float the, float out_x, float out_y, float out_the);
+												// 連続した座標系の位置が出力の座標系の位置になるように変換を設定
+	int getLatestPose(float *x, float *y, float *the);	// 最新の連続した座標系の位置
+
+	// ホイールとジャイロの統合（フィルタは制御スレッドだけが使い，ジャイロの角度は他のスレッドから受け取る）
+	odometryFilter filter;						//! 位置，姿勢とジャイロのずれの推定
+	float gyro_frame;							//! ジャイロの角度 - 連続した座標系の角度（最初の角度で決める）(rad)
+	float gyro_angle;							//! 受け取ったジャイロの角度(rad)
+	unsigned long gyro_time;					//! ジャイロの角度を計測した時刻(ms)
+	seqlock gyro_seq;							//! gyro_angle,gyro_timeの書き込みの回数
+	LONG gyro_done;								//! フィルタで使ったgyro_seq
+	float gyro_angle0;							//! 前にフィルタで使ったジャイロの角度(rad) 角速度を求める
+	unsigned long gyro_time0;					//! 前にフィルタで使ったジャイロの角度の時刻(ms) 0:無し
+	volatile LONG is_gyro_heading;				//! ジャイロの角度を使っているか（1:使用中）
+	volatile LONG reset_request;				//! 位置の共分散のリセットの要求（1:有り）
+	float pose_cov[9];							//! 出力する位置と姿勢の共分散（連続した座標系）
+	seqlock cov_seq;							//! pose_covの書き込みの回数
+	int updateHeading();						// 受け取ったジャイロの角度でフィルタを補正
+
+	// 前進の速度の上限（safetyMonitorがURGのスレッドから設定）
+	volatile LONG speed_cap;					//! 前進の速度の上限(mm/s) 負の場合は制限無し
+	volatile LONG cap_time;						//! 上限を要求した原因のスキャンの時刻(ms)
+	HANDLE cap_event;							//! 上限が変わったことを制御スレッドに知らせるイベント
+	int limitSpeed(float *right, float *left);	// 速度の上限で左右ホイールの目標速度を制限する
+	int applySpeedCap();						// 上限が変わったときに制御周期を待たずにモータを止める
 public:
 	megaRover();								// コンストラクタ
 	~megaRover();								// デストラクタ
 
+	int setTransport(roverTransport *transport);	// ボードとの通信の方法を設定（init()の前）
 	int init();									// 初期化
 	int close();								// 終了処理
 	int servoOn(int gain);						// サーボオン(gain:100)
 	int setDelta(int right, int left);			// 変化量を指定
+	int getLimit(float *max_speed, float *max_acc);	// ホイールの最大速度と最大加速度を取得
 	int setMotor(int right, int left);			// モータへのトルク入力(-127-127)
 
 	// speed control mode
 	int setSpeedControlMode(int is_on);			// 速度制御モードへの切り替え(1:速度制御，0:オフ)
 	int setSpeed(float front, float rotate);	// ホイールの目標速度(m/s)
 	int setArcSpeed(float front, float radius);	// ロボットの目標速度(前後，回転)
+	int setSpeedCap(float max_front, unsigned long time);	// 前進の速度の上限を設定(m/s) 負の場合は解除（スレッドセーフ）
 	int getOdometory(float *x, float *y, float *the, int is_clear);	// オドメトリの取得(m, rad) 1:クリア
+	int getOdometoryAt(unsigned long time, float *x, float *y, float *the);	// 指定した時刻のオドメトリの取得(m, rad)
+	int getOdometoryDelta(unsigned long t0, unsigned long t1, float *dx, float *dy, float *dthe);
+												// t1のオドメトリをt0のロボット座標系で取得(m, rad)
 	int getJoyStick(float *x, float *y, int *b);
 												// ジョイスティック情報の取得
+	int getPowerVoltage(float *voltage);		// 電源電圧の取得(V)
 	int getReferenceSpeed(float *right, float *left);
-	int setOdometoryAngle(float angle);			// ジャイロオドメトリのために方位を設定する(rad)
+	int setOdometoryAngle(float angle);			// 方位を設定する(rad)
+	int setGyroAngle(float angle, unsigned long time);	// ジャイロの角度(rad)と計測した時刻(ms)を入力（スレッドセーフ）
+	int getOdometoryCovariance(float *cov);		// オドメトリの位置と姿勢の共分散(3x3)
 	int getSpeed(float *rightSpeed, float *leftSpeed);
 	int megaRover::clearOdometory();			// オドメトリの値をクリアする．
 };
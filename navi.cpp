@@ -37,7 +37,7 @@ estX0(0), estY0(0), estThe0(0), estX(0), estY(0), estThe(0),
 hThread(NULL), coincidence(0),
 is_search_object(0), is_search_mode(0), search_mode(0),
 searchX(10000.0f), searchY(10000.0f),									// 非常に遠い位置を入れる
-is_reroute_mode(0), reroute_direction(RIGHT), reroute_mode(0),
+is_reroute_mode(0), reroute_num(0), reroute_index(0), reroute_time(0), reroute_start_x(0), reroute_start_y(0),
 forwardSpeed(0), rotateSpeed(0), is_need_stop(0)
 {
 }
@@ -875,17 +875,27 @@ float navi::distaceFromPreviousSearchPoint()
 }
 
 /*!
- * @brief リルートモードにする．
+ * @brief リルートの経路を設定してリルートモードにする
  *
- * @param[in] direction リルートの方向
+ * @param[in] x,y 経路の点(m) グローバル座標（推定位置と同じ座標系）
+ * @param[in] num 経路の点の数
  *
- * @return 0
+ * @return 0:成功，-1:点の数が不正
  */
-int navi::setRerouteMode(int direction)
+int navi::setReroutePath(const float *x, const float *y, int num)
 {
+	if ((num <= 0)||(num > MAX_REROUTE_PATH)) return -1;
+	for(int i = 0; i < num; i ++){
+		reroute_x[i] = x[i];
+		reroute_y[i] = y[i];
+	}
+	reroute_num = num;
+	reroute_index = 0;
+	reroute_time = timeGetTime();
+	reroute_start_x = estX;
+	reroute_start_y = estY;
 	is_reroute_mode = 1;
-	reroute_direction = direction;
-	reroute_mode = 0;
+	stop();
 
 	return 0;
 }
@@ -896,146 +906,56 @@ int navi::isRerouteMode()
 }
 
 /*!
- * @brief 探索のプロセス
+ * @brief リルートの経路を追従する
+ * 先読み距離より近づいた点は飛ばし，追従する点に向かう円弧の曲率で回転速度を決める（pure pursuit）．
+ * 向きが大きくずれている場合はその場で回転する．
+ * 最後の点に到達するか，停止が必要になるか，時間切れで終了して通常の走行に戻る．
+ * 停止が必要かどうかは止まった障害物の前から始めるため，その場で回転している間と始めた位置からLEAVE_DISTANCE離れるまでは判定しない
+ * （始めから停止が必要な状態のため，判定すると最初の周期で終了してしまう）．
  *
  * @return 1:継続中，0:終了
  */
 int navi::rerouteProcess()
 {
-	LOG("reroute_process, reroute_mode : %d\n", reroute_mode);
-
-
-	const float MARGIN_ANGLE = 0.1f;		// 次のモードに移る角度誤差(rad)
-	const float MARGIN_DIST_HUMAN = 1.0f;	// 人に近づく距離(m)
-	const float MARGIN_DIST_RETURN = 0.1f;	// 経路に戻るときに次のモードに移る位置誤差(m)
-
-	enum SEQUENCE {
-		INIT = 0,
-		TURN_SIDE,
-		MOVE_SIDE,
-		TURN_FORWARD,
-		MOVE_FORWARD,
-		TURN_RETURN,
-		MOVE_RETURN,
-		TURN_WAYPOINT,
-		FINISH
-	};
-	
-	int res = 1;
-
-	static long time_mode0 = 0;				// 前回modeを切り替えた時の時間(ms)
-	static int reroute_mode0 = -1;			// 前回のsearch_mode
-	if (reroute_mode != reroute_mode0){
-		reroute_mode0 = reroute_mode;
-		time_mode0 = timeGetTime();
-	}
-	float mode_period = (timeGetTime() - time_mode0) / 1000.0f;
-
-	LOG("reroute_mode:%d\n", reroute_mode);
-	if (mode_period > 6.0f) reroute_mode ++;
-	if (mode_period < 1.0f){
+	const float LOOKAHEAD = 0.4f;			// 先読み距離(m)
+	const float FORWARD_SPEED = 0.25f;		// 前進の速度(m/s)
+	const float ROTATE_SPEED = 0.5f;		// その場で回転する速度(rad/s)
+	const float TURN_ANGLE = 1.0f;			// その場で回転する角度誤差(rad)
+	const float GOAL_MARGIN = 0.15f;		// 最後の点に到達したとする距離(m)
+	const long REROUTE_TIMEOUT = 30000;		// リルートを打ち切る時間(ms) 最も長い候補(約5.2m)をFORWARD_SPEEDで追従して回転する時間
+	const float LEAVE_DISTANCE = 0.3f;		// 停止が必要かを判定し始める開始位置からの距離(m)
+
+	float sx = estX - reroute_start_x, sy = estY - reroute_start_y;
+	int is_check_stop = ((forwardSpeed > 0.0f)&&(sqrt(sx * sx + sy * sy) > LEAVE_DISTANCE)) ? 1 : 0;
+	float dx = reroute_x[reroute_num - 1] - estX, dy = reroute_y[reroute_num - 1] - estY;
+	if ((sqrt(dx * dx + dy * dy) < GOAL_MARGIN)||(is_check_stop && is_need_stop)||
+		((long)(timeGetTime() - reroute_time) > REROUTE_TIMEOUT)){
+		LOG("reroute_finish:index %d, need_stop %d\n", reroute_index, is_need_stop);
 		stop();
-		rerouteX0 = estX, rerouteY0 = estY, rerouteThe0 = estThe;
-	} else {
-		switch(reroute_mode){
-			case INIT:{
-				reroute_mode ++;
-				break;
-					}
-			case TURN_SIDE:{
-				if (!turn90deg(reroute_direction, rerouteThe0, MARGIN_ANGLE)) reroute_mode ++;
-				break;
-					}
-			case MOVE_SIDE:{
-				if (!moveForward(0.282, rerouteX0, rerouteY0)) reroute_mode ++;
-				break;
-					}
-			case TURN_FORWARD:{
-				if (!turn90deg(-reroute_direction, rerouteThe0, MARGIN_ANGLE)) reroute_mode ++;
-				break;
-					}
-			case MOVE_FORWARD:{
-				if (is_need_stop) reroute_mode = TURN_SIDE;
-				if (!moveForward(0.5, rerouteX0, rerouteY0)) reroute_mode ++;
-				break;
-					}
-			case TURN_RETURN:{
-				if (!turn90deg(-reroute_direction, rerouteThe0, MARGIN_ANGLE)) reroute_mode ++;
-				break;
-					}
-			case MOVE_RETURN:{
-				if (!moveForward(0.282, rerouteX0, rerouteY0)) reroute_mode ++;
-				break;
-					}
-			case TURN_WAYPOINT:{
-				if (!turn90deg(reroute_direction, rerouteThe0, MARGIN_ANGLE)) reroute_mode ++;
-				break;
-					}
-			case FINISH:{
-				data_no = 0;
-				is_reroute_mode = 0;
-				res = 0;
-				break;
-					}
-		}
+		data_no = 0;
+		is_reroute_mode = 0;
+		return 0;
 	}
 
-	return res;
-}
-
-/*!
- * @brief 90度回転する．
- *
- * @return 1:継続中，0:終了
- */
-int navi::turn90deg(int direction, float the0, float margin_angle)
-{
-	const float ROTATE_SPEED = 0.5f;
-	
-	int ret = 1;
-	float ang;
-	if (direction == RIGHT){
-		ang = the0 - M_PI / 2.0f;
-	} else {
-		ang = the0 + M_PI / 2.0f;
+	while(reroute_index < reroute_num - 1){
+		dx = reroute_x[reroute_index] - estX, dy = reroute_y[reroute_index] - estY;
+		if (sqrt(dx * dx + dy * dy) >= LOOKAHEAD) break;
+		reroute_index ++;
 	}
-	float ang_err = maxPI(ang - estThe);
-	
-	forwardSpeed = 0.0f;
-	if (fabs(ang_err) > margin_angle){
-		if (ang_err > 0.0f) rotateSpeed =  ROTATE_SPEED;
-		else				rotateSpeed = -ROTATE_SPEED;
-	} else {
-		rotateSpeed = 0.0f;
-		ret = 0;				// タスクが終了
-	}
-
-	return ret;
-}
-
-/*!
- * @brief ある距離だけ走行
- *
- * @return 1:継続中，0:終了
- */
-int navi::moveForward(float length, float x0, float y0)
-{
-	const float FORWARD_SPEED = 0.15f;
-	
-	int ret = 1;
-	float dx = estX - x0, dy = estY - y0;
+	dx = reroute_x[reroute_index] - estX, dy = reroute_y[reroute_index] - estY;
 	float dist = sqrt(dx * dx + dy * dy);
-	
-	rotateSpeed = 0;
-	if (dist < length){
-		forwardSpeed = FORWARD_SPEED;
-	} else {
+	float ang_err = maxPI(atan2(dy, dx) - estThe);
+
+	if (fabs(ang_err) > TURN_ANGLE){
 		forwardSpeed = 0.0f;
-		rotateSpeed = 0.0f;
-		ret = 0;
+		rotateSpeed = (ang_err > 0.0f) ? ROTATE_SPEED : -ROTATE_SPEED;
+	} else {
+		forwardSpeed = FORWARD_SPEED;
+		rotateSpeed = 2.0f * FORWARD_SPEED * sin(ang_err) / max(dist, LOOKAHEAD);	// 曲率 2sin(α)/L
 	}
+	LOG("reroute_process:index %d, forward %f, rotate %f\n", reroute_index, forwardSpeed, rotateSpeed);
 
-	return ret;
+	return 1;
 }
 
 /*!
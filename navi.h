@@ -68,15 +68,16 @@ private:
 	int turnToPos(float x, float y, float margin_angle);	// 目標(x,y)に向き直る
 	int moveToPos(float x, float y, float margin_distance);	// 目標(x,y)に近寄る
 
-	int is_reroute_mode;
-	int reroute_direction;
-	int reroute_mode;
-	float rerouteX0, rerouteY0, rerouteThe0;				// リルートを始めた時のx,y,the
-	int rerouteProcess();
-	int turn90deg(int direction, float the0, float margin_angle);
-	int moveForward(float length, float x0, float y0);
-
-	static const int RIGHT = -1, CENTER = 0, LEFT = +1;	//! 右，中央，左の定数
+	// リルート（reroutePlannerが求めた経路を連続的に追従する）
+	static const int MAX_REROUTE_PATH = 8;					//! リルートの経路の点の最大数
+	int is_reroute_mode;									//! リルート中かどうか
+	float reroute_x[MAX_REROUTE_PATH], reroute_y[MAX_REROUTE_PATH];	//! リルートの経路(m) グローバル座標
+	int reroute_num;										//! リルートの経路の点の数
+	int reroute_index;										//! 追従している経路の点の番号
+	long reroute_time;										//! リルートを始めた時間(ms)
+	float reroute_start_x, reroute_start_y;					//! リルートを始めた位置(m) グローバル座標
+	int rerouteProcess();									// リルートの経路を追従する
+
 	int is_need_stop;
 
 public:
@@ -100,7 +101,7 @@ public:
 	int isSearchMode();														// 探索モードかどうかを戻す(0:探索モードでない，1:探索モード）
 	int getSpeed(float *forward, float *rotate);							// 直接ホイールの速度を司令する．(探索モードで使用)
 	float distaceFromPreviousSearchPoint();									// 前回の探索対象からの距離を戻す(m)
-	int setRerouteMode(int direction);										// リルートモードにする．
+	int setReroutePath(const float *x, const float *y, int num);			// リルートの経路を設定してリルートモードにする
 	int isRerouteMode();
 	int setNeedStop(int is_need_stop);
 };
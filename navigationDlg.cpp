@@ -16,6 +16,7 @@
 #include "navigation.h"
 #include "navigationDlg.h"
 #include "logger.h"
+#include "scanLogger.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -27,6 +28,7 @@
 #define USE_MEGA_ROVER
 #define USE_IMU
 //#define USE_CAMERA
+#define USE_LOCAL_PLANNER
 
 // アプリケーションのバージョン情報に使われる CAboutDlg ダイアログ
 
@@ -134,14 +136,17 @@ BOOL CnavigationDlg::OnInitDialog()
 
 	ShowWindow(SW_SHOW);
 
-#ifdef _DEBUG
 	char s[100];
 	time_t timer = time(NULL);
 	struct tm *date = localtime(&timer);
-	sprintf(s, "log%04d%02d%02d%02d%02d.txt", date->tm_year+1900, date->tm_mon+1, date->tm_mday, date->tm_hour, date->tm_min);
+	sprintf(s, "log%04d%02d%02d%02d%02d.bin", date->tm_year+1900, date->tm_mon+1, date->tm_mday, date->tm_hour, date->tm_min);
 
-	logger::Init(s);
+	logger::Init(s);										// バイナリで書き込むのでリリースビルドでも使う（テキストはlogDecoderで変換）
 	LOG("START\n");
+
+#ifdef _DEBUG
+	sprintf(s, "scan%04d%02d%02d%02d%02d.bin", date->tm_year+1900, date->tm_mon+1, date->tm_mday, date->tm_hour, date->tm_min);
+	scanLogger::Init(s);
 #endif
 
 	timeBeginPeriod(1);
@@ -155,11 +160,28 @@ BOOL CnavigationDlg::OnInitDialog()
 	mega_rover.setSpeedControlMode(1);
 	mega_rover.setDelta(20,20);		// 加減速の程度
 #endif
+#if defined(USE_LOCAL_PLANNER) && defined(USE_MEGA_ROVER)
+	{
+		float max_speed, max_acc;
+		mega_rover.getLimit(&max_speed, &max_acc);
+		local_planner.setLimit(max_speed, max_acc);	// 加減速の制限内で候補を作る
+	}
+#endif
+#ifdef USE_LOCAL_PLANNER
+	local_planner.setCostmap(obs_avoid.getCostmap());	// 障害物回避と同じ距離のグリッドを使う
+#endif
+	reroute_planner.setCostmap(obs_avoid.getCostmap());	// 回避経路の候補を同じ距離のグリッドで評価する
 #ifdef USE_IMU
 	IMU.Init(IMU_COM_PORT);
 #endif
 #ifdef USE_CAMERA
 	ip.init();
+#endif
+#if defined(USE_URG3D) && defined(USE_MEGA_ROVER)
+	urg3d.setOdometorySource(&mega_rover);	// スキャン中の移動の補正と計測時刻の位置合わせに使用
+#endif
+#if defined(USE_IMU) && defined(USE_MEGA_ROVER)
+	IMU.setRover(&mega_rover);				// 受信する毎に方位をオドメトリと統合
 #endif
 	navigation.Init();
 	obs_avoid.Init();
@@ -240,8 +262,9 @@ void CnavigationDlg::OnClose()
 
 	timeEndPeriod(1);
 
-#ifdef _DEBUG
 	logger::Close();
+#ifdef _DEBUG
+	scanLogger::Close();
 #endif
 	CDialog::OnClose();
 }
@@ -258,12 +281,12 @@ void CnavigationDlg::OnTimer(UINT_PTR nIDEvent)
 
 	static const int search_z0     = 1800, search_z1     = 1900;	//! 上下方向の探索範囲(mm) 屋内用
 //	static const int search_z0     = 1900, search_z1     = 2000;	//! 上下方向の探索範囲(mm) 屋外用
-	static const int search_obs_z0 =    0, search_obs_z1 = 1000;	//! 障害物を探す上下方向の探索範囲(mm)　URGの高さが基準　【ToDo: 上まで探索したほうが良いのではないか？】
 	static const int search_tar_z0 =  200, search_tar_z1 = 400;		//! ターゲットを探す上下方向の探索範囲(mm)　URGの高さが基準
 	static const int intensity_thre = 7000;							//! 反射強度のしきい値(単位なし)
 
 	static int is_first = 1;
 	float odoX = 0, odoY = 0, odoThe = 0;							//! オドメトリの位置と角度(m, rad)
+	unsigned long odo_time = timeGetTime();							//! オドメトリを取得した時刻(ms) URGのデータもこの時刻に合わせる
 	float estX = 0, estY = 0, estThe = 0;							//! 推定した位置と角度(m, rad)
 	float joyX, joyY;
 	int button;
@@ -289,9 +312,10 @@ void CnavigationDlg::OnTimer(UINT_PTR nIDEvent)
 	float rightSpeed, leftSpeed;
 	mega_rover.getSpeed(&rightSpeed, &leftSpeed);
 	LOG("rightSpeed:%f, leftSpeed%f\n", rightSpeed, leftSpeed);
-	mega_rover.getOdometory(&odoX, &odoY, &odoThe, 0);			// オドメトリを取得
+	mega_rover.getOdometoryAt(odo_time, &odoX, &odoY, &odoThe);	// オドメトリを取得
 	LOG("odometory:(%f,%f,%f)\n", odoX, odoY, odoThe);
 	estX = odoX, estY = odoY, estThe = odoThe;					// パーティクルフイルタを使用していないときは，推定位置とオドメトリは一緒
+	obs_avoid.getCostmap()->setPose(odoX, odoY, odoThe);		// 距離のグリッドを現在の位置から参照する
 	mega_rover.getJoyStick(&joyX, &joyY, &button);				// ジョイスティックの値を取得
 	if (fabs(joyX) < 0.1f) joyX = 0.0f;
 	if (fabs(joyY) < 0.1f) joyY = 0.0f;
@@ -335,7 +359,7 @@ void CnavigationDlg::OnTimer(UINT_PTR nIDEvent)
 		navigation.getTargetPosition(&tarX, &tarY, &tarThe, &period);
 																// 目標位置の取得
 		LOG("targetPosition:(%f,%f,%f)\n", tarX, tarY, tarThe);
-		float slowDownFactor = obs_avoid.getSlowDownFactor();	// 障害物があったときの減速する比率を取得
+		float slowDownFactor;									// 指令する円弧の衝突までの時間から求める減速の比率
 		navigation.setNeedStop(obs_avoid.isNeedStop());
 		
 		if (reroute_mode0 && (!navigation.isRerouteMode())){
@@ -346,22 +370,51 @@ void CnavigationDlg::OnTimer(UINT_PTR nIDEvent)
 		if (obs_avoid.isReroute()){
 			float forward, rotate;
 			if (!reroute_mode0){
-				navigation.setRerouteMode(obs_avoid.getRerouteDirection());
-				reroute_mode0 = 1;
+				float px[reroutePlanner::PATH_NUM], py[reroutePlanner::PATH_NUM];
+				float dx = tarX - estX, dy = tarY - estY;
+				float tx =   dx * cos(estThe) + dy * sin(estThe);		// 目標のロボット座標系での位置
+				float ty = - dx * sin(estThe) + dy * cos(estThe);
+				if (!reroute_planner.plan(tx, ty, px, py)){				// 回避経路をグローバル座標にしてnaviに渡す
+					float gx[reroutePlanner::PATH_NUM], gy[reroutePlanner::PATH_NUM];
+					for(int i = 0; i < reroutePlanner::PATH_NUM; i ++){
+						gx[i] = estX + px[i] * cos(estThe) - py[i] * sin(estThe);
+						gy[i] = estY + px[i] * sin(estThe) + py[i] * cos(estThe);
+					}
+					navigation.setReroutePath(gx, gy, reroutePlanner::PATH_NUM);
+					reroute_mode0 = 1;
+				} else {
+					obs_avoid.finishReroute();							// 回避経路が無い場合は停止したまま再び待つ
+				}
 			}
 			navigation.getSpeed(&forward, &rotate);
-			mega_rover.setSpeed(forward * slowDownFactor, rotate);
+			if (!reroute_mode0) forward = rotate = 0.0f;
+			slowDownFactor = obs_avoid.getArcSlowDownFactor(forward, (rotate != 0) ? forward / rotate : 0);
+			mega_rover.setSpeed(forward * slowDownFactor, rotate * slowDownFactor);
 			LOG("reroute_mode, forward;%f, rotate:%f, slowDownFactor:%f\n", forward, rotate, slowDownFactor);
 		} else if (navigation.isSearchMode()){
 			float forward, rotate;
 			navigation.getSpeed(&forward, &rotate);
-			mega_rover.setSpeed(forward * slowDownFactor, rotate);
+			slowDownFactor = obs_avoid.getArcSlowDownFactor(forward, (rotate != 0) ? forward / rotate : 0);
+			mega_rover.setSpeed(forward * slowDownFactor, rotate * slowDownFactor);
 			LOG("search_mode, forward;%f, rotate:%f, slowDownFactor:%f\n", forward, rotate, slowDownFactor);
 		} else {
-			if (slowDownFactor < 1.0f) PlaySound("obstacle.wav", NULL, SND_FILENAME | SND_ASYNC | SND_NOSTOP);
+#ifdef USE_LOCAL_PLANNER
+			float dx = tarX - estX, dy = tarY - estY, forward, rotate;
+			float tx =   dx * cos(estThe) + dy * sin(estThe);		// 目標のロボット座標系での位置
+			float ty = - dx * sin(estThe) + dy * cos(estThe);
+			if (local_planner.plan(tx, ty, rightSpeed, leftSpeed, &forward, &rotate)){
+				PlaySound("obstacle.wav", NULL, SND_FILENAME | SND_ASYNC | SND_NOSTOP);
+			}
+			slowDownFactor = obs_avoid.getArcSlowDownFactor(forward, (rotate != 0) ? forward / rotate : 0);	// 選んだ円弧に沿って衝突までの時間を求める
+			mega_rover.setSpeed(forward * slowDownFactor, rotate * slowDownFactor);	// 障害物を避けながら目標に向かう
+			LOG("local_planner, forward;%f, rotate:%f, slowDownFactor:%f, ttc:%f\n", forward, rotate, slowDownFactor, obs_avoid.getTimeToCollision());
+#else
 			navigation.getTargetArcSpeed(&front, &radius);		// 目標に移動する速度と半径
+			slowDownFactor = obs_avoid.getArcSlowDownFactor(front, radius);	// 走行する円弧に沿って衝突までの時間を求める
+			if (slowDownFactor < 1.0f) PlaySound("obstacle.wav", NULL, SND_FILENAME | SND_ASYNC | SND_NOSTOP);
 			mega_rover.setArcSpeed(front * slowDownFactor, radius);
-			LOG("target_arc_speed, front;%f, radius:%f, slowDownFactor:%f\n", front, radius, slowDownFactor);
+			LOG("target_arc_speed, front;%f, radius:%f, slowDownFactor:%f, ttc:%f\n", front, radius, slowDownFactor, obs_avoid.getTimeToCollision());
+#endif
 		}
 
 		navigationView.setOdometory(estX, estY, estThe);		// 推定位置の入力
@@ -369,10 +422,7 @@ void CnavigationDlg::OnTimer(UINT_PTR nIDEvent)
 		
 		// パーティクルの取得と表示
 		navigation.getParticle(particle, &particle_num, MAX_PARTICLE_NUM);
-		LOG("\n");
-		for(int i = 0;i < particle_num; i ++){
-			LOG_WITHOUT_TIME("particle:(%f,%f,%f), eval:%d\n", particle[i].x, particle[i].y, particle[i].the, particle[i].eval);
-		}
+		scanLogger::WriteParticle(timeGetTime(), particle, particle_num);
 		navigationView.setParticle(particle, particle_num);		// パーティクルの表示
 		
 		// 一致度の取得と表示
@@ -392,11 +442,6 @@ void CnavigationDlg::OnTimer(UINT_PTR nIDEvent)
 	static pos p[MAX_DATA];
 	int num = 0;
 
-	// URG3Dから受信する障害物のデータ
-	static const int MAX_OBS_DATA = 10000;
-	static pos op[MAX_OBS_DATA];
-	int obs_num = 0;
-
 	// URG3Dから受信するターゲットのデータ
 	static const int MAX_TAR_DATA = 10000;
 	static pos_inten tp[MAX_TAR_DATA];
@@ -432,11 +477,10 @@ void CnavigationDlg::OnTimer(UINT_PTR nIDEvent)
 	
 	// URG3Dからデータを取得
 	urg3d.Get3SelectedData(search_z0, search_z1, p, &num, MAX_DATA,
-		search_obs_z0, search_obs_z1, op, &obs_num, MAX_OBS_DATA,
-		search_tar_z0, search_tar_z1, tp, &tar_num, MAX_TAR_DATA, intensity_thre);
+		0, 0, NULL, NULL, 0,																// 障害物はボクセル地図から取得する
+		search_tar_z0, search_tar_z1, tp, &tar_num, MAX_TAR_DATA, intensity_thre, odo_time);
 	
 	// world座標系に変換 (search_x,yで領域を制限)
-	LOG("\n");
 	for(int i = 0; i < num; i ++){
 		if ((p[i].x < search_x0)||(p[i].x > search_x1)||
 			(p[i].y < search_y0)||(p[i].y > search_y1)) continue;
@@ -447,7 +491,6 @@ void CnavigationDlg::OnTimer(UINT_PTR nIDEvent)
 		
 		x = (int)(p[i].x * cos(estThe) - p[i].y * sin(estThe) + estX * 1000.0f);			// 表示には推定位置を基準とした値を用いる
 		y = (int)(p[i].x * sin(estThe) + p[i].y * cos(estThe) + estY * 1000.0f);			// 推定していないときは，オドメトリと同じにする．
-		LOG_WITHOUT_TIME("urg_global_pos:(%d,%d,%d)\n", x, y, p[i].z);
 		drawPos[draw_no].x = x, drawPos[draw_no].y = y, drawPos[draw_no].z = p[i].z;
 		draw_no ++;
 		if (draw_no >= MAX_DRAW_POS) is_max = 1, draw_no = 0;
@@ -495,23 +538,7 @@ void CnavigationDlg::OnTimer(UINT_PTR nIDEvent)
 	navigation.getRefData(rp, &ref_num, MAX_REF_DATA);										// リファレンスデータの表示
 	navigationView.setRefData(rp, ref_num);
 
-	obs_avoid.setData(op, obs_num);															// 障害物データの代入
-#endif
-
-#ifdef USE_IMU
-	float xt = 0, yt = 0, zt = 0;
-
-	IMU.GetAngleStart();
-	if (IMU.GetAngle(&xt, &yt, &zt) == 0){
-		mega_rover.setOdometoryAngle(zt * M_PI / 180.0f);
-
-/*		{
-			char temp[256];
-			sprintf(temp, "angle xt:%f, yt:%f, zt:%f", xt, yt, zt);
-			message = temp;
-			UpdateData(FALSE);
-		}*/
-	}
+	obs_avoid.setData(urg3d.getVoxelMap(), odoX, odoY, odoThe);								// ボクセル地図の障害物で距離のグリッドを更新
 #endif
 	is_first = 0;
 	CDialog::OnTimer(nIDEvent);
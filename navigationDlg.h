@@ -11,6 +11,8 @@
 #include "obstacleAvoidance.h"
 #include "imageProcessing.h"
 #include "detectTarget.h"
+#include "localPlanner.h"
+#include "reroutePlanner.h"
 
 // CnavigationDlg ダイアログ
 class CnavigationDlg : public CDialog
@@ -44,6 +46,8 @@ private:
 	obstacleAvoidance obs_avoid;
 	imageProcessing ip;
 	detectTarget detect_target;
+	localPlanner local_planner;
+	reroutePlanner reroute_planner;
 
 	int is_record;
 	int is_play;
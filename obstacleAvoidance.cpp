@@ -11,14 +11,15 @@
 #include "obstacleAvoidance.h"
 #include <mmsystem.h>
 #include <time.h>
+#include <math.h>
 
 /*!
  * @brief コンストラクタ
  */
 obstacleAvoidance::obstacleAvoidance():
-is_obstacle(0), slow_down_factor(1.0f),
+is_obstacle(0), slow_down_factor(1.0f), time_to_collision(-1.0f),
 obstacle_detect_time(0), obstacle_detect_period(0),
-is_reroute(0), reroute_direction(0), is_need_stop(0)
+is_reroute(0), is_need_stop(0)
 {
 }
 
@@ -36,6 +37,8 @@ obstacleAvoidance::~obstacleAvoidance()
  */
 int obstacleAvoidance::Init()
 {
+	cmap.clear();				// オドメトリをクリアすると座標系が変わるため
+
 	return 0;
 }
 
@@ -72,25 +75,100 @@ float obstacleAvoidance::getSlowDownFactor()
 }
 
 /*!
- * @brief 障害物の位置データを設定
+ * @brief 指令する円弧の衝突までの時間から減速の比率を求める
+ * ロボットの足跡（costmap::ROBOT_RADIUSの円）を円弧に沿って進め，障害物に触れるまでの道のりを求める．
+ * 障害物までの距離だけ進めても触れないため，距離に応じて間隔を広げて参照する．
+ * 道のりからSTOP_MARGINを引いた距離を指令の速度で割った衝突までの時間が，TTC_MIN以上になるように減速する．
+ * 直進の箱で判定する場合と違い，曲がって避ける障害物では減速せず，曲がる内側の障害物では減速する．
  *
- * @param[in] p   障害物の位置データ
- * @param[in] num 障害物の位置データの数
+ * @param[in] front  前後の速度(m/s)
+ * @param[in] radius 回転半径(m) 左旋回が正，0は直進
  *
- * @return 0
+ * @return 減速の比率(0～1) 指令の速度にかける
  */
-int obstacleAvoidance::setData(pos *p, int num)
+float obstacleAvoidance::getArcSlowDownFactor(float front, float radius)
 {
-	obs_num = min(num, MAX_OBS_NUM);
-	pos *q = obs;
-	for(int i = 0; i < obs_num; i ++){
-		*q ++ = *p ++;
+	static const float TTC_MIN = 2.0f;			// 確保する衝突までの時間(s)
+	static const float STOP_MARGIN = 150.0f;	// 足跡が障害物に触れる前に残す距離(mm)
+	static const float STRAIGHT_RADIUS = 100.0f;	// これより大きい回転半径は直進とみなす(m)
+	static const float MIN_STEP = 50.0f;		// 足跡を進める最小の間隔(mm)
+
+	float speed = (float)fabs(front) * 1000.0f;	// mm/s
+	if (speed < 1.0f){
+		time_to_collision = -1.0f;
+		return 1.0f;
+	}
+	float dir = (front > 0) ? 1.0f : -1.0f;
+	float r = radius * 1000.0f;
+	int is_straight = ((radius == 0)||(fabs(radius) > STRAIGHT_RADIUS)) ? 1 : 0;
+	float horizon = speed * TTC_MIN + STOP_MARGIN;	// これより先の障害物では減速しない
+
+	float s = 0, collision = -1.0f;
+	while(s < horizon){
+		float x, y;
+		if (is_straight){
+			x = dir * s, y = 0;
+		} else {
+			float a = dir * s / r;
+			x = r * sin(a), y = r * (1.0f - cos(a));
+		}
+		float d = cmap.getDistance(x, y) - costmap::ROBOT_RADIUS;
+		if (d <= 0){
+			collision = s;
+			break;
+		}
+		s += max(d, MIN_STEP);
 	}
+
+	if (collision < 0){
+		time_to_collision = -1.0f;
+		return 1.0f;
+	}
+	time_to_collision = collision / speed;
+	float factor = (collision - STOP_MARGIN) / (speed * TTC_MIN);
+
+	return min(max(factor, 0.0f), 1.0f);
+}
+
+/*!
+ * @brief 指令した円弧で衝突するまでの時間を戻す
+ * 最後にgetArcSlowDownFactorを呼び出したときの値
+ *
+ * @return 衝突するまでの時間(s) 衝突しない場合は負
+ */
+float obstacleAvoidance::getTimeToCollision()
+{
+	return time_to_collision;
+}
+
+/*!
+ * @brief ボクセル地図を設定
+ * ボクセル地図の障害物で距離とコストのグリッドを更新して障害物回避の処理を行う．
+ *
+ * @param[in] map ボクセル地図（オドメトリの座標系）
+ * @param[in] x,y 現在のロボットの位置(m) オドメトリ
+ * @param[in] the 現在のロボットの向き(rad) オドメトリ
+ *
+ * @return 0
+ */
+int obstacleAvoidance::setData(voxelMap *map, float x, float y, float the)
+{
+	cmap.setData(map, x, y, the);
 	Update();
 
 	return 0;
 }
 
+/*!
+ * @brief 障害物からの距離とコストのグリッドを戻す
+ *
+ * @return グリッドのポインタ
+ */
+costmap *obstacleAvoidance::getCostmap()
+{
+	return &cmap;
+}
+
 /*!
  * @brief リルートするかどうかを戻す．
  *
@@ -103,40 +181,24 @@ int obstacleAvoidance::isReroute()
 	return is_reroute;
 }
 
-int obstacleAvoidance::getRerouteDirection()
-{
-	return reroute_direction;
-}
-
 
 /*!
  * @brief 障害物回避の処理を行う．(setData毎に呼び出される)
+ * チルトの掃引の間の障害物はボクセル地図で保持されるため，検出の結果をそのまま使う．
  *
  * @return 0
  */
 int obstacleAvoidance::Update()
 {
-	static const int FLAG_CLEAR_PERIOD = 2000;
-	static long time0 = 0;
-	static int min_len0 = SLOW_DOWN_LENGTH;		//! 障害物の最短距離を保存する変数．FLAG_CLEAR_PERIOD(2秒)だけ障害物を発見しないとクリア
-
-	int min_len;
+	int min_len = SLOW_DOWN_LENGTH;
 	is_obstacle = isDetectObstacle(CENTER, &min_len);	// 前の障害物の検出
-	
-	float factor = (float)(min_len - STOP_LENGTH)/(SLOW_DOWN_LENGTH - STOP_LENGTH);
-	if (is_obstacle && (factor < 0.1f)){
-		is_need_stop = 1;
-	} else {
-		is_need_stop = 0;
-	}
 
-	// 障害物の検出，スキャンを繰り返すため，一度検出したフラグを暫く保持
+	// slow_down_factor STOP_LENGTH以下で0, SLOW_DOWN_LENGTHで1
+	slow_down_factor = (float)(min_len - STOP_LENGTH)/(SLOW_DOWN_LENGTH - STOP_LENGTH);
+	slow_down_factor = min(max(slow_down_factor, 0.0f), 1.0f);
+	is_need_stop = (is_obstacle && (slow_down_factor < 0.1f)) ? 1 : 0;
+
 	if (is_obstacle){	// 回避すべき障害物がある場合
-		// slow_down_factor STOP_LENGTH以下で0, SLOW_DOWN_LENGTHで1
-		if (min_len < min_len0) min_len0 = min_len;
-		slow_down_factor = (float)(min_len0 - STOP_LENGTH)/(SLOW_DOWN_LENGTH - STOP_LENGTH);
-		slow_down_factor = min(max(slow_down_factor, 0),1);
-		
 		// 障害物を検知している時間を求める
 		if (slow_down_factor < 0.1){
 			if (obstacle_detect_time == 0){
@@ -152,81 +214,37 @@ int obstacleAvoidance::Update()
 		// リルート
 		if ((!is_reroute) && (obstacle_detect_period > REROUTE_PERIOD)){
 			obstacle_detect_time = 0;
-			is_reroute = 1;
-			if (!isDetectObstacle(RIGHT, &min_len)){
-				reroute_direction = RIGHT;
-			} else if (!isDetectObstacle(LEFT , &min_len)){
-				reroute_direction = LEFT;
-			} else {
-				reroute_direction = RIGHT;
-			}
+			is_reroute = 1;									// 回避経路はreroutePlannerで求める
 		}
-		time0 = timeGetTime();
 	} else {						// 障害物が無い場合
-		long time = timeGetTime();							// 2秒以上の間隔をあけてフラグのクリア
-		if ((time - time0) > FLAG_CLEAR_PERIOD){
-			is_obstacle = 0;
-			slow_down_factor = 1;
-			obstacle_detect_time = 0;
-			obstacle_detect_period = 0;
-			min_len0 = SLOW_DOWN_LENGTH;
-		}
+		obstacle_detect_time = 0;
+		obstacle_detect_period = 0;
 	}
 	
 	return 0;
 }
 
-/*!
- * @brief ある領域に入る障害物の個数の計算
- * (x_min,y_min)-(x_max,y_max)に含まれる
- *
- * @param[in] x_min     探索するx座標の最小値(mm) - 後
- * @param[in] y_min     探索するy座標の最小値(mm) - 右
- * @param[in] x_max     探索するx座標の最大値(mm) - 前
- * @param[in] y_max     探索するy座標の最大値(mm) - 左
- * @param[in] nearest_x 探索するy座標の最大値(mm) - 前
- *
- * @return 障害物の個数
- */
-int obstacleAvoidance::getDataNum(int x_min, int y_min, int x_max, int y_max, int *nearest_x)
-{
-	int point_num = 0, min_len = 10000;
-	for(int i = 0; i < obs_num; i ++){
-		if ((obs[i].x >= x_min)&&(obs[i].x < x_max)&&(obs[i].y >= y_min)&&(obs[i].y <= y_max)){
-			point_num ++;
-			if (obs[i].x < min_len) min_len = obs[i].x;
-		}
-	}
-	*nearest_x = min_len;
-
-	return point_num;
-}
-
 /*!
  * @brief 右，中央，左に障害物があるかを計測する
+ * 幅(TREAD/2+MARGIN)*2，前方SLOW_DOWN_LENGTHまでの箱に入る障害物のボクセルを数え，最も近いx座標を求める．
+ * ボクセル地図の障害物は複数回（voxelMap::MIN_HIT以上）計測され，通過した光線より多く計測されたものだけなので，
+ * １つのボクセルでも障害物とする（小さい障害物や低い障害物も止まる）．
  *
- * @param[in] right_center_left 右と中央と左の指定(RIGHT=-1,CENTER=0,LEFT=+1)
+ * @param[in]  right_center_left 右と中央と左の指定(RIGHT=-1,CENTER=0,LEFT=+1)
+ * @param[out] min_x             障害物までの距離(mm)
  *
- * @return 障害物の個数
+ * @return 1:障害物有り，0:障害物無し
  */
 int obstacleAvoidance::isDetectObstacle(int right_center_left, int *min_x)
 {
-	static const int MIN_POINT = 5;		// 障害物とみなす最小のデータ数（１回のスキャンで）
-	int point_num = 0, min_len = 10000, res = 0;
-	
-	if (right_center_left == CENTER){
-		point_num = getDataNum(100, -(TREAD/2+MARGIN)      , SLOW_DOWN_LENGTH, (TREAD/2+MARGIN)      , &min_len);	// 中央で１台分探索したときに障害物を発見するか．
-	} else if (right_center_left == RIGHT){
-		point_num = getDataNum(100, -(TREAD/2+MARGIN)-TREAD, SLOW_DOWN_LENGTH, (TREAD/2+MARGIN)-TREAD, &min_len);	// 右に１台分探索したときに障害物を発見するか．	
-	} else if (right_center_left == LEFT){
-		point_num = getDataNum(100, -(TREAD/2+MARGIN)+TREAD, SLOW_DOWN_LENGTH, (TREAD/2+MARGIN)+TREAD, &min_len);	// 左に１台分探索したときに障害物を発見するか．
-	}
-	if (point_num > MIN_POINT){
-		res = 1;
-		*min_x = min_len;
-	}
+	static const int X_MIN = 100;		// 探索を開始するx座標(mm)
+	const float y = (float)(right_center_left * TREAD), half_width = (float)(TREAD/2 + MARGIN);
+	int nearest_x;
+
+	if (cmap.getObstacleNum((float)X_MIN, y - half_width, (float)SLOW_DOWN_LENGTH, y + half_width, &nearest_x) == 0) return 0;
+	*min_x = nearest_x;
 
-	return res;
+	return 1;
 }
 
 /*!
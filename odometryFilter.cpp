@@ -0,0 +1,284 @@
+﻿/*!
+ * @file  odometryFilter.cpp
+ * @brief ホイールのオドメトリとジャイロの角度を統合する拡張カルマンフィルタ
+ *
+ * 状態は位置(x,y)，姿勢the，ジャイロの角度のずれoffset，ずれの変化率drift．
+ * ホイールの移動量で円弧として予測し，ジャイロの角度 = the + offset として補正する．
+ * 予測の回転角度はホイールとジャイロの角速度（driftを引いたもの）を分散で重み付けて統合する（滑りで回転がずれても追従する）．
+ * ホイールが止まっている間は姿勢の予測の誤差が0になるので，ジャイロのドリフトが推定される．
+ */
+
+#include "stdafx.h"
+#include "odometryFilter.h"
+#include <math.h>
+
+#define	M_PI	3.14159f
+
+/*!
+ * @class odometryFilter
+ * @brief ホイールとジャイロで位置と姿勢を推定するクラス
+ */
+
+const float odometryFilter::DIST_NOISE   = 0.0004f;		// 1m進むと標準偏差2cm
+const float odometryFilter::TURN_NOISE   = 0.0025f;		// 1rad回ると標準偏差0.05rad
+const float odometryFilter::SLIP_NOISE   = 0.0004f;		// 1m進むと標準偏差0.02rad
+const float odometryFilter::GYRO_NOISE   = 0.0001f;		// 標準偏差0.01rad（通信の遅れを含む）
+const float odometryFilter::RATE_NOISE   = 2.0e-6f;		// 20msの周期で標準偏差0.0002rad（角度の分解能0.008deg程度）
+const float odometryFilter::OFFSET_NOISE = 1.0e-8f;
+const float odometryFilter::DRIFT_NOISE  = 1.0e-8f;
+const float odometryFilter::INIT_DRIFT   = 4.0e-6f;		// 標準偏差0.002rad/s（約0.1deg/s）
+const float odometryFilter::GATE         = 10.8f;		// 自由度1のカイ２乗分布の99.9%
+
+/*!
+ * @brief コンストラクタ
+ */
+odometryFilter::odometryFilter():
+is_gyro(0), reject_count(0), gyro_rate(0), is_gyro_rate(0)
+{
+	for(int i = 0; i < N; i ++){
+		state[i] = 0;
+		for(int j = 0; j < N; j ++) cov[i][j] = 0;
+	}
+	cov[4][4] = INIT_DRIFT;
+}
+
+/*!
+ * @brief デストラクタ
+ */
+odometryFilter::~odometryFilter()
+{
+}
+
+/*!
+ * @brief 角度を-PI～PIにする
+ *
+ * @param[in] angle 角度(rad)
+ *
+ * @return -PI～PIの角度(rad)
+ */
+float odometryFilter::normalize(float angle)
+{
+	while(angle >  M_PI) angle -= 2.0f*M_PI;
+	while(angle < -M_PI) angle += 2.0f*M_PI;
+
+	return angle;
+}
+
+/*!
+ * @brief 位置の不確かさを0にする
+ * オドメトリをクリアしてその位置を原点として使う場合に呼び出す．姿勢の不確かさは残す．
+ *
+ * @return 0
+ */
+int odometryFilter::resetPosition()
+{
+	for(int i = 0; i < 2; i ++){
+		for(int j = 0; j < N; j ++) cov[i][j] = cov[j][i] = 0;
+	}
+
+	return 0;
+}
+
+/*!
+ * @brief 次の予測で使うジャイロの角速度
+ *
+ * @param[in] rate ジャイロの角速度(rad/s) 連続した２つの角度の差から求める
+ *
+ * @return 0
+ */
+int odometryFilter::setGyroRate(float rate)
+{
+	gyro_rate = rate;
+	is_gyro_rate = 1;
+
+	return 0;
+}
+
+/*!
+ * @brief ホイールの移動量とジャイロの角速度で予測
+ * 周期の間は一定の曲率で動いたとして円弧で積分する（中間の角度の方向に弦の長さだけ進む）．
+ * ジャイロの角速度がある場合は，ホイールの回転角度と (角速度 - drift)×周期 を分散で重み付けて回転角度とする．
+ *
+ * @param[in] ds   前後の移動距離(m)
+ * @param[in] dthe 回転角度(rad)
+ * @param[in] dt   周期(s)
+ *
+ * @return 0
+ */
+int odometryFilter::predict(float ds, float dthe, float dt)
+{
+	float qt = TURN_NOISE * fabs(dthe) + SLIP_NOISE * fabs(ds);	// ホイールの回転角度の分散
+	float gain = 0;										// ジャイロの角速度の重み
+	if (is_gyro && is_gyro_rate && (qt > 0)){
+		float qg = RATE_NOISE * dt;
+		gain = qt / (qt + qg);
+		dthe += gain * ((gyro_rate - state[4]) * dt - dthe);
+		qt = qt * qg / (qt + qg);
+	}
+	is_gyro_rate = 0;
+
+	float half = dthe / 2.0f;
+	float k = (fabs(half) < 1.0e-6f) ? 1.0f : sin(half) / half;	// 弦の長さ / 弧の長さ
+	float tm = state[2] + half;
+	float c = cos(tm), s = sin(tm);
+	float dx = k * ds * c, dy = k * ds * s;
+
+	state[0] += dx;
+	state[1] += dy;
+	state[2] = normalize(state[2] + dthe);
+	state[3] = normalize(state[3] + state[4] * dt);
+
+	float f[N][N], fp[N][N];							// 状態の遷移のヤコビアン
+	for(int i = 0; i < N; i ++){
+		for(int j = 0; j < N; j ++) f[i][j] = (i == j) ? 1.0f : 0.0f;
+	}
+	f[0][2] = -dy;
+	f[1][2] =  dx;
+	f[3][4] =  dt;
+	f[2][4] = -gain * dt;								// ジャイロの角速度からdriftを引いている
+	for(int i = 0; i < N; i ++){						// F P F^T
+		for(int j = 0; j < N; j ++){
+			fp[i][j] = 0;
+			for(int l = 0; l < N; l ++) fp[i][j] += f[i][l] * cov[l][j];
+		}
+	}
+	for(int i = 0; i < N; i ++){
+		for(int j = 0; j < N; j ++){
+			float sum = 0;
+			for(int l = 0; l < N; l ++) sum += fp[i][l] * f[j][l];
+			cov[i][j] = sum;
+		}
+	}
+
+	float qs = DIST_NOISE * fabs(ds);					// ホイールの移動量の誤差 G Q G^T
+	float g[3][2] = {{k * c, -0.5f * ds * s}, {k * s, 0.5f * ds * c}, {0, 1.0f}};
+	for(int i = 0; i < 3; i ++){
+		for(int j = 0; j < 3; j ++){
+			cov[i][j] += g[i][0] * qs * g[j][0] + g[i][1] * qt * g[j][1];
+		}
+	}
+	cov[3][3] += OFFSET_NOISE * dt;
+	cov[4][4] += DRIFT_NOISE * dt;
+
+	return 0;
+}
+
+/*!
+ * @brief ジャイロの角度のずれを初期化
+ * 計測した時刻の姿勢とジャイロの角度の差をずれとする．
+ *
+ * @param[in] z   ジャイロの角度(rad)
+ * @param[in] lag 計測した時刻から今までの回転角度(rad)
+ *
+ * @return 0
+ */
+int odometryFilter::initHeading(float z, float lag)
+{
+	state[3] = normalize(z - (state[2] - lag));
+	for(int j = 0; j < N; j ++) cov[3][j] = cov[j][3] = 0;
+	cov[3][3] = GYRO_NOISE;
+	if (!is_gyro){										// 最初はドリフト無し
+		state[4] = 0;
+		for(int j = 0; j < N; j ++) cov[4][j] = cov[j][4] = 0;
+		cov[4][4] = INIT_DRIFT;
+	}
+	is_gyro = 1;
+	reject_count = 0;
+
+	return 0;
+}
+
+/*!
+ * @brief ジャイロの角度で補正
+ * 計測した時刻の姿勢は今の姿勢からlagだけ戻したものとする．
+ * 外れ値は使わず，REINIT_COUNT回続いた場合はジャイロの角度が飛んだとしてずれを初期化する．
+ *
+ * @param[in] z   ジャイロの角度(rad)
+ * @param[in] lag 計測した時刻から今までの回転角度(rad)
+ *
+ * @return 0:補正，1:外れ値
+ */
+int odometryFilter::correctHeading(float z, float lag)
+{
+	if (!is_gyro) return initHeading(z, lag);
+
+	float y = normalize(z - (state[2] - lag + state[3]));	// イノベーション
+	float ph[N];										// P H^T  (H = [0 0 1 1 0])
+	for(int i = 0; i < N; i ++) ph[i] = cov[i][2] + cov[i][3];
+	float s = ph[2] + ph[3] + GYRO_NOISE;
+	if (y * y / s > GATE){
+		if (++ reject_count >= REINIT_COUNT) initHeading(z, lag);
+		return 1;
+	}
+	reject_count = 0;
+
+	float k[N];
+	for(int i = 0; i < N; i ++) k[i] = ph[i] / s;
+	for(int i = 0; i < N; i ++) state[i] += k[i] * y;
+	for(int i = 0; i < N; i ++){
+		for(int j = 0; j < N; j ++) cov[i][j] -= k[i] * ph[j];
+	}
+	for(int i = 0; i < N; i ++){						// 丸め誤差で非対称にならないようにする
+		for(int j = i + 1; j < N; j ++) cov[i][j] = cov[j][i] = (cov[i][j] + cov[j][i]) / 2.0f;
+	}
+	state[2] = normalize(state[2]);
+	state[3] = normalize(state[3]);
+
+	return 0;
+}
+
+/*!
+ * @brief 推定した位置と姿勢
+ *
+ * @param[out] x,y 位置(m)
+ * @param[out] the 姿勢(rad) -PI～PI
+ *
+ * @return 0
+ */
+int odometryFilter::getPose(float *x, float *y, float *the)
+{
+	*x = state[0], *y = state[1], *the = state[2];
+
+	return 0;
+}
+
+/*!
+ * @brief 位置と姿勢の共分散
+ *
+ * @param[out] c (x,y,the)の共分散 3x3の行列を行の順に9個
+ *
+ * @return 0
+ */
+int odometryFilter::getCovariance(float *c)
+{
+	for(int i = 0; i < 3; i ++){
+		for(int j = 0; j < 3; j ++) c[i * 3 + j] = cov[i][j];
+	}
+
+	return 0;
+}
+
+/*!
+ * @brief ジャイロの角度のずれとその変化率
+ *
+ * @param[out] offset ジャイロの角度 - 姿勢(rad)
+ * @param[out] drift  ずれの変化率(rad/s)
+ *
+ * @return 0
+ */
+int odometryFilter::getGyroOffset(float *offset, float *drift)
+{
+	*offset = state[3], *drift = state[4];
+
+	return 0;
+}
+
+/*!
+ * @brief ジャイロの角度を使っているか
+ *
+ * @return 1:使用中，0:未使用
+ */
+int odometryFilter::isGyroUsed()
+{
+	return is_gyro;
+}
@@ -0,0 +1,51 @@
+﻿#pragma once
+
+class odometryFilter
+{
+public:
+	odometryFilter();									// コンストラクタ
+	virtual ~odometryFilter();							// デストラクタ
+
+	static const int N = 5;								//! 状態の数 (x, y, the, ジャイロの角度のずれ, ずれの変化率)
+
+private:
+	static const float DIST_NOISE;						//! 移動距離の分散(m^2/m)
+	static const float TURN_NOISE;						//! 回転角度の分散(rad^2/rad)
+	static const float SLIP_NOISE;						//! 移動による回転角度の分散(rad^2/m)
+	static const float GYRO_NOISE;						//! ジャイロの角度の分散(rad^2)
+	static const float RATE_NOISE;						//! ジャイロの角速度から求めた回転角度の分散(rad^2/s)
+	static const float OFFSET_NOISE;					//! ジャイロの角度のずれの変化の分散(rad^2/s)
+	static const float DRIFT_NOISE;						//! ずれの変化率の変化の分散((rad/s)^2/s)
+	static const float INIT_DRIFT;						//! ずれの変化率の初期の分散((rad/s)^2)
+	static const float GATE;							//! ジャイロの角度を外れ値とするマハラノビス距離の２乗
+	static const int REINIT_COUNT = 5;					//! 連続して外れ値になった場合にずれを初期化する回数
+
+	float state[N];										//! 状態 (x(m), y(m), the(rad), offset(rad), drift(rad/s))
+	float cov[N][N];									//! 状態の共分散
+	int is_gyro;										//! ジャイロの角度を使い始めたか（1:使用中）
+	int reject_count;									//! 連続して外れ値になった回数
+	float gyro_rate;									//! 次の予測で使うジャイロの角速度(rad/s)
+	int is_gyro_rate;									//! gyro_rateが有効か（予測で使うと無効にする）
+
+	static float normalize(float angle);				// 角度を-PI～PIにする
+
+public:
+	int resetPosition();								// 位置の不確かさを0にする（その位置を原点として使う場合）
+	int predict(float ds, float dthe, float dt);		// ホイールの移動量とジャイロの角速度で予測
+	int setGyroRate(float rate);						// 次の予測で使うジャイロの角速度
+	int correctHeading(float z, float lag);				// ジャイロの角度で補正
+	int initHeading(float z, float lag);				// ジャイロの角度のずれを初期化
+	int getPose(float *x, float *y, float *the);		// 位置(m)，姿勢(rad)
+	int getCovariance(float *c);						// 位置と姿勢の共分散(3x3)
+	int getGyroOffset(float *offset, float *drift);		// ジャイロの角度のずれ(rad)とその変化率(rad/s)
+	int isGyroUsed();									// ジャイロの角度を使っているか
+};
+
+/*
+ * 使い方
+ * 1) 制御の周期毎に predict(移動距離, 回転角度, 周期) を呼び出す（円弧で積分する）
+ *    ジャイロの角速度をsetGyroRateで設定すると，回転角度はホイールと角速度を分散で重み付けて使う
+ * 2) ジャイロの角度を受け取ったら correctHeading(角度, 計測から今までの回転角度) で補正する
+ *    最初の角度は initHeading で使う．ジャイロの角度は 姿勢 + ずれ として，ずれとその変化率を推定する
+ * 3) getPose, getCovariance で推定した位置と共分散を取得する
+ */
@@ -0,0 +1,160 @@
+﻿/*!
+ * @file  periodicScheduler.cpp
+ * @brief 絶対時刻の期限で周期的な処理を行う
+ *
+ * Sleepで周期を待つと，処理の時間とSleepの遅れが周期に加わる．
+ * ここではパフォーマンスカウンタで期限を開始からの周期の倍数で決め，期限の直前まではWaitで，最後は短いSleepで待つ．
+ * 周期と期限からの遅れはヒストグラムに記録して定期的にログに出力する．
+ */
+
+#include "stdafx.h"
+#include "periodicScheduler.h"
+#include "logger.h"
+
+/*!
+ * @class periodicScheduler
+ * @brief 周期的な処理の期限を管理するクラス
+ */
+
+/*!
+ * @brief コンストラクタ
+ */
+periodicScheduler::periodicScheduler():
+freq(1), period_count(1), deadline(0), last_start(0), period(0),
+cycles(0), overruns(0), max_jitter(0), sum_jitter(0)
+{
+	for(int i = 0; i < HIST_NUM + 2; i ++) hist[i] = 0;
+}
+
+/*!
+ * @brief デストラクタ
+ */
+periodicScheduler::~periodicScheduler()
+{
+}
+
+/*!
+ * @brief 現在の時刻
+ *
+ * @return パフォーマンスカウンタの値(count)
+ */
+LONGLONG periodicScheduler::now()
+{
+	LARGE_INTEGER count;
+	QueryPerformanceCounter(&count);
+
+	return count.QuadPart;
+}
+
+/*!
+ * @brief 周期を設定して開始
+ *
+ * @param[in] period_ms 周期(ms)
+ *
+ * @return 0
+ */
+int periodicScheduler::start(int period_ms)
+{
+	LARGE_INTEGER f;
+	QueryPerformanceFrequency(&f);
+	freq = f.QuadPart;
+	period_count = freq * period_ms / 1000;
+	period = period_ms / 1000.0f;
+	last_start = now();
+	deadline = last_start + period_count;
+
+	return 0;
+}
+
+/*!
+ * @brief 次の周期の期限まで待つ
+ * 期限のSPIN_TIME前まではイベントを待ち，その後はSleep(0)で期限まで待つ．
+ * 期限になったら周期を統計に加えて次の期限を設定する．
+ * １周期以上遅れた場合は過ぎた期限を飛ばす（遅れを取り戻すために連続で処理しない）．
+ *
+ * @param[in] event 期限の前に起こすイベント（NULLの場合は期限まで待つ）
+ *
+ * @return 1:イベントがセットされた，0:期限になった
+ */
+int periodicScheduler::wait(HANDLE event)
+{
+	LONGLONG t;
+	while((t = now()) < deadline){
+		long wait_ms = (long)((deadline - t) * 1000 / freq) - SPIN_TIME;
+		if (wait_ms > 0){
+			if (event == NULL) Sleep(wait_ms);
+			else if (WaitForSingleObject(event, wait_ms) == WAIT_OBJECT_0) return 1;
+		} else {
+			Sleep(0);
+		}
+	}
+
+	record(t);
+	if (t - deadline >= period_count){
+		overruns ++;
+		deadline += ((t - deadline) / period_count) * period_count;
+	}
+	deadline += period_count;
+
+	return 0;
+}
+
+/*!
+ * @brief 周期と遅れを統計に加える
+ *
+ * @param[in] start 周期を開始した時刻(count)
+ *
+ * @return 0
+ */
+int periodicScheduler::record(LONGLONG start)
+{
+	LONGLONG actual = start - last_start;
+	period = (float)actual / freq;
+	last_start = start;
+
+	float jitter = (float)(start - deadline) * 1000.0f / freq;		// 期限からの遅れ(ms)
+	if (jitter > max_jitter) max_jitter = jitter;
+	sum_jitter += jitter;
+
+	int us = (int)((actual - period_count) * 1000000 / freq);		// 周期の誤差(us)
+	int bin = (us < -HIST_NUM / 2 * HIST_BIN) ? 0 : min((us + HIST_NUM / 2 * HIST_BIN) / HIST_BIN + 1, HIST_NUM + 1);
+	hist[bin] ++;
+
+	if (++ cycles >= LOG_CYCLES) logStatistics();
+
+	return 0;
+}
+
+/*!
+ * @brief 統計をログに出力して消去する
+ *
+ * @return 0
+ */
+int periodicScheduler::logStatistics()
+{
+	LOG("scheduler:period %d us, cycles %d, overruns %d, jitter mean %f ms, max %f ms\n",
+		(int)(period_count * 1000000 / freq), cycles, overruns, sum_jitter / cycles, max_jitter);
+	LOG("scheduler_hist(%d us bins from -%d us):", HIST_BIN, HIST_NUM / 2 * HIST_BIN);
+	for(int i = 0; i < HIST_NUM + 2; i ++){
+		LOG_WITHOUT_TIME(" %d", hist[i]);
+		hist[i] = 0;
+	}
+	LOG_WITHOUT_TIME("\n");
+
+	cycles = 0;
+	overruns = 0;
+	max_jitter = 0;
+	sum_jitter = 0;
+
+	return 0;
+}
+
+/*!
+ * @brief 前の周期から実際に経過した時間
+ *
+ * @return 時間(s)
+ */
+float periodicScheduler::getPeriod()
+{
+	return period;
+}
@@ -0,0 +1,45 @@
+﻿#pragma once
+#include <windows.h>
+
+class periodicScheduler
+{
+public:
+	periodicScheduler();								// コンストラクタ
+	virtual ~periodicScheduler();						// デストラクタ
+
+private:
+	static const int SPIN_TIME = 1;						//! 期限の前にWaitをやめて待つ時間(ms)
+	static const int HIST_NUM = 20;						//! 周期のヒストグラムのビンの数
+	static const int HIST_BIN = 250;					//! ヒストグラムのビンの幅(us) 周期±HIST_NUM/2*HIST_BIN
+	static const int LOG_CYCLES = 3000;					//! 統計をログに出力する周期の回数
+
+	LONGLONG freq;										//! パフォーマンスカウンタの周波数(count/s)
+	LONGLONG period_count;								//! 周期(count)
+	LONGLONG deadline;									//! 次の周期の開始の期限(count)
+	LONGLONG last_start;								//! 前の周期を開始した時刻(count)
+	float period;										//! 前の周期から実際に経過した時間(s)
+
+	int hist[HIST_NUM + 2];								//! 周期のヒストグラム（最初と最後は範囲外）
+	int cycles;											//! 統計を取った周期の回数
+	int overruns;										//! 期限を１周期以上過ぎた回数
+	float max_jitter;									//! 期限からの遅れの最大値(ms)
+	double sum_jitter;									//! 期限からの遅れの和(ms)
+
+	LONGLONG now();										// 現在の時刻(count)
+	int record(LONGLONG start);							// 周期と遅れを統計に加える
+	int logStatistics();								// 統計をログに出力して消去する
+
+public:
+	int start(int period_ms);							// 周期を設定して開始
+	int wait(HANDLE event);								// 次の周期の期限まで待つ
+	float getPeriod();									// 前の周期から実際に経過した時間(s)
+};
+
+/*
+ * 使い方
+ * 1) start(周期(ms))で開始
+ * 2) 周期的な処理の後に wait(イベント) を呼び出す
+ *    イベントがセットされたら1を返すので，処理して再びwaitを呼び出す．期限になったら0を返す
+ *    期限は開始からの周期の倍数で決まり，処理の時間やWaitの遅れで周期がずれない
+ * 3) getPeriod()で実際の周期(s)を取得して制御に使う
+ */
@@ -0,0 +1,183 @@
+﻿/*!
+ * @file  poseHistory.cpp
+ * @brief 時刻付きのオドメトリの履歴
+ *
+ * 制御のスレッドだけが書き込むリングバッファ（timedRing）で，読み出しはロックを使わない．
+ * 履歴の間は一定の曲率で動いたとして補間する（SE(2)の補間）．
+ */
+
+#include "stdafx.h"
+#include "poseHistory.h"
+#include <math.h>
+
+#define	M_PI	3.14159f
+
+/*!
+ * @class poseHistory
+ * @brief 時刻を指定して位置を求めるためのオドメトリの履歴のクラス
+ */
+
+/*!
+ * @brief コンストラクタ
+ */
+poseHistory::poseHistory()
+{
+}
+
+/*!
+ * @brief デストラクタ
+ */
+poseHistory::~poseHistory()
+{
+}
+
+/*!
+ * @brief 履歴を追加
+ *
+ * @param[in] p 時刻付きの位置と速度
+ *
+ * @return 0
+ */
+int poseHistory::add(const pose_T &p)
+{
+	return ring.add(p);
+}
+
+/*!
+ * @brief 最新の履歴を取得
+ *
+ * @param[out] p 最新の履歴
+ *
+ * @return 0:成功，-1:履歴が無い
+ */
+int poseHistory::latest(pose_T *p)
+{
+	return ring.latest(p);
+}
+
+/*!
+ * @brief bの位置をaの座標系で求める
+ *
+ * @param[in]  a,b  位置
+ * @param[out] dx,dy,dthe aの座標系のbの位置(m)，姿勢(rad)
+ *
+ * @return 0
+ */
+int poseHistory::relative(const pose_T &a, const pose_T &b, float *dx, float *dy, float *dthe)
+{
+	float c = cos(a.the), s = sin(a.the);
+	float x = b.x - a.x, y = b.y - a.y;
+
+	*dx   =  c * x + s * y;
+	*dy   = -s * x + c * y;
+	*dthe = b.the - a.the;
+	if (*dthe >  M_PI) *dthe -= 2.0f*M_PI;
+	if (*dthe < -M_PI) *dthe += 2.0f*M_PI;
+
+	return 0;
+}
+
+/*!
+ * @brief 一定の曲率の動きをr倍する
+ * 動き(dx,dy,dthe)を一定の速度と角速度で動いた結果とみなし，その時間をr倍した動きを求める（SE(2)のexp(r log)）．
+ *
+ * @param[in]  dx,dy,dthe 動き(m, rad)
+ * @param[in]  r          倍率
+ * @param[out] ox,oy,othe r倍した動き(m, rad)
+ *
+ * @return 0
+ */
+int poseHistory::scaleMotion(float dx, float dy, float dthe, float r, float *ox, float *oy, float *othe)
+{
+	if (fabs(dthe) < 1.0e-6f){
+		*ox = r * dx, *oy = r * dy, *othe = r * dthe;
+		return 0;
+	}
+
+	float a = sin(dthe) / dthe, b = (1.0f - cos(dthe)) / dthe;	// 並進の速度から動きへの変換 [[a,-b],[b,a]]
+	float d = a * a + b * b;
+	float ux = ( a * dx + b * dy) / d;					// 並進の速度×時間
+	float uy = (-b * dx + a * dy) / d;
+
+	float t = r * dthe;
+	float ra = 1.0f, rb = 0;								// r = 0 の場合は動き無し
+	if (fabs(t) >= 1.0e-6f) ra = sin(t) / t, rb = (1.0f - cos(t)) / t;
+	*ox = r * (ra * ux - rb * uy);
+	*oy = r * (rb * ux + ra * uy);
+	*othe = t;
+
+	return 0;
+}
+
+/*!
+ * @brief 指定した時刻の位置
+ * 時刻を挟む２つの履歴の間を一定の曲率の動きで補間する．
+ * 最新の履歴より新しい時刻はMAX_EXTRAPOLATIONまで最新の速度で外挿し，範囲外は端の値を戻す．
+ *
+ * @param[in]  time 時刻(ms) timeGetTime()の値
+ * @param[out] x,y  位置(m)
+ * @param[out] the  姿勢(rad) -PI～PI
+ *
+ * @return 0:範囲内，1:範囲外のため端の値，-1:履歴が無い
+ */
+int poseHistory::poseAt(unsigned long time, float *x, float *y, float *the)
+{
+	pose_T a, b;
+	int res = ring.find(time, &a, &b);
+	if (res < 0) return -1;
+	if (res == ring.NEWER){								// 最新の履歴より新しい場合は外挿
+		long dt = (long)(time - b.time);
+		float sec = min(dt, (long)MAX_EXTRAPOLATION) / 1000.0f;
+		float othe = b.w * sec, ds = b.v * sec;			// 一定の速度と角速度の円弧
+		float ox = (fabs(othe) < 1.0e-6f) ? ds : ds * sin(othe) / othe;
+		float oy = (fabs(othe) < 1.0e-6f) ? 0  : ds * (1.0f - cos(othe)) / othe;
+		float c = cos(b.the), s = sin(b.the);
+		*x   = b.x + c * ox - s * oy;
+		*y   = b.y + s * ox + c * oy;
+		*the = b.the + othe;
+		if (*the >  M_PI) *the -= 2.0f*M_PI;
+		if (*the < -M_PI) *the += 2.0f*M_PI;
+		return (dt > MAX_EXTRAPOLATION) ? 1 : 0;
+	}
+	if (res == ring.OLDER){								// 範囲外は端の値
+		*x = a.x, *y = a.y, *the = a.the;
+		return 1;
+	}
+
+	float dx, dy, dthe, ox, oy, othe;
+	float r = (b.time != a.time) ? (float)(long)(time - a.time) / (float)(long)(b.time - a.time) : 1.0f;
+	relative(a, b, &dx, &dy, &dthe);
+	scaleMotion(dx, dy, dthe, r, &ox, &oy, &othe);
+	float c = cos(a.the), s = sin(a.the);
+	*x   = a.x + c * ox - s * oy;
+	*y   = a.y + s * ox + c * oy;
+	*the = a.the + othe;
+	if (*the >  M_PI) *the -= 2.0f*M_PI;
+	if (*the < -M_PI) *the += 2.0f*M_PI;
+
+	return 0;
+}
+
+/*!
+ * @brief t1の位置をt0の座標系で求める
+ *
+ * @param[in]  t0,t1 時刻(ms) timeGetTime()の値
+ * @param[out] dx,dy t0の座標系のt1の位置(m)
+ * @param[out] dthe  t0からt1への回転(rad) -PI～PI
+ *
+ * @return 0:範囲内，1:どちらかが範囲外，-1:履歴が無い
+ */
+int poseHistory::delta(unsigned long t0, unsigned long t1, float *dx, float *dy, float *dthe)
+{
+	pose_T p0, p1;
+
+	int r0 = poseAt(t0, &p0.x, &p0.y, &p0.the);
+	int r1 = poseAt(t1, &p1.x, &p1.y, &p1.the);
+	if ((r0 < 0)||(r1 < 0)){
+		*dx = *dy = *dthe = 0;
+		return -1;
+	}
+	relative(p0, p1, dx, dy, dthe);
+
+	return max(r0, r1);
+}
@@ -0,0 +1,45 @@
+﻿#pragma once
+#include "timedRing.h"
+
+class poseHistory
+{
+public:
+	poseHistory();										// コンストラクタ
+	virtual ~poseHistory();								// デストラクタ
+
+	static const int MAX_SAMPLE = 128;					//! 履歴の最大個数（20ms周期で約2.5秒分）
+
+	/*!
+	 * @struct pose_T
+	 * @brief 時刻付きの位置と速度
+	 */
+	struct pose_T{
+		unsigned long time;								//!< 時刻(ms) timeGetTime()の値
+		float x, y, the;								//!< 位置(m)，姿勢(rad)
+		float v, w;										//!< 前後の速度(m/s)，回転の速度(rad/s)
+	};
+
+private:
+	static const int MAX_EXTRAPOLATION = 40;			//! 最新の履歴より新しい時刻を速度で外挿する最大の時間(ms)
+
+	timedRing<pose_T, MAX_SAMPLE> ring;					//! 履歴のリングバッファ（ロック無しで読む）
+
+	static int relative(const pose_T &a, const pose_T &b, float *dx, float *dy, float *dthe);
+														// bの位置をaの座標系で求める
+	static int scaleMotion(float dx, float dy, float dthe, float r, float *ox, float *oy, float *othe);
+														// 一定の曲率の動きをr倍する
+
+public:
+	int add(const pose_T &p);							// 履歴を追加（書き込むスレッドは１つだけ）
+	int latest(pose_T *p);								// 最新の履歴を取得
+	int poseAt(unsigned long time, float *x, float *y, float *the);	// 指定した時刻の位置
+	int delta(unsigned long t0, unsigned long t1, float *dx, float *dy, float *dthe);
+														// t1の位置をt0の座標系で求める
+};
+
+/*
+ * 使い方
+ * 1) 制御のスレッドが周期毎に add(時刻, 位置, 速度) を呼び出す
+ * 2) 他のスレッドはロック無しで poseAt(時刻) や delta(t0, t1) を呼び出す
+ *    読んでいる間に書き込まれた履歴は読み直し，上書きされた古い履歴は範囲外とする
+ */
@@ -0,0 +1,184 @@
+﻿/*!
+ * @file  reroutePlanner.cpp
+ * @brief 障害物で経路を塞がれたときの回避経路の選択
+ *
+ * 次のwaypointへの経路を基準に，横の移動量と追い越す区間の長さの組を候補として一度に評価する．
+ * 候補の経路は 横へ移動 → 経路と平行に追い越し → 経路に戻る の３区間で，
+ * 障害物からの最小距離（クリアランス）と元の経路に対する余分な道のりで順位を付ける．
+ */
+
+#include "stdafx.h"
+#include "reroutePlanner.h"
+#include <math.h>
+#include "logger.h"
+
+/*!
+ * @class reroutePlanner
+ * @brief 複数の回避経路を評価して最も良い経路を選ぶクラス
+ */
+
+/*!
+ * @brief コンストラクタ
+ * 候補の横の移動量と追い越す区間の長さを設定する．
+ */
+reroutePlanner::reroutePlanner():
+cmap(NULL)
+{
+	int k = 0;
+	for(int i = 0; i < OFFSET_NUM; i ++){
+		float offset = (float)OFFSET_STEP * (i + 2);
+		for(int side = -1; side <= 1; side += 2){
+			for(int j = 0; j < LENGTH_NUM; j ++){
+				cand_offset[k] = side * offset;
+				cand_length[k] = (float)(LENGTH_MIN + LENGTH_STEP * j);
+				k ++;
+			}
+		}
+	}
+}
+
+/*!
+ * @brief デストラクタ
+ */
+reroutePlanner::~reroutePlanner()
+{
+}
+
+/*!
+ * @brief 障害物からの距離のグリッドを設定
+ *
+ * @param[in] cmap 障害物からの距離のグリッド
+ *
+ * @return 0
+ */
+int reroutePlanner::setCostmap(costmap *cmap)
+{
+	this->cmap = cmap;
+
+	return 0;
+}
+
+/*!
+ * @brief 候補の経路の点を求める
+ * 現在の位置から目標への方向を前とした座標系で経路を作り，ロボット座標系に変換する．
+ * 経路に戻る点が目標より先になる場合は目標に戻る．
+ * 追い越す区間が目標を越える候補は，目標を通り過ぎてから戻ることになるため使わない．
+ * 経路に戻る点は最も遠くてもAPPROACH_LENGTH*2+LENGTH_MIN+LENGTH_STEP*(LENGTH_NUM-1)=3.6mで，
+ * costmapの範囲（ロボットから±5m）に収まり，経路の長さは最大で約5.2mとなる（navi::rerouteProcessの時間切れはこれを基準にする）．
+ *
+ * @param[in]  k     候補の番号
+ * @param[in]  tx,ty 目標の位置(mm) ロボット座標系
+ * @param[out] px,py 経路の点(mm) ロボット座標系 PATH_NUM個
+ *
+ * @return 経路に戻る点の元の経路に沿った距離(mm)，-1:追い越す区間が目標を越える
+ */
+int reroutePlanner::getPath(int k, float tx, float ty, float *px, float *py)
+{
+	float len = sqrt(tx * tx + ty * ty);
+	float c = (len > 0) ? tx / len : 1.0f, s = (len > 0) ? ty / len : 0.0f;
+	float ax[PATH_NUM], ay[PATH_NUM];
+
+	ax[0] = (float)APPROACH_LENGTH;
+	ay[0] = cand_offset[k];
+	ax[1] = APPROACH_LENGTH + cand_length[k];
+	ay[1] = cand_offset[k];
+	if (ax[1] >= len) return -1;
+	ax[2] = min(ax[1] + APPROACH_LENGTH, len);
+	ay[2] = 0;
+	for(int i = 0; i < PATH_NUM; i ++){
+		px[i] = c * ax[i] - s * ay[i];
+		py[i] = s * ax[i] + c * ay[i];
+	}
+
+	return (int)ax[2];
+}
+
+/*!
+ * @brief 区間の障害物からの最小距離を調べる
+ * SAMPLE_STEP毎に距離のグリッドを１回参照する．
+ * 現在より障害物に近づいてロボットの半径より近くなったら衝突とする（停止した位置から離れる方向は許可）．
+ *
+ * @param[in]  x0,y0     区間の始点(mm) ロボット座標系
+ * @param[in]  x1,y1     区間の終点(mm) ロボット座標系
+ * @param[in]  start     現在の位置の障害物からの距離(mm)
+ * @param[out] clearance 区間の障害物からの最小距離で更新(mm)
+ *
+ * @return 区間の長さ(mm) 衝突する場合は負
+ */
+float reroutePlanner::checkSegment(float x0, float y0, float x1, float y1, float start, float *clearance)
+{
+	float dx = x1 - x0, dy = y1 - y0;
+	float len = sqrt(dx * dx + dy * dy);
+	int n = (int)(len / SAMPLE_STEP) + 1;
+
+	for(int i = 1; i <= n; i ++){
+		float t = (float)i / n;
+		float d = cmap->getDistance(x0 + t * dx, y0 + t * dy);
+		if ((d < costmap::ROBOT_RADIUS)&&(d < start)) return -1.0f;
+		if (d < *clearance) *clearance = d;
+	}
+
+	return len;
+}
+
+/*!
+ * @brief 障害物を回避して経路に戻る経路を求める
+ * 全ての候補の衝突とクリアランスと余分な道のりを求め，重み付き和の小さい候補を選ぶ．
+ *
+ * @param[in]  tx,ty 次のwaypointの位置(m) ロボット座標系
+ * @param[out] px,py 経路の点(m) ロボット座標系 PATH_NUM個
+ *
+ * @return 0:成功，-1:衝突しない候補が無い
+ */
+int reroutePlanner::plan(float tx, float ty, float *px, float *py)
+{
+	static const float DETOUR_WEIGHT = 1.0f;		// 余分な道のりの重み(1/m)
+	static const float CLEARANCE_WEIGHT = 1.0f;		// クリアランスの重み
+
+	if (cmap == NULL) return -1;
+	tx *= 1000.0f, ty *= 1000.0f;
+	const float start = cmap->getDistance(0, 0);
+
+	int valid = 0;
+	for(int k = 0; k < CANDIDATE_NUM; k ++){
+		float x[PATH_NUM], y[PATH_NUM];
+		float straight = (float)getPath(k, tx, ty, x, y);
+		if (straight < 0){
+			cand_clearance[k] = cand_detour[k] = 0;
+			cand_cost[k] = -1.0f;
+			continue;
+		}
+		float clearance = 1.0e6f, length = 0, x0 = 0, y0 = 0;
+		for(int i = 0; (i < PATH_NUM)&&(length >= 0); i ++){
+			float l = checkSegment(x0, y0, x[i], y[i], start, &clearance);
+			length = (l < 0) ? -1.0f : length + l;
+			x0 = x[i], y0 = y[i];
+		}
+		cand_clearance[k] = clearance;
+		cand_detour[k] = length - straight;
+		if (length < 0){
+			cand_cost[k] = -1.0f;
+			continue;
+		}
+		float clear = min(max((clearance - costmap::ROBOT_RADIUS) / CLEARANCE_MAX, 0.0f), 1.0f);
+		cand_cost[k] = DETOUR_WEIGHT * cand_detour[k] / 1000.0f + CLEARANCE_WEIGHT * (1.0f - clear);
+		valid ++;
+	}
+
+	int best = -1;
+	for(int k = 0; k < CANDIDATE_NUM; k ++){
+		if ((cand_cost[k] >= 0)&&((best < 0)||(cand_cost[k] < cand_cost[best]))) best = k;
+	}
+	LOG("reroute_plan:valid %d/%d, best %d\n", valid, CANDIDATE_NUM, best);
+	if (best < 0) return -1;
+
+	getPath(best, tx, ty, px, py);
+	for(int i = 0; i < PATH_NUM; i ++){
+		px[i] /= 1000.0f;
+		py[i] /= 1000.0f;
+	}
+	LOG("reroute_path:offset %f, length %f, clearance %f, detour %f\n",
+		cand_offset[best], cand_length[best], cand_clearance[best], cand_detour[best]);
+
+	return 0;
+}
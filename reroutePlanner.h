@@ -0,0 +1,44 @@
+﻿#pragma once
+#include "costmap.h"
+
+class reroutePlanner
+{
+public:
+	reroutePlanner();									// コンストラクタ
+	virtual ~reroutePlanner();							// デストラクタ
+
+	static const int PATH_NUM = 3;						//! 経路の点の数（横へ移動，追い越し，経路に戻る）
+
+private:
+	static const int APPROACH_LENGTH = 700;				//! 横へ移動する区間と戻る区間の前後方向の長さ(mm)
+	static const int OFFSET_STEP = 150;					//! 横の移動量の間隔(mm)
+	static const int OFFSET_NUM = 10;					//! 片側の横の移動量の数（OFFSET_STEP*2～*(OFFSET_NUM+1)）
+	static const int LENGTH_MIN = 600;					//! 追い越す区間の最短の長さ(mm)
+	static const int LENGTH_STEP = 400;					//! 追い越す区間の長さの間隔(mm)
+	static const int LENGTH_NUM = 5;					//! 追い越す区間の長さの数
+	static const int CANDIDATE_NUM = OFFSET_NUM * 2 * LENGTH_NUM;	//! 候補の数
+	static const int SAMPLE_STEP = 100;					//! 経路の衝突を調べる間隔(mm)
+	static const int CLEARANCE_MAX = 1000;				//! 評価するクリアランスの最大値（これ以上は同じ評価）(mm)
+
+	costmap *cmap;										//! 障害物からの距離のグリッド（障害物回避と共有）
+	float cand_offset[CANDIDATE_NUM];					//! 候補の横の移動量(mm) 左が正
+	float cand_length[CANDIDATE_NUM];					//! 候補の追い越す区間の長さ(mm)
+	float cand_clearance[CANDIDATE_NUM];				//! 候補の経路上の障害物からの最小距離(mm)
+	float cand_detour[CANDIDATE_NUM];					//! 候補の元の経路に対する余分な道のり(mm)
+	float cand_cost[CANDIDATE_NUM];						//! 候補の評価（小さい方が良い，負の場合は不可）
+
+	int getPath(int k, float tx, float ty, float *px, float *py);	// 候補の経路の点を求める
+	float checkSegment(float x0, float y0, float x1, float y1, float start, float *clearance);
+														// 区間の障害物からの最小距離を調べる
+
+public:
+	int setCostmap(costmap *cmap);						// 障害物からの距離のグリッドを設定
+	int plan(float tx, float ty, float *px, float *py);	// 障害物を回避して経路に戻る経路を求める
+};
+
+/*
+ * 使い方
+ * 1) setCostmap(obstacleAvoidance::getCostmap())で障害物からの距離のグリッドを設定
+ * 2) リルートする時にplan(次のwaypointのx, y(m, ロボット座標系), px, py)を呼び出す
+ *    px, pyにPATH_NUM個の経路の点(m, ロボット座標系)が入るので，navi::setReroutePathに渡す
+ */
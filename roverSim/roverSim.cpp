@@ -0,0 +1,159 @@
+﻿/*!
+ * @file  roverSim.cpp
+ * @brief 速度制御をボードのシミュレーションで動かすツール
+ *
+ * megaRoverの制御スレッドと同じ順序（読み込み → 移動量 → PI制御 → 変化量の制限 → 書き込み）で，
+ * speedControllerをsimRoverに対して周期毎に動かし，目標速度への追従をテキストで出力する．
+ * 時間はsimRoverのreadで進めるので，何度実行しても同じ結果になる（速度制御の変更の比較に使う）．
+ *
+ * 使い方: roverSim [-v] [-p 周期(ms)] [-d 変化量]
+ *   -v 周期毎の目標速度，速度，トルクを出力する
+ *   -p 制御の周期(ms)（省略時は20）
+ *   -d １周期のトルクの変化量の上限（省略時はnavigationDlgと同じ20，0は制限無し）
+ * Windowsの関数を使わないので，VisualStudioでもgccでも単体でビルドできる
+ * （g++ roverSim.cpp ../simRover.cpp ../speedController.cpp）．
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../simRover.h"
+#include "../speedController.h"
+#include "../memoryMap.h"
+
+static const float MAX_SPEED = 0.625f;				//! megaRover::MAX_SPEED (MEGA_ROVER_1_1)
+static const float TREAD = 0.280f;					//! megaRover::TREAD(m)
+static const int SERVO_GAIN = 100;					//! navigationDlgと同じサーボのゲイン
+
+/*!
+ * @struct phase_T
+ * @brief 目標速度を一定にする区間
+ */
+struct phase_T{
+	const char *name;								//!< 区間の名前
+	float front, rotate;							//!< 前後の速度(m/s)，角速度(rad/s)
+	float duration;									//!< 区間の長さ(s)
+};
+
+static const phase_T PHASES[] = {
+	{"forward", 0.3f,  0.0f, 3.0f},
+	{"arc",     0.3f,  0.5f, 3.0f},
+	{"spin",    0.0f, -1.0f, 2.0f},
+	{"stop",    0.0f,  0.0f, 2.0f},
+};
+
+/*!
+ * @brief 大きい方の値（VisualStudio 2008にはfmaxが無い）
+ *
+ * @param[in] a,b 値
+ *
+ * @return 大きい方の値
+ */
+static double larger(double a, double b)
+{
+	return (a > b) ? a : b;
+}
+
+/*!
+ * @brief 前後の速度と角速度から左右のホイールの目標速度を求める（megaRover::setSpeedと同じ）
+ *
+ * @param[in]  front,rotate 前後の速度(m/s)，角速度(rad/s)
+ * @param[out] right,left   左右のホイールの目標速度(m/s)
+ *
+ * @return 0
+ */
+static int toWheelSpeed(float front, float rotate, float *right, float *left)
+{
+	*right = front + rotate * TREAD / 2.0f;
+	*left  = front - rotate * TREAD / 2.0f;
+	float max_speed = (float)larger(fabs(*right), fabs(*left));
+	if (max_speed > MAX_SPEED){
+		*right *= MAX_SPEED / max_speed;
+		*left  *= MAX_SPEED / max_speed;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int verbose = 0, period_ms = 20, delta = 20;
+	for(int i = 1; i < argc; i ++){
+		if      (!strcmp(argv[i], "-v")) verbose = 1;
+		else if (!strcmp(argv[i], "-p") && (i + 1 < argc)) period_ms = atoi(argv[++ i]);
+		else if (!strcmp(argv[i], "-d") && (i + 1 < argc)) delta = atoi(argv[++ i]);
+		else {
+			fprintf(stderr, "usage: roverSim [-v] [-p period_ms] [-d delta]\n");
+			return 1;
+		}
+	}
+	if (period_ms <= 0) period_ms = 20;
+
+	simRover sim(period_ms);
+	speedController controller(MAX_SPEED);
+	sim.connect();
+	sim.setByte(Flag, 0x02);						// megaRover::init()と同じ初期化
+	sim.write();
+	sim.setWord(EncoderA, 0);
+	sim.setWord(EncoderB, 0);
+	sim.write();
+	sim.setByte(CpuMode, 1);						// megaRover::servoOn()
+	sim.setByte(MotorGainCh1, SERVO_GAIN);
+	sim.setByte(MotorGainCh2, SERVO_GAIN);
+	sim.write();
+
+	const float period = sim.getSimulatedPeriod();
+	double odo_right = 0, odo_left = 0;
+	double time = 0;
+	if (verbose) printf("time,ref_right,ref_left,speed_right,speed_left,torque_right,torque_left\n");
+	for(size_t k = 0; k < sizeof(PHASES) / sizeof(PHASES[0]); k ++){
+		const phase_T *ph = &PHASES[k];
+		float ref_right, ref_left;
+		toWheelSpeed(ph->front, ph->rotate, &ref_right, &ref_left);
+		int steps = (int)(ph->duration / period + 0.5f);
+		int settle = -1;							// 目標速度の誤差が10%以内になった周期
+		double err_sum = 0;
+		int err_num = 0;
+		for(int i = 0; i < steps; i ++){
+			sim.read(PowerVoltage, EncoderB + 2 - PowerVoltage);
+			float right, left;
+			controller.getWheelDistance((unsigned short)sim.getWord(EncoderA), (unsigned short)sim.getWord(EncoderB), &right, &left);
+			odo_right += right, odo_left += left;
+			int torque_right = 0, torque_left = 0;
+			if (!controller.control(right, left, period, ref_right, ref_left, &torque_right, &torque_left)){
+				torque_right = torque_left = 0;
+			}
+			const int limit = speedController::TORQUE_LIMIT;		// megaRover::setMotor()と同じ制限
+			torque_right = (torque_right > limit) ? limit : ((torque_right < -limit) ? -limit : torque_right);
+			torque_left  = (torque_left  > limit) ? limit : ((torque_left  < -limit) ? -limit : torque_left );
+			controller.rampTorque(&torque_right, &torque_left, delta, delta);
+			sim.setWord(MotorSpeedCh1, (short)torque_right);
+			sim.setWord(MotorSpeedCh2, (short)torque_left);
+			sim.write();
+			time += period;
+
+			float speed_right = right / period, speed_left = left / period;
+			float err = (float)larger(fabs(speed_right - ref_right), fabs(speed_left - ref_left));
+			float tolerance = 0.1f * (float)larger(larger(fabs(ref_right), fabs(ref_left)), 0.05);
+			if (err > tolerance) settle = -1;
+			else if (settle < 0) settle = i;
+			if (i >= steps - (int)(1.0f / period)){	// 最後の1秒の平均の誤差
+				err_sum += err;
+				err_num ++;
+			}
+			if (verbose){
+				printf("%.3f,%.3f,%.3f,%.4f,%.4f,%d,%d\n", time, ref_right, ref_left, speed_right, speed_left, torque_right, torque_left);
+			}
+		}
+		printf("%-8s ref %+.3f %+.3f m/s, settle %s%.2f s, mean error (last 1s) %.4f m/s\n",
+			ph->name, ref_right, ref_left, (settle < 0) ? "> " : "", (settle < 0) ? ph->duration : settle * period,
+			(err_num > 0) ? err_sum / err_num : 0.0);
+	}
+
+	double true_right, true_left;
+	sim.getWheelDistance(&true_right, &true_left);
+	printf("distance right %.4f m (odometry %.4f), left %.4f m (odometry %.4f)\n", true_right, odo_right, true_left, odo_left);
+
+	return 0;
+}
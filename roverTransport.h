@@ -0,0 +1,24 @@
+﻿#pragma once
+
+/*!
+ * @class roverTransport
+ * @brief Mega Roverのボードのメモリマップを読み書きするインターフェース
+ *
+ * megaRoverはこのインターフェースだけでボードと通信する．
+ * 実機はwrcTransport（WRC003LVHIDのライブラリ），実機の無い環境ではsimRover（ボードのシミュレーション）を使う．
+ * アドレスはmemoryMap.hのmemmap_T，ワードはリトルエンディアン．
+ */
+class roverTransport
+{
+public:
+	virtual ~roverTransport(){}							// デストラクタ
+
+	virtual int connect() = 0;							// ボードに接続する（0:成功，-1:失敗）
+	virtual int disconnect() = 0;						// ボードとの接続を切る
+	virtual int read(int address, int size) = 0;		// ボードのメモリマップを読み込む
+	virtual int write() = 0;							// 設定した値をボードに書き込む
+	virtual int setByte(int address, unsigned char value) = 0;	// 書き込む値（バイト）を設定
+	virtual int setWord(int address, short value) = 0;	// 書き込む値（ワード）を設定
+	virtual short getWord(int address) = 0;			// 読み込んだ値（ワード）を取得
+	virtual float getSimulatedPeriod(){ return 0; }		// readで進めた時間(s) 実時間で動く場合は0
+};
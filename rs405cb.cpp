@@ -218,6 +218,24 @@ short RSStartGetAngle( HANDLE hComm )
  * @return 0以上:サーボの現在角度(0.1度=1),0未満:エラー
  */
 short RSGetAngle( HANDLE hComm )
+{
+	short angle = 0;
+	int ret = RSGetAngleReply( hComm, &angle );
+
+	return (ret < 0) ? ret : angle;
+}
+
+/*!
+ * @brief サーボの現在角度を取得する（エラーと角度を区別する）
+ * 角度は負の値も取り得るため，戻り値と角度を分けている．
+ * 取得を開始する関数RSStartGetAngle(hComm)を予め実行して，間をおいてから呼び出す．
+ *
+ * @param[in]  hComm 通信ポートのハンドル
+ * @param[out] pAngle サーボの現在角度(0.1度=1)
+ *
+ * @return 1:取得成功,0:未受信,0未満:エラー
+ */
+int RSGetAngleReply( HANDLE hComm, short *pAngle )
 {
 	const int MAX_LEN = 128;
 	unsigned char	sum;
@@ -235,6 +253,7 @@ short RSGetAngle( HANDLE hComm )
 	DWORD Error;
 	ClearCommError(hComm,&Error,&Comstat);
 	if(!Comstat.cbInQue) return 0;					// 受信していない場合
+	if (Comstat.cbInQue < 27) return 0;				// 返信パケットが揃っていない場合
 	if (Comstat.cbInQue > MAX_LEN) readlen = MAX_LEN;
 	else readlen = Comstat.cbInQue;						// 受信できる最大文字数を超えている場合は，max_lenだけ受信
 
@@ -258,7 +277,8 @@ short RSGetAngle( HANDLE hComm )
 	}
 
 	angle = ((readbuf[8] << 8) & 0x0000FF00) | (readbuf[7] & 0x000000FF);
-	return angle;
+	*pAngle = angle;
+	return 1;
 }
 
 /*!
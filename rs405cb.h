@@ -8,5 +8,6 @@ int RSMove( HANDLE hComm, short sPos, unsigned short sTime );
 												// サーボの出力角を指定
 short RSStartGetAngle( HANDLE hComm );			// サーボの現在角度の取得を開始する
 short RSGetAngle( HANDLE hComm );				// サーボの現在角度を取得する
+int RSGetAngleReply( HANDLE hComm, short *pAngle );	// サーボの現在角度を取得する（1:取得成功,0:未受信,0未満:エラー）
 int RSTorqueOnOff( HANDLE hComm, short sMode );	// サーボのトルクをON/OFFする
 int RSMaxTorque( HANDLE hComm, int maxTorque );	// サーボのトルクを設定する
@@ -0,0 +1,112 @@
+﻿/*!
+ * @file  safetyMonitor.cpp
+ * @brief URGのスキャン毎に停止領域を調べて前進を止める
+ *
+ * 障害物回避はOnTimer(100ms)で行うため，スキャン，タイマ，制御の周期の遅れが重なる．
+ * ここではURGの受信スレッドでスキャン毎に停止領域を調べ，ロボットの速度の上限を直接設定する．
+ */
+
+#include "stdafx.h"
+#include "safetyMonitor.h"
+#include "estimateGround.h"
+#include "logger.h"
+#include <mmsystem.h>
+
+/*!
+ * @class safetyMonitor
+ * @brief スキャン毎に停止領域を調べて速度の上限を設定するクラス
+ */
+
+/*!
+ * @brief コンストラクタ
+ */
+safetyMonitor::safetyMonitor():
+rover(NULL), is_stop(0), clear_time(0)
+{
+}
+
+/*!
+ * @brief デストラクタ
+ */
+safetyMonitor::~safetyMonitor()
+{
+}
+
+/*!
+ * @brief 速度の上限を設定するロボットを設定
+ *
+ * @param[in] rover ロボットのクラスのポインタ（NULLの場合は何もしない）
+ *
+ * @return 0
+ */
+int safetyMonitor::setRover(megaRover *rover)
+{
+	this->rover = rover;
+
+	return 0;
+}
+
+/*!
+ * @brief 現在の速度から停止領域の長さを求める
+ * ロボットの半径 + 停止距離 v^2/(2a) + STOP_MARGIN
+ *
+ * @return 停止領域の長さ(mm) ロボットの中心から
+ */
+int safetyMonitor::getStopLength()
+{
+	float right, left, max_speed, max_acc;
+	rover->getSpeed(&right, &left);
+	rover->getLimit(&max_speed, &max_acc);
+	float v = max((right + left) / 2.0f, 0.0f);
+
+	return HALF_WIDTH + (int)(v * v / (2.0f * max_acc) * 1000.0f) + STOP_MARGIN;
+}
+
+/*!
+ * @brief スキャン毎に停止領域を調べる
+ * 前方の停止領域に障害物(LABEL_OBSTACLE)の点がMIN_POINTS以上あれば前進の速度の上限を0にする．
+ * チルトで計測する高さが変わるため，RELEASE_PERIODの間検出しなかったら解除する．
+ *
+ * @param[in] x,y       点の位置(mm) ロボット座標系
+ * @param[in] label     点の分類(estimateGround::LABEL_*)
+ * @param[in] n         点の数
+ * @param[in] scan_time スキャンの最後のビームの時刻(ms) 停止までの遅れの基準
+ *
+ * @return 1:停止を要求している，0:要求していない
+ */
+int safetyMonitor::check(const float *x, const float *y, const unsigned char *label, int n, unsigned long scan_time)
+{
+	if (rover == NULL) return 0;
+
+	const float length = (float)getStopLength();
+	int count = 0;
+	for(int i = 0; i < n; i ++){
+		if (label[i] != estimateGround::LABEL_OBSTACLE) continue;
+		if ((x[i] > 0)&&(x[i] < length)&&(y[i] > -HALF_WIDTH)&&(y[i] < HALF_WIDTH)) count ++;
+	}
+
+	if (count >= MIN_POINTS){
+		clear_time = scan_time;
+		if (!is_stop){
+			rover->setSpeedCap(0.0f, scan_time);
+			is_stop = 1;
+			LOG("safety_stop:points %d, length %f\n", count, length);
+		}
+	} else if (is_stop && ((long)(scan_time - clear_time) > RELEASE_PERIOD)){
+		rover->setSpeedCap(-1.0f, scan_time);
+		is_stop = 0;
+		LOG("safety_release\n");
+	}
+
+	return is_stop;
+}
+
+/*!
+ * @brief 停止を要求しているか
+ *
+ * @return 1:停止を要求している，0:要求していない
+ */
+int safetyMonitor::isStop()
+{
+	return is_stop;
+}
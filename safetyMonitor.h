@@ -0,0 +1,33 @@
+﻿#pragma once
+#include "megaRover.h"
+
+class safetyMonitor
+{
+public:
+	safetyMonitor();									// コンストラクタ
+	virtual ~safetyMonitor();							// デストラクタ
+
+private:
+	static const int HALF_WIDTH = 350;					//! 停止領域の幅の半分(mm) ロボットの半径
+	static const int STOP_MARGIN = 300;					//! 停止距離に加える余裕(mm)
+	static const int MIN_POINTS = 3;					//! 障害物とみなす１スキャンの最小の点数
+	static const int RELEASE_PERIOD = 1200;				//! 障害物が無くなってから停止を解除するまでの時間(ms) チルトの１掃引より長くする
+
+	megaRover *rover;									//! 速度の上限を設定するロボット
+	int is_stop;										//! 停止を要求しているか
+	unsigned long clear_time;							//! 最後に障害物を検出した時刻(ms)
+	int getStopLength();								// 現在の速度から停止領域の長さを求める
+
+public:
+	int setRover(megaRover *rover);						// 速度の上限を設定するロボットを設定
+	int check(const float *x, const float *y, const unsigned char *label, int n, unsigned long scan_time);
+														// スキャン毎に停止領域を調べる
+	int isStop();										// 停止を要求しているか
+};
+
+/*
+ * 使い方
+ * URGのスレッドでスキャンを受信する毎に，ロボット座標系の点(mm)と分類(estimateGround::LABEL_*)でcheckを呼び出す．
+ * 停止領域に障害物があればmegaRover::setSpeedCap(0)で前進を止め，RELEASE_PERIODだけ無ければ解除する．
+ * OnTimerを経由しないため，停止までの遅れはスキャンの受信からモータへの書き込みまでになる．
+ */
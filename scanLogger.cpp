@@ -0,0 +1,103 @@
+﻿#include "StdAfx.h"
+#include "scanLogger.h"
+
+/*!
+ * @class scanLogger
+ * @brief URGのスキャンとパーティクルをバイナリで保存するクラス
+ * 点毎にテキストで書き込むとセンサのスレッドの負荷が大きいため，１スキャンを１レコードで書き込む．
+ */
+
+FILE* scanLogger::fp = NULL;
+
+/*!
+ * @brief 初期化
+ *
+ * @param[in] filename	ファイル名
+ */
+void scanLogger::Init(CString filename)
+{
+	if (NULL == (fp = fopen(filename,"wb"))){
+		AfxMessageBox("Cannot Open Scan Log file");
+		exit(1);
+	}
+	setvbuf(fp, NULL, _IOFBF, BUFFER_SIZE);					// 大きなバッファにまとめて書き込む
+	fwrite("SCANLOG1", 1, 8, fp);
+}
+
+/*!
+ * @brief 1スキャン分のデータの書き込み
+ *
+ * @param[in] time       最後のビームの時刻(ms)
+ * @param[in] tilt_first 最初のビームのチルト角度(deg)
+ * @param[in] tilt_last  最後のビームのチルト角度(deg)
+ * @param[in] x          オドメトリのx座標(m)
+ * @param[in] y          オドメトリのy座標(m)
+ * @param[in] the        オドメトリの角度(rad)
+ * @param[in] length     距離データ(mm)
+ * @param[in] intensity  反射強度
+ * @param[in] num        データの個数(641以下)
+ */
+void scanLogger::WriteScan(unsigned long time, float tilt_first, float tilt_last,
+	float x, float y, float the, const int *length, const int *intensity, int num)
+{
+	static struct scan_log_scan_T rec;
+	const int max_no = sizeof(rec.length) / sizeof(rec.length[0]);
+
+	if (fp == NULL) return;
+	num = min(num, max_no);
+	rec.header.type = SCAN_LOG_SCAN;
+	rec.header.size = sizeof(rec);
+	rec.header.time = time;
+	rec.tilt_first = tilt_first, rec.tilt_last = tilt_last;
+	rec.x = x, rec.y = y, rec.the = the;
+	for(int i = 0; i < max_no; i ++){
+		rec.length[i]    = (i < num) ? (unsigned short)min(max(length[i]   , 0), 65535) : 0;
+		rec.intensity[i] = (i < num) ? (unsigned short)min(max(intensity[i], 0), 65535) : 0;
+	}
+	fwrite(&rec, sizeof(rec), 1, fp);
+}
+
+/*!
+ * @brief パーティクルの書き込み
+ *
+ * @param[in] time     時刻(ms)
+ * @param[in] particle パーティクルのデータ
+ * @param[in] num      パーティクルの個数
+ */
+void scanLogger::WriteParticle(unsigned long time, const struct particle_T *particle, int num)
+{
+	static const int MAX_PARTICLE = 1000;
+	static struct {
+		struct scan_log_particle_T head;
+		struct particle_T particle[MAX_PARTICLE];
+	} rec;
+
+	if (fp == NULL) return;
+	num = min(max(num, 0), MAX_PARTICLE);
+	rec.head.header.type = SCAN_LOG_PARTICLE;
+	rec.head.header.size = (unsigned short)(sizeof(rec.head) + sizeof(struct particle_T) * num);
+	rec.head.header.time = time;
+	rec.head.num = num;
+	memcpy(rec.particle, particle, sizeof(struct particle_T) * num);
+	fwrite(&rec, rec.head.header.size, 1, fp);
+}
+
+/*!
+ * @brief ファイルが開いているか
+ * 書き込むデータの準備を省略するために使用する．
+ *
+ * @return 1:開いている，0:開いていない
+ */
+int scanLogger::isOpen()
+{
+	return (fp != NULL) ? 1 : 0;
+}
+
+/*!
+ * @brief 終了処理
+ */
+void scanLogger::Close()
+{
+	if (fp != NULL) fclose(fp);
+	fp = NULL;
+}
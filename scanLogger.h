@@ -0,0 +1,60 @@
+﻿#pragma once
+#include "dataType.h"
+
+/*!
+ * @struct scan_log_header_T
+ * @brief バイナリログのレコードのヘッダ
+ */
+struct scan_log_header_T{
+	unsigned short type;							//!< レコードの種類(SCAN_LOG_SCAN, SCAN_LOG_PARTICLE)
+	unsigned short size;							//!< ヘッダを含むレコードのサイズ(byte)
+	unsigned long time;								//!< 時刻(ms) timeGetTime()の値
+};
+
+/*!
+ * @struct scan_log_scan_T
+ * @brief 1スキャン分のレコード
+ */
+struct scan_log_scan_T{
+	struct scan_log_header_T header;				//!< ヘッダ（時刻は最後のビームの時刻）
+	float tilt_first;								//!< 最初のビームのチルト角度(deg)
+	float tilt_last;								//!< 最後のビームのチルト角度(deg)
+	float x, y, the;								//!< 最後のビームの時刻のオドメトリ(m, rad)
+	unsigned short length[641];						//!< 距離データ(mm)
+	unsigned short intensity[641];					//!< 反射強度（65535で飽和）
+};
+
+/*!
+ * @struct scan_log_particle_T
+ * @brief パーティクルのレコード（particle_Tの配列が続く）
+ */
+struct scan_log_particle_T{
+	struct scan_log_header_T header;				//!< ヘッダ
+	unsigned long num;								//!< パーティクルの個数
+};
+
+class scanLogger
+{
+public:
+	static void Init(CString filename);						// 初期化
+	static void WriteScan(unsigned long time, float tilt_first, float tilt_last,
+		float x, float y, float the, const int *length, const int *intensity, int num);
+															// 1スキャン分のデータの書き込み
+	static void WriteParticle(unsigned long time, const struct particle_T *particle, int num);
+															// パーティクルの書き込み
+	static void Close();									// 終了処理
+	static int isOpen();									// ファイルが開いているか
+
+	static const unsigned short SCAN_LOG_SCAN     = 1;		//! スキャンのレコード
+	static const unsigned short SCAN_LOG_PARTICLE = 2;		//! パーティクルのレコード
+protected:
+	static FILE* fp;										//! ファイルポインタ
+	static const int BUFFER_SIZE = 1024 * 1024;				//! 書き込みバッファのサイズ(byte)
+};
+
+/*
+ * ファイルの形式
+ * 先頭に"SCANLOG1"(8byte)，その後にレコードが続く．
+ * 各レコードはscan_log_header_Tで始まり，typeとsizeで種類と長さがわかる．
+ * １レコードを１回のfwriteで書き込むため，複数のスレッドから書き込んでもレコードは混ざらない．
+ */
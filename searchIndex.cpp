@@ -0,0 +1,263 @@
+﻿/*!
+ * @file  searchIndex.cpp
+ * @brief 探索点の空間インデックス
+ *
+ * 探索点を一定の大きさのセルのハッシュに登録し，範囲内の探索点だけを調べる．
+ * トラックの番号でも引けるようにし，毎回作り直さずに移動したトラックだけを付け替える．
+ */
+
+#include "stdafx.h"
+#include "searchIndex.h"
+#include <math.h>
+
+/*!
+ * @class searchIndex
+ * @brief 探索点の位置で近傍を求めるクラス
+ */
+
+/*!
+ * @brief コンストラクタ
+ */
+searchIndex::searchIndex()
+{
+	clear();
+}
+
+/*!
+ * @brief デストラクタ
+ */
+searchIndex::~searchIndex()
+{
+}
+
+/*!
+ * @brief 全ての探索点を削除
+ *
+ * @return 0
+ */
+int searchIndex::clear()
+{
+	int i;
+	for(i = 0; i < CELL_HASH_SIZE; i ++) cell_head[i] = -1;
+	for(i = 0; i < ID_HASH_SIZE; i ++) id_head[i] = -1;
+	for(i = 0; i < MAX_ENTRY; i ++) entry[i].cell_next = i + 1;
+	entry[MAX_ENTRY - 1].cell_next = -1;
+	free_head = 0;
+	entry_num = 0;
+	generation = 0;
+
+	return 0;
+}
+
+/*!
+ * @brief セルのハッシュ
+ *
+ * @param[in] cx,cy セルの番号
+ *
+ * @return ハッシュの値(0～CELL_HASH_SIZE-1)
+ */
+unsigned int searchIndex::hashCell(int cx, int cy)
+{
+	return ((unsigned int)cx * 73856093u ^ (unsigned int)cy * 19349663u) & (CELL_HASH_SIZE - 1);
+}
+
+/*!
+ * @brief 番号の探索点を探す
+ *
+ * @param[in] id 探索点の番号
+ *
+ * @return 探索点の位置（-1:無し）
+ */
+int searchIndex::find(int id)
+{
+	for(int k = id_head[id & (ID_HASH_SIZE - 1)]; k >= 0; k = entry[k].id_next){
+		if (entry[k].id == id) return k;
+	}
+
+	return -1;
+}
+
+/*!
+ * @brief 探索点をセルのハッシュに登録
+ *
+ * @param[in] k 探索点の位置
+ *
+ * @return 0
+ */
+int searchIndex::link(int k)
+{
+	unsigned int h = hashCell(entry[k].cx, entry[k].cy);
+	entry[k].cell_next = cell_head[h];
+	cell_head[h] = k;
+
+	return 0;
+}
+
+/*!
+ * @brief 探索点をセルのハッシュから外す
+ *
+ * @param[in] k 探索点の位置
+ *
+ * @return 0
+ */
+int searchIndex::unlink(int k)
+{
+	int *prev = &cell_head[hashCell(entry[k].cx, entry[k].cy)];
+	while(*prev != k) prev = &entry[*prev].cell_next;
+	*prev = entry[k].cell_next;
+
+	return 0;
+}
+
+/*!
+ * @brief 探索点を削除
+ *
+ * @param[in] k 探索点の位置
+ *
+ * @return 0
+ */
+int searchIndex::remove(int k)
+{
+	unlink(k);
+	int *prev = &id_head[entry[k].id & (ID_HASH_SIZE - 1)];
+	while(*prev != k) prev = &entry[*prev].id_next;
+	*prev = entry[k].id_next;
+
+	entry[k].cell_next = free_head;
+	free_head = k;
+	entry_num --;
+
+	return 0;
+}
+
+/*!
+ * @brief 更新を開始
+ *
+ * @return 0
+ */
+int searchIndex::beginUpdate()
+{
+	generation ++;
+
+	return 0;
+}
+
+/*!
+ * @brief 探索点を追加・移動
+ * 番号が登録されていなければ追加し，セルが変わった場合だけハッシュを付け替える．
+ *
+ * @param[in] id 探索点の番号
+ * @param[in] p  探索点の位置(mm)と確からしさ
+ *
+ * @return 0:成功，-1:登録できる数を超えた
+ */
+int searchIndex::update(int id, const pos_slate &p)
+{
+	int cx = (int)floor((float)p.pos.x / CELL_SIZE), cy = (int)floor((float)p.pos.y / CELL_SIZE);
+	int k = find(id);
+
+	if (k < 0){
+		if (free_head < 0) return -1;
+		k = free_head;
+		free_head = entry[k].cell_next;
+		entry[k].id = id;
+		entry[k].id_next = id_head[id & (ID_HASH_SIZE - 1)];
+		id_head[id & (ID_HASH_SIZE - 1)] = k;
+		entry[k].cx = cx, entry[k].cy = cy;
+		link(k);
+		entry_num ++;
+	} else if ((entry[k].cx != cx)||(entry[k].cy != cy)){
+		unlink(k);
+		entry[k].cx = cx, entry[k].cy = cy;
+		link(k);
+	}
+	entry[k].point = p;
+	entry[k].generation = generation;
+
+	return 0;
+}
+
+/*!
+ * @brief 更新しなかった探索点を削除
+ *
+ * @return 削除した数
+ */
+int searchIndex::endUpdate()
+{
+	int n = 0;
+	for(int i = 0; i < ID_HASH_SIZE; i ++){
+		int k = id_head[i];
+		while(k >= 0){
+			int next = entry[k].id_next;
+			if (entry[k].generation != generation){
+				remove(k);
+				n ++;
+			}
+			k = next;
+		}
+	}
+
+	return n;
+}
+
+/*!
+ * @brief 近い順に範囲内の探索点を取得
+ * 中心のセルから一周ずつ外側のセルを調べ，max_num個見つかり，
+ * max_num番目の距離が次の周までの距離より近くなったら打ち切る．
+ *
+ * @param[in]  center   中心の位置(mm)
+ * @param[in]  radius   半径(mm)
+ * @param[out] p        探索点（近い順）
+ * @param[out] distance 中心からの距離(mm)（NULLの場合は取得しない）
+ * @param[in]  max_num  取得する最大数
+ *
+ * @return 取得した数
+ */
+int searchIndex::query(pos center, float radius, pos_slate *p, float *distance, int max_num)
+{
+	static float dist[MAX_ENTRY];
+	if (max_num <= 0) return 0;
+	max_num = min(max_num, MAX_ENTRY);
+
+	int ccx = (int)floor((float)center.x / CELL_SIZE), ccy = (int)floor((float)center.y / CELL_SIZE);
+	int ring_max = (int)(radius / CELL_SIZE) + 1;
+	int n = 0;
+
+	for(int r = 0; r <= ring_max; r ++){
+		for(int cx = ccx - r; cx <= ccx + r; cx ++){
+			for(int cy = ccy - r; cy <= ccy + r; cy += ((abs(cx - ccx) == r) ? 1 : 2 * r)){	// 周のセルだけ
+				for(int k = cell_head[hashCell(cx, cy)]; k >= 0; k = entry[k].cell_next){
+					if ((entry[k].cx != cx)||(entry[k].cy != cy)) continue;	// ハッシュが衝突した別のセル
+					float dx = (float)(entry[k].point.pos.x - center.x), dy = (float)(entry[k].point.pos.y - center.y);
+					float d = sqrt(dx * dx + dy * dy);
+					if ((d > radius)||((n == max_num)&&(d >= dist[n - 1]))) continue;
+					int i = (n < max_num) ? n ++ : n - 1;			// 挿入ソート
+					for(; (i > 0)&&(dist[i - 1] > d); i --){
+						dist[i] = dist[i - 1];
+						p[i] = p[i - 1];
+					}
+					dist[i] = d;
+					p[i] = entry[k].point;
+				}
+				if (r == 0) break;
+			}
+		}
+		if ((n == max_num)&&(dist[n - 1] <= (float)r * CELL_SIZE)) break;	// 次の周の点は全て遠い
+	}
+
+	if (distance){
+		for(int i = 0; i < n; i ++) distance[i] = dist[i];
+	}
+
+	return n;
+}
+
+/*!
+ * @brief 登録した探索点の数
+ *
+ * @return 探索点の数
+ */
+int searchIndex::getNum()
+{
+	return entry_num;
+}
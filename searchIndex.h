@@ -0,0 +1,57 @@
+﻿#pragma once
+#include "dataType.h"
+
+class searchIndex
+{
+public:
+	searchIndex();										// コンストラクタ
+	virtual ~searchIndex();								// デストラクタ
+
+	static const int MAX_ENTRY = 256;					//! 登録できる探索点の最大数
+
+private:
+	static const int CELL_SIZE = 2000;					//! セルの大きさ(mm)
+	static const int CELL_HASH_SIZE = 512;				//! セルのハッシュの大きさ（2のべき乗）
+	static const int ID_HASH_SIZE = 256;				//! 番号のハッシュの大きさ（2のべき乗）
+
+	/*!
+	 * @struct entry_T
+	 * @brief 登録した探索点
+	 */
+	struct entry_T{
+		int id;											//!< 探索点の番号（トラックの番号）
+		pos_slate point;								//!< 位置(mm)と確からしさ
+		int cx, cy;										//!< セルの番号
+		int generation;									//!< 最後に更新した世代
+		int cell_next;									//!< 同じセルのハッシュの次の探索点（-1:無し，未使用の場合は空きの次）
+		int id_next;									//!< 同じ番号のハッシュの次の探索点（-1:無し）
+	} entry[MAX_ENTRY];
+	int cell_head[CELL_HASH_SIZE];						//! セルのハッシュ毎の最初の探索点（-1:無し）
+	int id_head[ID_HASH_SIZE];							//! 番号のハッシュ毎の最初の探索点（-1:無し）
+	int free_head;										//! 空きの最初（-1:無し）
+	int entry_num;										//! 登録した探索点の数
+	int generation;										//! 更新の世代
+
+	static unsigned int hashCell(int cx, int cy);		// セルのハッシュ
+	int find(int id);									// 番号の探索点を探す
+	int link(int k);									// 探索点をセルのハッシュに登録
+	int unlink(int k);									// 探索点をセルのハッシュから外す
+	int remove(int k);									// 探索点を削除
+
+public:
+	int clear();										// 全ての探索点を削除
+	int beginUpdate();									// 更新を開始
+	int update(int id, const pos_slate &p);				// 探索点を追加・移動
+	int endUpdate();									// 更新しなかった探索点を削除
+	int query(pos center, float radius, pos_slate *p, float *distance, int max_num);
+														// 近い順に範囲内の探索点を取得
+	int getNum();										// 登録した探索点の数
+};
+
+/*
+ * 使い方
+ * 1) 探索点が変わる毎に beginUpdate() → 全ての探索点を update(番号, 位置) → endUpdate()
+ *    位置が同じセルの間はハッシュを付け替えない．番号が無くなった探索点は endUpdate() で削除される
+ * 2) query(中心, 半径(mm), p, distance, max_num)で半径内の探索点を近い順にmax_num個まで取得
+ *    中心のセルから外側のセルへ順に調べ，max_num個見つかった時点で外側を打ち切る
+ */
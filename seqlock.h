@@ -0,0 +1,37 @@
+﻿#pragma once
+#include <windows.h>
+
+/*!
+ * @class seqlock
+ * @brief 書き込むスレッドが１つの値を他のスレッドがロック無しで読むための書き込みの回数
+ *
+ * 書き込む前後で回数を増やし（奇数の間は書き込み中），読む前後で回数が変わっていたら読み直す．
+ */
+class seqlock
+{
+	volatile LONG seq;							//! 書き込みの回数（奇数の間は書き込み中）
+
+public:
+	seqlock(): seq(0) {}						// コンストラクタ
+
+	//! 書き込みを開始（回数を奇数にする）
+	void beginWrite() { InterlockedIncrement(&seq); }
+	//! 書き込みを終了（回数を偶数にする）
+	void endWrite() { InterlockedIncrement(&seq); }
+	//! 現在の書き込みの回数（待たない）
+	LONG current() const { return InterlockedCompareExchange((volatile LONG*)&seq, 0, 0); }
+	//! 書き込み中でなくなるまで待って読み始める
+	LONG beginRead() const {
+		LONG s;
+		while((s = current()) & 1) Sleep(0);
+		return s;
+	}
+	//! beginReadから書き込まれたので読み直すか（1:読み直す）
+	int retry(LONG s) const { return (current() != s) ? 1 : 0; }
+};
+
+/*
+ * 使い方
+ * 書き込み : lock.beginWrite(); 値を書き込む; lock.endWrite();
+ * 読み出し : LONG s; do { s = lock.beginRead(); 値をコピー; } while(lock.retry(s));
+ */
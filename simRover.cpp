@@ -0,0 +1,278 @@
+﻿/*!
+ * @file  simRover.cpp
+ * @brief Mega Roverのボードのシミュレーション
+ *
+ * memoryMap.hのレジスタの配置でボードを模擬する．
+ * MotorSpeedCh1,2の値でホイールの速度を１次遅れで変化させ，エンコーダA,Bを16bitで一周させながら数える．
+ * Windowsの関数を使わないので，プリコンパイルヘッダ無しでLinuxでもビルドできる．
+ */
+
+#include "simRover.h"
+#include "memoryMap.h"
+#include <string.h>
+#include <math.h>
+
+/*!
+ * @class simRover
+ * @brief Mega Roverのボードを模擬するクラス
+ */
+
+const float simRover::MAX_SPEED = 0.625f;
+const float simRover::TIME_CONSTANT = 0.1f;
+const float simRover::COUNT_PER_METER = 13 * 71.2f * 4 / (0.150f * 3.14159f);	// MEGA_ROVER_1_1
+const float simRover::POWER_VOLTAGE = 12.0f;
+
+/*!
+ * @brief コンストラクタ
+ *
+ * @param[in] period_ms read１回で進める時間(ms) 制御の周期
+ */
+simRover::simRover(int period_ms):
+period(period_ms / 1000.0f), speed_right(0), speed_left(0), count_a(0), count_b(0),
+distance_right(0), distance_left(0), connected(0)
+{
+	memset(host, 0, sizeof(host));
+	memset(board, 0, sizeof(board));
+	memset(dirty, 0, sizeof(dirty));
+}
+
+/*!
+ * @brief デストラクタ
+ */
+simRover::~simRover()
+{
+}
+
+/*!
+ * @brief ボードのワードを取得
+ *
+ * @param[in] address アドレス
+ *
+ * @return 値（符号付き）
+ */
+int simRover::getBoardWord(int address)
+{
+	return (short)(board[address] | (board[address + 1] << 8));
+}
+
+/*!
+ * @brief ボードのワードを設定
+ *
+ * @param[in] address アドレス
+ * @param[in] value   値（下位16bitを設定）
+ *
+ * @return 0
+ */
+int simRover::setBoardWord(int address, int value)
+{
+	board[address]     = (unsigned char)(value & 0xff);
+	board[address + 1] = (unsigned char)((value >> 8) & 0xff);
+
+	return 0;
+}
+
+/*!
+ * @brief ボードに接続する
+ * ボードを電源を入れた状態に戻す．
+ *
+ * @return 0
+ */
+int simRover::connect()
+{
+	memset(board, 0, sizeof(board));
+	memset(dirty, 0, sizeof(dirty));
+	speed_right = speed_left = 0;
+	count_a = count_b = 0;
+	distance_right = distance_left = 0;
+	setBoardWord(PowerVoltage, (int)(POWER_VOLTAGE * 1024.0f / 6.6f));
+	memcpy(host, board, sizeof(host));
+	connected = 1;
+
+	return 0;
+}
+
+/*!
+ * @brief ボードとの接続を切る
+ *
+ * @return 0
+ */
+int simRover::disconnect()
+{
+	connected = 0;
+
+	return 0;
+}
+
+/*!
+ * @brief ボードのメモリマップを読み込む
+ * 時間をperiodだけ進めてから，範囲のボードの値をPC側にコピーする（書き込み前の値は残す）．
+ *
+ * @param[in] address 先頭のアドレス
+ * @param[in] size    バイト数
+ *
+ * @return 0:成功，-1:未接続か範囲外
+ */
+int simRover::read(int address, int size)
+{
+	if ((!connected)||(address < 0)||(address + size > MEM_SIZE)) return -1;
+
+	step(period);
+	for(int i = address; i < address + size; i ++){
+		if (!dirty[i]) host[i] = board[i];
+	}
+
+	return 0;
+}
+
+/*!
+ * @brief 設定した値をボードに書き込む
+ * エンコーダに書き込んだ場合はカウントをその値にする．
+ *
+ * @return 0:成功，-1:未接続
+ */
+int simRover::write()
+{
+	if (!connected) return -1;
+
+	for(int i = 0; i < MEM_SIZE; i ++){
+		if (dirty[i]) board[i] = host[i];
+	}
+	if (dirty[EncoderA] || dirty[EncoderA + 1]) count_a = (unsigned short)getBoardWord(EncoderA);
+	if (dirty[EncoderB] || dirty[EncoderB + 1]) count_b = (unsigned short)getBoardWord(EncoderB);
+	memset(dirty, 0, sizeof(dirty));
+
+	return 0;
+}
+
+/*!
+ * @brief 書き込む値（バイト）を設定
+ *
+ * @param[in] address アドレス
+ * @param[in] value   値
+ *
+ * @return 0:成功，-1:範囲外
+ */
+int simRover::setByte(int address, unsigned char value)
+{
+	if ((address < 0)||(address >= MEM_SIZE)) return -1;
+	host[address] = value;
+	dirty[address] = 1;
+
+	return 0;
+}
+
+/*!
+ * @brief 書き込む値（ワード）を設定
+ *
+ * @param[in] address アドレス
+ * @param[in] value   値
+ *
+ * @return 0:成功，-1:範囲外
+ */
+int simRover::setWord(int address, short value)
+{
+	if ((address < 0)||(address + 1 >= MEM_SIZE)) return -1;
+	setByte(address    , (unsigned char)(value & 0xff));
+	setByte(address + 1, (unsigned char)((value >> 8) & 0xff));
+
+	return 0;
+}
+
+/*!
+ * @brief 読み込んだ値（ワード）を取得
+ *
+ * @param[in] address アドレス
+ *
+ * @return 値
+ */
+short simRover::getWord(int address)
+{
+	if ((address < 0)||(address + 1 >= MEM_SIZE)) return 0;
+
+	return (short)(host[address] | (host[address + 1] << 8));
+}
+
+/*!
+ * @brief readで進めた時間
+ * 実時間ではなくこの時間を制御の周期として使えば，同じ指令には同じ結果になる．
+ *
+ * @return read１回で進める時間(s)
+ */
+float simRover::getSimulatedPeriod()
+{
+	return period;
+}
+
+/*!
+ * @brief ボードとホイールの時間を進める
+ * モータの電源がONでゲインが0より大きい場合，トルクに比例した速度に１次遅れで近づける（ブレーキ0x8000と電源OFFは速度0）．
+ * 左のホイールは負のトルクとエンコーダの減少が前進．
+ *
+ * @param[in] dt 進める時間(s)
+ *
+ * @return 0
+ */
+int simRover::step(float dt)
+{
+	if (dt <= 0) return 0;
+
+	int right = getBoardWord(MotorSpeedCh1), left = getBoardWord(MotorSpeedCh2);
+	if (right == -0x8000) right = 0;
+	if (left  == -0x8000) left  = 0;
+	double target_right = 0, target_left = 0;
+	if (board[CpuMode] == 1){
+		if (board[MotorGainCh1] > 0) target_right =  right / 1000.0 * MAX_SPEED;
+		if (board[MotorGainCh2] > 0) target_left  = -left  / 1000.0 * MAX_SPEED;
+	}
+
+	double k = 1.0 - exp(-dt / TIME_CONSTANT);
+	speed_right += (target_right - speed_right) * k;
+	speed_left  += (target_left  - speed_left ) * k;
+	distance_right += speed_right * dt;
+	distance_left  += speed_left  * dt;
+
+	count_a += speed_right * dt * COUNT_PER_METER;
+	count_b -= speed_left  * dt * COUNT_PER_METER;
+	count_a = fmod(count_a, 65536.0);
+	count_b = fmod(count_b, 65536.0);
+	if (count_a < 0) count_a += 65536.0;
+	if (count_b < 0) count_b += 65536.0;
+	setBoardWord(EncoderA, (int)count_a);
+	setBoardWord(EncoderB, (int)count_b);
+
+	return 0;
+}
+
+/*!
+ * @brief 左右のホイールの移動距離（connectからの真の値）
+ *
+ * @param[out] right 右のホイールの移動距離(m)
+ * @param[out] left  左のホイールの移動距離(m)
+ *
+ * @return 0
+ */
+int simRover::getWheelDistance(double *right, double *left)
+{
+	*right = distance_right;
+	*left  = distance_left;
+
+	return 0;
+}
+
+/*!
+ * @brief ゲームパッドの状態を設定
+ *
+ * @param[in] button ボタン
+ * @param[in] ud     左のスティックの上下(-127～128)
+ * @param[in] lr     右のスティックの左右(-127～128)
+ *
+ * @return 0
+ */
+int simRover::setJoyStick(int button, int ud, int lr)
+{
+	setBoardWord(GamePadButton, button);
+	setBoardWord(GamePadLJoyUD, ud);
+	setBoardWord(GamePadRJoyLR, lr);
+
+	return 0;
+}
@@ -0,0 +1,53 @@
+﻿#pragma once
+#include "roverTransport.h"
+
+class simRover : public roverTransport
+{
+public:
+	simRover(int period_ms = 20);						// コンストラクタ
+	virtual ~simRover();								// デストラクタ
+
+	static const int MEM_SIZE = 128;					//! メモリマップの大きさ(byte)
+
+private:
+	static const float MAX_SPEED;						//! トルク1000の時のホイールの速度(m/s)
+	static const float TIME_CONSTANT;					//! ホイールの速度の時定数(s)
+	static const float COUNT_PER_METER;					//! 1mあたりのエンコーダのカウント
+	static const float POWER_VOLTAGE;					//! 電源電圧(V)
+
+	unsigned char host[MEM_SIZE];						//! PC側のメモリマップ（readで更新，writeで送信）
+	unsigned char board[MEM_SIZE];						//! ボードのメモリマップ
+	unsigned char dirty[MEM_SIZE];						//! writeを待っているバイト（1:有り）
+	float period;										//! read１回で進める時間(s)
+	double speed_right, speed_left;						//! 左右のホイールの前進の速度(m/s)
+	double count_a, count_b;							//! エンコーダのカウント（小数まで）
+	double distance_right, distance_left;				//! 左右のホイールの移動距離(m)
+	int connected;										//! 接続中（1:接続，0:切断）
+
+	int getBoardWord(int address);						// ボードのワードを取得
+	int setBoardWord(int address, int value);			// ボードのワードを設定
+
+public:
+	int connect();										// ボードに接続する
+	int disconnect();									// ボードとの接続を切る
+	int read(int address, int size);					// ボードのメモリマップを読み込む
+	int write();										// 設定した値をボードに書き込む
+	int setByte(int address, unsigned char value);		// 書き込む値（バイト）を設定
+	int setWord(int address, short value);				// 書き込む値（ワード）を設定
+	short getWord(int address);							// 読み込んだ値（ワード）を取得
+	float getSimulatedPeriod();							// readで進めた時間(s)
+
+	int step(float dt);									// ボードとホイールの時間を進める
+	int getWheelDistance(double *right, double *left);	// 左右のホイールの移動距離(m)
+	int setJoyStick(int button, int ud, int lr);		// ゲームパッドの状態を設定
+};
+
+/*
+ * 使い方
+ * 1) megaRover::setTransport(&sim)でmegaRover::init()の前に設定する
+ *    （ROVER_SIMULATIONを定義してビルドした場合はmegaRoverが最初からsimRoverを使う）
+ * 2) read()を呼ぶ毎にperiod_msだけ時間が進む（実時間を使わないので同じ指令には同じ結果を返す）
+ *    megaRoverはgetSimulatedPeriod()の時間を制御の周期として使う
+ * 3) getWheelDistance()でホイールの真の移動距離を取得して，オドメトリや速度制御の評価に使う
+ *    速度制御だけを試す場合はroverSim/roverSim.cppでspeedControllerと直接組み合わせる
+ */
@@ -0,0 +1,128 @@
+﻿/*!
+ * @file  speedController.cpp
+ * @brief ホイールの速度制御の計算
+ *
+ * megaRover::Update()の速度制御の部分を通信から分けたもの．
+ * Windowsの関数を使わないので，プリコンパイルヘッダ無しでLinuxでもビルドできる．
+ */
+
+#include "speedController.h"
+
+#define	M_PI	3.14159f
+
+/*!
+ * @class speedController
+ * @brief ホイールの速度制御の計算のクラス
+ */
+
+const float speedController::KP = 50000.0f;
+const float speedController::KI = 1000.0f;
+const float speedController::LEFT_COEF = 1.0f;
+
+/*!
+ * @brief コンストラクタ
+ *
+ * @param[in] max_speed トルクTORQUE_LIMITの時の速度(m/s)
+ */
+speedController::speedController(float max_speed):
+max_speed(max_speed), encoder_right0(0), encoder_left0(0), is_first(1),
+err_int_right(0), err_int_left(0), torque_right0(0), torque_left0(0)
+{
+}
+
+/*!
+ * @brief デストラクタ
+ */
+speedController::~speedController()
+{
+}
+
+/*!
+ * @brief エンコーダの値から前の周期からの移動量を求める
+ * 16bitで一周した差分は戻す．左は負が前進なので符号を反転する．
+ *
+ * @param[in]  right,left           エンコーダの値（下位16bit）
+ * @param[out] right_dist,left_dist 左右のホイールの移動量(m)
+ *
+ * @return 0
+ */
+int speedController::getWheelDistance(unsigned int right, unsigned int left, float *right_dist, float *left_dist)
+{
+	const int MAX_SHORT = 256 * 256;
+
+	int rd =    right - encoder_right0;
+	int ld = -(int)(left - encoder_left0);				// 左はマイナスが前進
+	encoder_right0 = right, encoder_left0 = left;
+	if (rd >= ( MAX_SHORT / 2)) rd -= MAX_SHORT;
+	if (rd <= (-MAX_SHORT / 2)) rd += MAX_SHORT;
+	if (ld >= ( MAX_SHORT / 2)) ld -= MAX_SHORT;
+	if (ld <= (-MAX_SHORT / 2)) ld += MAX_SHORT;
+#ifdef MEGA_ROVER_1_1
+	*right_dist = (float)rd / (13 * 71.2f * 4) * 150 * M_PI / 1000.0f;
+	*left_dist  = (float)ld / (13 * 71.2f * 4) * 150 * M_PI / 1000.0f * LEFT_COEF;
+#else
+	*right_dist = (float)rd / (48 * 104 * 4) * 150 * M_PI / 1000.0f;
+	*left_dist  = (float)ld / (48 * 104 * 4) * 150 * M_PI / 1000.0f * LEFT_COEF;
+#endif
+
+	return 0;
+}
+
+/*!
+ * @brief 移動量と目標速度からトルクを求める
+ * 目標速度に比例したトルクに速度の誤差のPI制御を加える．目標速度が0の場合はトルク0．
+ * 最初の周期は前の周期の移動量が無いので計算しない．
+ *
+ * @param[in]  right_dist,left_dist   この周期の左右のホイールの移動量(m)
+ * @param[in]  period                 周期(s)
+ * @param[in]  ref_right,ref_left     左右のホイールの目標速度(m/s)
+ * @param[out] right_torque,left_torque 左右のモータのトルク（左は負が前進）
+ *
+ * @return 1:トルクを求めた，0:最初の周期
+ */
+int speedController::control(float right_dist, float left_dist, float period, float ref_right, float ref_left,
+							 int *right_torque, int *left_torque)
+{
+	if (is_first){
+		is_first = 0;
+		return 0;
+	}
+
+	float err_right = ref_right - right_dist / period;
+	float err_left  = ref_left  - left_dist  / period;
+	err_int_right += err_right * period;
+	err_int_left  += err_left  * period;
+	if ((ref_right != 0.0f) || (ref_left != 0.0f)){
+		*right_torque = (int)(  KP * err_right + KI * err_int_right + ref_right / max_speed * TORQUE_LIMIT);
+		*left_torque  = (int)(- KP * err_left  - KI * err_int_left  - ref_left  / max_speed * TORQUE_LIMIT);
+	} else {
+		*right_torque = *left_torque = 0;
+	}
+
+	return 1;
+}
+
+/*!
+ * @brief １周期のトルクの変化量を制限する
+ * 急な加減速を防止するため，前の周期に書き込んだトルクからの変化を制限し，結果を次の周期の基準にする．
+ *
+ * @param[in,out] right,left             左右のモータのトルク
+ * @param[in]     delta_right,delta_left １周期の変化量の上限（0:制限無し）
+ *
+ * @return 0
+ */
+int speedController::rampTorque(int *right, int *left, int delta_right, int delta_left)
+{
+	if (delta_right != 0){
+		if (*right > torque_right0 + delta_right) *right = torque_right0 + delta_right;
+		if (*right < torque_right0 - delta_right) *right = torque_right0 - delta_right;
+	}
+	if (delta_left != 0){
+		if (*left > torque_left0 + delta_left) *left = torque_left0 + delta_left;
+		if (*left < torque_left0 - delta_left) *left = torque_left0 - delta_left;
+	}
+	torque_right0 = *right;
+	torque_left0  = *left;
+
+	return 0;
+}
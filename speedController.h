@@ -0,0 +1,45 @@
+﻿#pragma once
+
+#define MEGA_ROVER_1_1
+
+/*!
+ * @class speedController
+ * @brief ホイールの速度制御の計算（エンコーダの差分，PI制御，トルクの変化量の制限）
+ *
+ * megaRoverの制御スレッドが周期毎に呼び出す．通信や時刻を扱わないので，
+ * simRoverと組み合わせてLinuxでも同じ計算を試せる（roverSim/roverSim.cpp）．
+ */
+class speedController
+{
+public:
+	speedController(float max_speed);					// コンストラクタ
+	virtual ~speedController();							// デストラクタ
+
+	static const int TORQUE_LIMIT = 1000;					//! トルクの最大値
+
+private:
+	static const float KP, KI;							//! 比例，積分のゲイン
+	static const float LEFT_COEF;						//! 左のホイールの移動量の補正（要調整個体差あり）
+
+	const float max_speed;								//! トルクTORQUE_LIMITの時の速度(m/s)
+	unsigned int encoder_right0, encoder_left0;			//! 前の周期のエンコーダの値
+	int is_first;										//! 最初の制御の周期（1:最初）
+	float err_int_right, err_int_left;					//! 速度の誤差の積分(m)
+	int torque_right0, torque_left0;					//! 前の周期に書き込んだトルク
+
+public:
+	int getWheelDistance(unsigned int right, unsigned int left, float *right_dist, float *left_dist);
+														// エンコーダの値から前の周期からの移動量を求める
+	int control(float right_dist, float left_dist, float period, float ref_right, float ref_left,
+		int *right_torque, int *left_torque);			// 移動量と目標速度からトルクを求める
+	int rampTorque(int *right, int *left, int delta_right, int delta_left);
+														// １周期のトルクの変化量を制限する
+};
+
+/*
+ * 使い方
+ * 1) 制御の周期毎にエンコーダの値を読み，getWheelDistance(右, 左, &右の移動量, &左の移動量)を呼び出す
+ *    エンコーダは16bitで一周する（左は減少が前進）
+ * 2) 速度制御をする場合はcontrol(移動量, 周期(s), 目標速度, &トルク)を呼び出す（最初の周期は0を返しトルクを求めない）
+ * 3) 書き込む前にrampTorque(&トルク, 変化量)で変化量を制限する（変化量0は制限無し）
+ */
@@ -0,0 +1,295 @@
+﻿/*!
+ * @file  targetTracker.cpp
+ * @brief 探索対象の候補点を追跡する
+ *
+ * トラック毎に位置が一定のモデルのカルマンフィルタで位置と共分散を持つ．
+ * 観測とトラックはハッシュで近くのトラックだけを調べ，マハラノビス距離でゲートした組を近い順に対応付ける．
+ * 数回観測したトラックを確定し，観測が無くなったトラックは削除する．
+ */
+
+#include "stdafx.h"
+#include "targetTracker.h"
+#include <math.h>
+#include <stdlib.h>
+#include "logger.h"
+
+/*!
+ * @class targetTracker
+ * @brief 探索対象の候補点を追跡するクラス
+ */
+
+static const float PROCESS_NOISE = 300.0f * 300.0f;		//! 位置の変化の分散(mm^2/s)
+static const float MEASURE_NOISE = 200.0f * 200.0f;		//! 候補点の位置の分散(mm^2)
+static const float CHI2_GATE = 9.21f;					//! マハラノビス距離の2乗のゲート（2自由度，99%）
+static const float CONFIDENCE_GAIN = 0.3f;				//! 候補点の確からしさで確からしさを更新する割合
+
+/*!
+ * @brief コンストラクタ
+ */
+targetTracker::targetTracker():
+track_num(0), next_id(1), predict_time(0), hit_interval(0)
+{
+}
+
+/*!
+ * @brief デストラクタ
+ */
+targetTracker::~targetTracker()
+{
+}
+
+/*!
+ * @brief トラックを消去する
+ *
+ * @return 0
+ */
+int targetTracker::clear()
+{
+	track_num = 0;
+	predict_time = 0;
+
+	return 0;
+}
+
+/*!
+ * @brief 観測の回数を数える間隔を設定
+ * 候補点が直近のinterval(ms)のデータから求められる場合，同じデータから求めた候補点で
+ * 観測の回数が増えないように，interval以上離れた観測だけを数える．
+ *
+ * @param[in] interval 間隔(ms)
+ *
+ * @return 0
+ */
+int targetTracker::setHitInterval(int interval)
+{
+	hit_interval = interval;
+
+	return 0;
+}
+
+/*!
+ * @brief セルのハッシュ
+ *
+ * @param[in] ix,iy セルの番号
+ *
+ * @return ハッシュの値(0～HASH_SIZE-1)
+ */
+unsigned int targetTracker::hashCell(int ix, int iy)
+{
+	return ((unsigned int)ix * 73856093u ^ (unsigned int)iy * 19349663u) & (HASH_SIZE - 1);
+}
+
+/*!
+ * @brief 組のソートのための比較関数
+ *
+ * @param[in] c1 組１のポインタ
+ * @param[in] c2 組２のポインタ
+ *
+ * @return -1:c1の距離が小さい，0:同じ，1:c1の距離が大きい
+ */
+int targetTracker::comp_pair(const void *c1, const void *c2)
+{
+	const struct pair_T *p1 = (struct pair_T *)c1;
+	const struct pair_T *p2 = (struct pair_T *)c2;
+
+	if      (p1->distance < p2->distance) return -1;
+	else if (p1->distance > p2->distance) return 1;
+	else return 0;
+}
+
+/*!
+ * @brief 経過時間で共分散を増やす
+ *
+ * @param[in] time 現在の時刻(ms)
+ *
+ * @return 0
+ */
+int targetTracker::predict(unsigned long time)
+{
+	float period = (predict_time == 0) ? 0 : (float)(long)(time - predict_time) / 1000.0f;
+	predict_time = time;
+	if (period <= 0) return 0;
+
+	for(int k = 0; k < track_num; k ++){
+		track[k].pxx += PROCESS_NOISE * period;
+		track[k].pyy += PROCESS_NOISE * period;
+	}
+
+	return 0;
+}
+
+/*!
+ * @brief 観測とトラックを対応付ける
+ * トラックをGATEの大きさのセルでハッシュに登録し，観測の周囲の9セルのトラックとだけ距離を求める．
+ * ゲート内の組をマハラノビス距離の小さい順に，観測とトラックが未使用なら対応付ける．
+ *
+ * @param[in]  det       観測（候補点）
+ * @param[in]  num       観測の数
+ * @param[out] det_track 観測に対応付けたトラックの番号（-1:無し）
+ *
+ * @return 対応付けた数
+ */
+int targetTracker::associate(const pos_slate *det, int num, int *det_track)
+{
+	static int trk_used[MAX_TRACK];
+	int i, k, n = 0, matched = 0;
+
+	for(i = 0; i < HASH_SIZE; i ++) hash_head[i] = -1;
+	for(k = 0; k < track_num; k ++){
+		unsigned int h = hashCell((int)floor(track[k].x / GATE), (int)floor(track[k].y / GATE));
+		hash_next[k] = hash_head[h];
+		hash_head[h] = k;
+		trk_used[k] = 0;
+	}
+
+	for(i = 0; i < num; i ++){
+		int cx = (int)floor((float)det[i].pos.x / GATE), cy = (int)floor((float)det[i].pos.y / GATE);
+		det_track[i] = -1;
+		for(int dx = -1; dx <= 1; dx ++){
+			for(int dy = -1; dy <= 1; dy ++){
+				for(k = hash_head[hashCell(cx + dx, cy + dy)]; k >= 0; k = hash_next[k]){
+					float ex = det[i].pos.x - track[k].x, ey = det[i].pos.y - track[k].y;
+					if (ex * ex + ey * ey > (float)GATE * GATE) continue;
+					float sxx = track[k].pxx + MEASURE_NOISE, sxy = track[k].pxy, syy = track[k].pyy + MEASURE_NOISE;
+					float det_s = sxx * syy - sxy * sxy;
+					float m = (syy * ex * ex - 2.0f * sxy * ex * ey + sxx * ey * ey) / det_s;
+					if ((m > CHI2_GATE)||(n >= MAX_PAIR)) continue;
+					pair[n].distance = m;
+					pair[n].det = (short)i;
+					pair[n].trk = (short)k;
+					n ++;
+				}
+			}
+		}
+	}
+
+	qsort(pair, n, sizeof(struct pair_T), comp_pair);
+	for(i = 0; i < n; i ++){
+		if ((det_track[pair[i].det] >= 0)||trk_used[pair[i].trk]) continue;
+		det_track[pair[i].det] = pair[i].trk;
+		trk_used[pair[i].trk] = 1;
+		matched ++;
+	}
+
+	return matched;
+}
+
+/*!
+ * @brief 観測でトラックを更新する
+ * カルマンゲイン K = P (P + R)^-1 で位置と共分散を更新する．高さと確からしさは平均で平滑化する．
+ * 観測の回数は前に数えてからhit_intervalより後の場合だけ数える．
+ *
+ * @param[in] k    トラックの番号
+ * @param[in] det  観測（候補点）
+ * @param[in] time 観測の時刻(ms)
+ *
+ * @return 0
+ */
+int targetTracker::correct(int k, const pos_slate *det, unsigned long time)
+{
+	track_T *t = &track[k];
+	float sxx = t->pxx + MEASURE_NOISE, sxy = t->pxy, syy = t->pyy + MEASURE_NOISE;
+	float det_s = sxx * syy - sxy * sxy;
+	float ixx = syy / det_s, ixy = -sxy / det_s, iyy = sxx / det_s;		// S^-1
+	float kxx = t->pxx * ixx + t->pxy * ixy, kxy = t->pxx * ixy + t->pxy * iyy;	// K = P S^-1
+	float kyx = t->pxy * ixx + t->pyy * ixy, kyy = t->pxy * ixy + t->pyy * iyy;
+	float ex = det->pos.x - t->x, ey = det->pos.y - t->y;
+
+	t->x += kxx * ex + kxy * ey;
+	t->y += kyx * ex + kyy * ey;
+	t->z += 0.3f * (det->pos.z - t->z);
+	float pxx = (1.0f - kxx) * t->pxx - kxy * t->pxy;					// P = (I - K) P
+	float pxy = (1.0f - kxx) * t->pxy - kxy * t->pyy;
+	float pyy = -kyx * t->pxy + (1.0f - kyy) * t->pyy;
+	t->pxx = pxx, t->pxy = pxy, t->pyy = pyy;
+
+	t->confidence += CONFIDENCE_GAIN * (det->probability - t->confidence);
+	if ((long)(time - t->hit_time) > hit_interval){
+		t->hits ++;
+		t->hit_time = time;
+	}
+	t->misses = 0;
+	t->update_time = time;
+	if ((t->state == TENTATIVE)&&(t->hits >= CONFIRM_HITS)){
+		t->state = CONFIRMED;
+		LOG("track_confirm:id %d, (%f,%f)\n", t->id, t->x, t->y);
+	}
+
+	return 0;
+}
+
+/*!
+ * @brief 観測でトラックを更新
+ * 予測，対応付け，更新を行い，対応の無い観測から未確定のトラックを作り，古いトラックを削除する．
+ *
+ * @param[in] det  観測（候補点）(mm) グローバル座標
+ * @param[in] num  観測の数
+ * @param[in] time 観測の時刻(ms)
+ *
+ * @return トラックの数
+ */
+int targetTracker::update(const pos_slate *det, int num, unsigned long time)
+{
+	static int det_track[MAX_TRACK];
+	num = min(num, MAX_TRACK);
+
+	predict(time);
+	associate(det, num, det_track);
+
+	int matched_num = track_num;						// 新しいトラックは未観測の判定をしない
+	for(int k = 0; k < matched_num; k ++) track[k].misses ++;
+	for(int i = 0; i < num; i ++){
+		if (det_track[i] >= 0){
+			correct(det_track[i], &det[i], time);
+		} else if (track_num < MAX_TRACK){
+			track_T *t = &track[track_num ++];
+			t->id = next_id ++;
+			t->state = TENTATIVE;
+			t->x = (float)det[i].pos.x, t->y = (float)det[i].pos.y, t->z = (float)det[i].pos.z;
+			t->pxx = t->pyy = MEASURE_NOISE, t->pxy = 0;
+			t->hits = 1, t->misses = 0;
+			t->confidence = det[i].probability;
+			t->update_time = t->hit_time = time;
+		}
+	}
+
+	int n = 0;
+	for(int k = 0; k < track_num; k ++){				// 削除して前に詰める
+		const track_T *t = &track[k];
+		if ((t->state == TENTATIVE)&&(t->misses >= TENTATIVE_MISS)) continue;
+		if ((t->state == CONFIRMED)&&((long)(time - t->update_time) > DELETE_TIME)){
+			LOG("track_delete:id %d\n", t->id);
+			continue;
+		}
+		if (n != k) track[n] = track[k];
+		n ++;
+	}
+	track_num = n;
+
+	return track_num;
+}
+
+/*!
+ * @brief 確定したトラックを取得
+ *
+ * @param[out] p       トラックの位置(mm)と確からしさ(0～1) 候補点の確からしさに観測の無い時間で減る割合を掛ける
+ * @param[out] id      トラックの番号（NULLの場合は取得しない）
+ * @param[in]  max_num 取得する最大数
+ *
+ * @return 取得した数
+ */
+int targetTracker::getTracks(pos_slate *p, int *id, int max_num)
+{
+	int n = 0;
+	for(int k = 0; (k < track_num)&&(n < max_num); k ++){
+		const track_T *t = &track[k];
+		if (t->state != CONFIRMED) continue;
+		p[n].pos.x = (int)t->x, p[n].pos.y = (int)t->y, p[n].pos.z = (int)t->z;
+		float fresh = 1.0f - (float)(long)(predict_time - t->update_time) / DELETE_TIME;
+		p[n].probability = t->confidence * min(max(fresh, 0.0f), 1.0f);
+		if (id) id[n] = t->id;
+		n ++;
+	}
+
+	return n;
+}
@@ -0,0 +1,72 @@
+﻿#pragma once
+#include "dataType.h"
+
+class targetTracker
+{
+public:
+	targetTracker();									// コンストラクタ
+	virtual ~targetTracker();							// デストラクタ
+
+	static const int MAX_TRACK = 100;					//! トラックの最大数
+
+private:
+	static const int GATE = 1000;						//! 対応付ける最大の距離(mm)
+	static const int CONFIRM_HITS = 2;					//! 確定するまでの観測の回数（hit_interval毎に１回まで数える）
+	static const int TENTATIVE_MISS = 3;				//! 未確定のトラックを削除する連続の未観測の回数
+	static const int DELETE_TIME = 5000;				//! 確定したトラックを削除する観測の無い時間(ms)
+	static const int MAX_PAIR = 1000;					//! ゲート内の組の最大数
+	static const int HASH_SIZE = 256;					//! トラックを登録するハッシュの大きさ（2のべき乗）
+
+	static const int TENTATIVE = 0, CONFIRMED = 1;		//! トラックの状態
+
+	/*!
+	 * @struct track_T
+	 * @brief トラック（位置が一定のモデルのカルマンフィルタ）
+	 */
+	struct track_T{
+		int id;											//!< トラックの番号（削除するまで変わらない）
+		int state;										//!< 状態(TENTATIVE, CONFIRMED)
+		float x, y, z;									//!< 推定位置(mm)
+		float pxx, pxy, pyy;							//!< 位置の共分散(mm^2)
+		int hits, misses;								//!< 観測の回数，連続の未観測の回数
+		float confidence;								//!< 候補点の確からしさを平滑化した値(0～1)
+		unsigned long update_time;						//!< 最後に観測した時刻(ms)
+		unsigned long hit_time;							//!< 最後に観測の回数を数えた時刻(ms)
+	} track[MAX_TRACK];
+	int track_num;										//! トラックの数
+	int next_id;										//! 次に付けるトラックの番号
+	unsigned long predict_time;							//! 前回予測した時刻(ms)
+	int hit_interval;									//! 観測の回数を数える間隔(ms)
+
+	/*!
+	 * @struct pair_T
+	 * @brief ゲート内の観測とトラックの組
+	 */
+	struct pair_T{
+		float distance;									//!< マハラノビス距離の2乗
+		short det, trk;									//!< 観測とトラックの番号
+	} pair[MAX_PAIR];
+	int hash_head[HASH_SIZE];							//! ハッシュのセル毎の最初のトラック（-1:無し）
+	int hash_next[MAX_TRACK];							//! 同じハッシュの次のトラック（-1:無し）
+
+	static unsigned int hashCell(int ix, int iy);		// セルのハッシュ
+	static int comp_pair(const void *c1, const void *c2);	// 組のソートのための比較関数
+	int predict(unsigned long time);					// 経過時間で共分散を増やす
+	int associate(const pos_slate *det, int num, int *det_track);	// 観測とトラックを対応付ける
+	int correct(int k, const pos_slate *det, unsigned long time);	// 観測でトラックを更新する
+
+public:
+	int update(const pos_slate *det, int num, unsigned long time);	// 観測でトラックを更新
+	int getTracks(pos_slate *p, int *id, int max_num);	// 確定したトラックを取得
+	int clear();										// トラックを消去する
+	int setHitInterval(int interval);					// 観測の回数を数える間隔を設定
+};
+
+/*
+ * 使い方
+ * 1) setHitInterval(候補点を求めるデータの時間)を設定する（重なったデータから求めた候補点を何度も数えない）
+ * 2) 候補点(detectTarget::slate_point)を求める毎にupdate(候補点, 数, 時刻)を呼び出す
+ *    位置はupdate毎に更新し，確定のための観測の回数はhit_interval毎に１回まで数える
+ * 3) getTracks(p, id, max_num)で確定したトラックの位置と確からしさと番号を取得
+ *    確からしさは候補点の確からしさを平滑化した値で，最後に観測してからの時間で0まで減る
+ */
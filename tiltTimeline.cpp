@@ -0,0 +1,167 @@
+﻿/*!
+ * @file  tiltTimeline.cpp
+ * @brief チルト角度の時系列
+ *
+ * サーボ(RS405CB)から取得した角度を時刻と共に保存して，任意の時刻の角度を求める．
+ * URGの各ビームを計測した時刻のチルト角度を求めるために使用する．
+ */
+
+#include "stdafx.h"
+#include "tiltTimeline.h"
+
+/*!
+ * @class tiltTimeline
+ * @brief チルト角度の時系列を扱うクラス
+ */
+
+/*!
+ * @brief コンストラクタ
+ */
+tiltTimeline::tiltTimeline():
+sample_no(0), sample_top(0), command_no(0), command_top(0)
+{
+}
+
+/*!
+ * @brief デストラクタ
+ */
+tiltTimeline::~tiltTimeline()
+{
+}
+
+/*!
+ * @brief 履歴をクリアする
+ *
+ * @return 0
+ */
+int tiltTimeline::clear()
+{
+	sample_no = command_no = 0;
+
+	return 0;
+}
+
+/*!
+ * @brief RSMoveで指令した動きを追加
+ * 指令した時の角度から目標角度まで，一定速度で移動するものとする．
+ *
+ * @param[in] time   指令した時刻(ms)
+ * @param[in] target 目標のチルト角度(deg)
+ * @param[in] period 移動時間(ms)
+ *
+ * @return 0
+ */
+int tiltTimeline::addCommand(unsigned long time, float target, float period)
+{
+	float start = (sample_no > 0) ? getAngle(time) : target;	// 指令した時の角度
+
+	command_top = (command_top + 1) % MAX_COMMAND;
+	command[command_top].time   = time;
+	command[command_top].start  = start;
+	command[command_top].target = target;
+	command[command_top].period = period;
+	if (command_no < MAX_COMMAND) command_no ++;
+
+	return 0;
+}
+
+/*!
+ * @brief サーボから取得した角度を追加
+ * 時刻はサーボに角度の取得を要求した時刻とする（返信までの遅れは1ms未満）．
+ *
+ * @param[in] time  角度の取得を要求した時刻(ms)
+ * @param[in] angle チルト角度(deg)
+ *
+ * @return 0
+ */
+int tiltTimeline::addSample(unsigned long time, float angle)
+{
+	if ((sample_no > 0)&&((long)(time - sample[sample_top].time) <= 0)) return -1;	// 古いデータは無視
+
+	sample_top = (sample_top + 1) % MAX_SAMPLE;
+	sample[sample_top].time  = time;
+	sample[sample_top].angle = angle;
+	if (sample_no < MAX_SAMPLE) sample_no ++;
+
+	return 0;
+}
+
+/*!
+ * @brief 保存している角度の個数
+ *
+ * @return 保存している角度の個数
+ */
+int tiltTimeline::getSampleNum()
+{
+	return sample_no;
+}
+
+/*!
+ * @brief 指令した動きから角度を求める
+ *
+ * @param[in]  time   時刻(ms)
+ * @param[in]  offset 時刻に加える値(ms) 1ms未満の時刻を指定するために使用
+ * @param[out] angle  チルト角度(deg)
+ *
+ * @return 0:成功，-1:指定した時刻以前の指令が無い
+ */
+int tiltTimeline::getProfile(unsigned long time, float offset, float *angle)
+{
+	int k = command_top;
+	for(int i = 0; i < command_no; i ++){				// 新しい方から，指定した時刻以前の指令を探す
+		float t = (float)(long)(time - command[k].time) + offset;
+		if (t >= 0.0f){
+			float r = (command[k].period > 0.0f) ? t / command[k].period : 1.0f;
+			if (r > 1.0f) r = 1.0f;
+			*angle = command[k].start + (command[k].target - command[k].start) * r;
+			return 0;
+		}
+		k = (k + MAX_COMMAND - 1) % MAX_COMMAND;
+	}
+	return -1;
+}
+
+/*!
+ * @brief 指定した時刻のチルト角度を求める
+ * 取得した角度の間は，指令した動きの形に沿って補間する（折り返しの角も再現できる）．
+ * 最新の角度より後は，最新の角度を基準として指令した動きに沿って外挿する．
+ * 指令が無い場合は，単純な線形補間（範囲外は端の値）とする．
+ *
+ * @param[in] time   時刻(ms)
+ * @param[in] offset 時刻に加える値(ms) 1ms未満の時刻を指定するために使用
+ *
+ * @return チルト角度(deg)
+ */
+float tiltTimeline::getAngle(unsigned long time, float offset)
+{
+	float p, pa, pb;
+
+	if (sample_no == 0){
+		return getProfile(time, offset, &p) ? 0.0f : p;
+	}
+
+	// 新しい方から，指定した時刻以前の角度を探す
+	int i, k = sample_top;
+	float ta = 0.0f;
+	for(i = 0; i < sample_no; i ++){
+		ta = (float)(long)(time - sample[k].time) + offset;
+		if (ta >= 0.0f) break;
+		if (i < sample_no - 1) k = (k + MAX_SAMPLE - 1) % MAX_SAMPLE;
+	}
+	const struct sample_T *a = &sample[k];
+	int is_profile = !getProfile(time, offset, &p);
+
+	if ((i == 0)||(i == sample_no)){					// 最新より後，もしくは最古より前は外挿
+		if (is_profile && !getProfile(a->time, 0.0f, &pa)) return a->angle + (p - pa);
+		return a->angle;
+	}
+
+	const struct sample_T *b = &sample[(k + 1) % MAX_SAMPLE];
+	float period = (float)(long)(b->time - a->time);
+	float r = ta / period;
+	if (is_profile && !getProfile(a->time, 0.0f, &pa) && !getProfile(b->time, 0.0f, &pb)){
+		float residual = (b->angle - a->angle) - (pb - pa);		// 指令した動きとの差は線形に配分
+		return a->angle + (p - pa) + r * residual;
+	}
+	return a->angle + r * (b->angle - a->angle);
+}
@@ -0,0 +1,49 @@
+﻿#pragma once
+
+class tiltTimeline
+{
+public:
+	tiltTimeline();									// コンストラクタ
+	virtual ~tiltTimeline();						// デストラクタ
+
+private:
+	// サーボから取得した角度の履歴
+	static const int MAX_SAMPLE = 32;				//! 保存する角度の最大個数
+	struct sample_T{
+		unsigned long time;							//!< 角度を取得した時刻(ms)
+		float angle;								//!< チルト角度(deg)
+	} sample[MAX_SAMPLE];
+	int sample_no;									//! 保存している角度の個数
+	int sample_top;									//! 最新の角度の位置
+
+	// RSMoveで指令した動きの履歴
+	static const int MAX_COMMAND = 8;				//! 保存する指令の最大個数
+	struct command_T{
+		unsigned long time;							//!< 指令した時刻(ms)
+		float start;								//!< 指令した時のチルト角度(deg)
+		float target;								//!< 目標のチルト角度(deg)
+		float period;								//!< 移動時間(ms)
+	} command[MAX_COMMAND];
+	int command_no;									//! 保存している指令の個数
+	int command_top;								//! 最新の指令の位置
+
+	int getProfile(unsigned long time, float offset, float *angle);
+													// 指令した動きから角度を求める
+
+public:
+	int clear();									// 履歴をクリアする
+	int addCommand(unsigned long time, float target, float period);
+													// RSMoveで指令した動きを追加
+	int addSample(unsigned long time, float angle);	// サーボから取得した角度を追加
+	float getAngle(unsigned long time, float offset = 0.0f);
+													// 指定した時刻のチルト角度を求める(deg)
+	int getSampleNum();								// 保存している角度の個数
+};
+
+/*
+ * 使い方
+ * 1) RSMoveで移動を指令したら，addCommand(時刻, 目標角度, 移動時間)で登録
+ * 2) サーボから角度を取得したら，addSample(角度の取得を要求した時刻, 角度)で登録
+ * 3) getAngle(時刻)で任意の時刻の角度を取得
+ *    取得した角度の間は補間，最新の角度より後は指令した動きに沿って外挿する．
+ */
@@ -0,0 +1,139 @@
+﻿#pragma once
+#include "seqlock.h"
+
+/*!
+ * @class timedRing
+ * @brief 時刻付きのデータのリングバッファ（書き込むスレッドは１つだけ，読み出しはロック無し）
+ *
+ * データ毎のseqlockで書き込み中と上書きを検出して読み直す．
+ * Tは時刻のメンバ time (timeGetTime()の値) を持つ構造体とする．
+ */
+template<class T, int N> class timedRing
+{
+	/*!
+	 * @struct slot_T
+	 * @brief データの１個分
+	 */
+	struct slot_T{
+		seqlock lock;							//!< 書き込みの回数
+		LONG index;								//!< 何番目に書き込んだデータか
+		T data;									//!< 時刻付きのデータ
+	} slot[N];
+	volatile LONG count;						//! 書き込んだデータの総数
+
+public:
+	static const int FOUND = 0;					//! 時刻を挟む２つのデータが見つかった
+	static const int NEWER = 1;					//! 最新のデータより新しい（a,bは最新）
+	static const int OLDER = 2;					//! 最も古いデータより古いか，読む間に上書きされた（a,bは端のデータ）
+
+	timedRing(): count(0) {						// コンストラクタ
+		for(int i = 0; i < N; i ++) slot[i].index = -1;
+	}
+
+	/*!
+	 * @brief データを追加
+	 * 書き込んだ後で総数を増やして読み出せるようにする．
+	 *
+	 * @param[in] d 時刻付きのデータ
+	 *
+	 * @return 0
+	 */
+	int add(const T &d){
+		LONG index = count;
+		slot_T *s = &slot[index % N];
+
+		s->lock.beginWrite();
+		s->index = index;
+		s->data = d;
+		s->lock.endWrite();
+		InterlockedExchange(&count, index + 1);
+
+		return 0;
+	}
+
+	//! 書き込んだデータの総数
+	LONG size() const { return InterlockedCompareExchange((volatile LONG*)&count, 0, 0); }
+
+	/*!
+	 * @brief index番目のデータを読む
+	 *
+	 * @param[in]  index 何番目に書き込んだデータか
+	 * @param[out] d     データ
+	 *
+	 * @return 0:成功，-1:既に上書きされている
+	 */
+	int read(LONG index, T *d) const {
+		const slot_T *s = &slot[index % N];
+		LONG seq, written;
+		do {
+			seq = s->lock.beginRead();
+			written = s->index;
+			*d = s->data;
+		} while(s->lock.retry(seq));
+
+		return (written == index) ? 0 : -1;
+	}
+
+	/*!
+	 * @brief 最新のデータを取得
+	 *
+	 * @param[out] d 最新のデータ
+	 *
+	 * @return 0:成功，-1:データが無い
+	 */
+	int latest(T *d) const {
+		LONG n = size();
+		if (n == 0) return -1;
+
+		return read(n - 1, d);
+	}
+
+	/*!
+	 * @brief 指定した時刻を挟む隣り合う２つのデータを探す
+	 * 二分探索で a.time <= time < b.time となるa,bを求める．書き込み中の１個分は使わない．
+	 *
+	 * @param[in]  time 時刻(ms) timeGetTime()の値
+	 * @param[out] a,b  時刻の前と後のデータ
+	 *
+	 * @return FOUND，NEWER，OLDER，-1:データが無い
+	 */
+	int find(unsigned long time, T *a, T *b) const {
+		LONG n = size();
+		if (n == 0) return -1;
+
+		LONG hi = n - 1;
+		if (read(hi, b)) return -1;
+		if ((long)(time - b->time) >= 0){		// 最新より新しい
+			*a = *b;
+			return NEWER;
+		}
+		LONG lo = max(n - N + 1, (LONG)0);
+		if (read(lo, a)) *a = *b;				// 読む間に上書きされた場合は最新の値
+		if ((long)(time - a->time) < 0){		// 最も古いものより古い
+			*b = *a;
+			return OLDER;
+		}
+		while(hi - lo > 1){
+			LONG mid = (lo + hi) / 2;
+			T m;
+			if (read(mid, &m)||((long)(time - m.time) >= 0)){
+				lo = mid;						// 上書きされたデータは指定した時刻より古い
+			} else {
+				hi = mid;
+				*b = m;
+			}
+		}
+		if (read(lo, a)){
+			*a = *b;
+			return OLDER;
+		}
+
+		return FOUND;
+	}
+};
+
+/*
+ * 使い方
+ * 1) 書き込むスレッドが add(データ) を呼び出す
+ * 2) 他のスレッドはロック無しで latest() や find(時刻) を呼び出し，FOUNDならaとbの間を補間する
+ */
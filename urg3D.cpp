@@ -2,10 +2,14 @@
 
 #include "stdafx.h"
 #include "urg3D.h"
+#include <math.h>
 #include "logger.h"
+#include "scanLogger.h"
 
 #define URG_PORT 2
 
+#define	M_PI	3.14159f
+
 /*!
  * @class urg3D
  * @brief URGを使用して3D障害物データを検出するクラス
@@ -16,7 +20,9 @@
  * @brief コンストラクタ
  */
 urg3D::urg3D():
-tilt_low(0), tilt_high(0), tilt_period(1.0), num(0),terminate(0)
+tilt_low(0), tilt_high(0), tilt_period(1.0), num(0),terminate(0), rover(NULL),
+last_scan_time(0), stat_count(0), stat_dropped(0), stat_sum(0), stat_sum2(0), stat_max(0),
+frame_mean(0), frame_jitter(0), frame_max(0), frame_dropped(0)
 {
 }
 
@@ -172,9 +178,9 @@ int urg3D::Get2SelectedData(int low1, int high1, pos *p1, int *no1, int max_no1,
  * @param[in] p1 位置データ１を保存する配列
  * @param[out] no1 データ１の個数
  * @param[in] max_no1 データ１の最大個数（位置データの配列の最大値）
- * @param[in] low2 取得するデータ２の最小高さ
- * @param[in] high2 取得するデータ２の最大高さ
- * @param[in] p2 位置データ２を保存する配列
+ * @param[in] low2 取得するデータ２の最小高さ（推定した地面からの高さ，地面とロボットより高い物体は除く）
+ * @param[in] high2 取得するデータ２の最大高さ（推定した地面からの高さ）
+ * @param[in] p2 位置データ２を保存する配列（NULLの場合は取得しない）
  * @param[out] no2 データ２の個数
  * @param[in] max_no2 データ２の最大個数（位置データの配列の最大値）
  * @param[in] low3 取得するデータ３の最小高さ
@@ -183,29 +189,47 @@ int urg3D::Get2SelectedData(int low1, int high1, pos *p1, int *no1, int max_no1,
  * @param[out] no3 データ３の個数
  * @param[in] max_no3 データ３の最大個数（位置データの配列の最大値）
  * @param[in] min_intensity 反射強度の最小値
+ * @param[in] align_time 指定した時刻(ms)のロボット座標系に変換する（0:変換しない）
  * 
  * @return データの個数
  */
 int urg3D::Get3SelectedData(int low1, int high1, pos *p1, int *no1, int max_no1,
 							int low2, int high2, pos *p2, int *no2, int max_no2,
-							int low3, int high3, pos_inten *p3, int *no3, int max_no3, int min_intensity)
+							int low3, int high3, pos_inten *p3, int *no3, int max_no3, int min_intensity,
+							unsigned long align_time)
 {
 	int n1 = 0, n2 = 0, n3 = 0, i;
+	unsigned long time0 = 0;
+	float dx = 0, dy = 0, c = 1, s = 0;
 
 	WaitForSingleObject(mutex, INFINITE); 
-	for(i = 0; ((i < num)&&(n1 < max_no1)&&(n2 < max_no2)); i++){
-		if ((upos_inten[i].pos.z >= low1)&&(upos_inten[i].pos.z <= high1)){
-			p1[n1 ++] = upos_inten[i].pos;
+	for(i = 0; ((i < num)&&(n1 < max_no1)&&((p2 == NULL)||(n2 < max_no2))); i++){
+		pos q = upos_inten[i].pos;
+		if (align_time != 0){								// 計測した時刻からの移動を補正
+			if (upos_time[i] != time0){						// スキャンが変わった時だけ変換を求める
+				float dthe;
+				time0 = upos_time[i];
+				getMotion(time0, align_time, &dx, &dy, &dthe);
+				c = cos(dthe), s = sin(dthe);
+			}
+			q.x = (int)(c * upos_inten[i].pos.x - s * upos_inten[i].pos.y + dx);
+			q.y = (int)(s * upos_inten[i].pos.x + c * upos_inten[i].pos.y + dy);
 		}
-		if ((upos_inten[i].pos.z >= low2)&&(upos_inten[i].pos.z <= high2)){
-			p2[n2 ++] = upos_inten[i].pos;
+		if ((q.z >= low1)&&(q.z <= high1)){
+			p1[n1 ++] = q;
 		}
-		if ((upos_inten[i].pos.z >= low3)&&(upos_inten[i].pos.z <= high3)&&
+		if ((p2 != NULL)&&(upos_label[i] == estimateGround::LABEL_OBSTACLE)&&
+			(upos_height[i] >= low2)&&(upos_height[i] <= high2)){
+			p2[n2 ++] = q;
+		}
+		if ((q.z >= low3)&&(q.z <= high3)&&
 			(upos_inten[i].intensity > min_intensity)){
-			p3[n3 ++] = upos_inten[i];
+			p3[n3].pos = q;
+			p3[n3 ++].intensity = upos_inten[i].intensity;
 		}
 	}
-	*no1 = n1, *no2 = n2, *no3 = n3;
+	*no1 = n1, *no3 = n3;
+	if (no2 != NULL) *no2 = n2;
 	num -= i;
 	ReleaseMutex(mutex);
 
@@ -245,89 +269,258 @@ DWORD WINAPI urg3D::ThreadFunc(LPVOID lpParameter)
 
 /*!
  * @brief 別スレッドで動作する関数
- * Update()を50ms毎に呼び出している．
+ * URGのデータを受信したらすぐにUpdate()を呼び出す（１スキャンが揃った時点で配列に保存される）．
+ * データが来ない場合もDATA_TIMEOUT毎にUpdate()を呼び出してサーボを動かす．
  *
  * @return S_OK
  */
 DWORD WINAPI urg3D::ExecThread()
 {
 	while(!terminate){
+		urg.WaitData(DATA_TIMEOUT);
 		Update();
-		Sleep(50);
 	}
 	return S_OK; 
 }
 
 
 /*!
- * @brief 定期的(50ms)に呼び出される関数
- * 1)サーボモータの制御
+ * @brief URGのデータを受信する毎に呼び出される関数
+ * 1)サーボモータの制御（tilt_period毎に折り返す）
  * 2)サーボモータの角度の取得
  * 3)URGのデータを取得
  * 4)デカルト座標系の占有データに変換して配列に保存
  *
+ * スキャン中(約11ms)もチルトとロボットは動いているため，ビーム毎の計測時刻から
+ * チルト角度とロボットの移動を求めて，最後のビームの時刻のロボット座標系に変換する．
+ *
  * @return 0
  */
 int urg3D::Update()
 {
 	static int is_first = 1;
 	static int length[urg.n_data], intensity[urg.n_data];
-	static pos p[urg.n_data];
-	static int is_up = 1, count = 1000;
-
-	count ++;
-	if (count >= (tilt_period * 1000 / 50)){
+	static CURG::scan_xyz xyz;
+	static short height[urg.n_data];
+	static unsigned char label[urg.n_data];
+	static int is_up = 1, is_moved = 0;
+	static unsigned long move_time = 0;					// サーボに移動を指令した時刻(ms)
+	static unsigned long angle_request_time = 0;		// チルト角度の取得を開始した時刻(ms)
+	static int is_angle_waiting = 0;					// チルト角度の返信待ち
+
+	if ((!is_moved)||((long)(timeGetTime() - move_time) >= (long)(tilt_period * 1000))){
 		if (is_up){
 			RSMove(hComm, (tilt_high + SERVO_OFFSET) * 10, (int)(tilt_period * 100));
+			tilt.addCommand(timeGetTime(), (float)tilt_high, tilt_period * 1000);
 		} else {
 			RSMove(hComm, (tilt_low  + SERVO_OFFSET) * 10, (int)(tilt_period * 100));
+			tilt.addCommand(timeGetTime(), (float)tilt_low , tilt_period * 1000);
+		}
+		if (rover){							// 掃引が終わったので地面を推定
+			float x, y, the;
+			rover->getOdometoryAt(timeGetTime(), &x, &y, &the);
+			ground.updateSweep(x, y);
+		} else {
+			ground.updateSweep(0, 0);
 		}
 		RSStartGetAngle(hComm);				// tilt角度の取得を始める．
+		angle_request_time = move_time = timeGetTime();
+		is_angle_waiting = 1;
 		is_up ^= 1;
-		count = 0;
+		is_moved = 1;
 		return 0;
 	}
 
 	if (is_first){
 		RSStartGetAngle(hComm);				// tilt角度の取得を始める．
+		angle_request_time = timeGetTime();
+		is_angle_waiting = 1;
 		urg.StartMeasure();
 		is_first = 0;
 		return 0;
 	}
 	
-	int n = 0;
-	float tilt_angle = RSGetAngle(hComm)/10.0f - SERVO_OFFSET;	// deg
-	if (urg.n_data == urg.GetData(length, intensity)){
-		n = urg.TranslateCartesian(tilt_angle, length, p);
+	short angle;
+	int ret = RSGetAngleReply(hComm, &angle);
+	if (ret > 0){							// 返信があれば，要求した時刻の角度として保存
+		tilt.addSample(angle_request_time, angle/10.0f - SERVO_OFFSET);
 	}
-	WaitForSingleObject(mutex, INFINITE);	// mutexの開始
-	pos *q = p;
-	int *r = intensity;
-	for(int i = 0; (i < n)&&(num < MAX_NUM);i ++){
-		if ((q->x != 0)||(q->y != 0)||(q->z != 0)){
-			upos_inten[num   ].pos       = *q ++;
-			upos_inten[num ++].intensity = *r ++;
-		} else {
-			q ++;
+	if (ret != 0) is_angle_waiting = 0;		// 返信を受信（エラーを含む）
+
+	if (urg.n_data == urg.GetData(length, intensity)){
+		const float beam_period = (float)SCAN_PERIOD / STEPS_PER_ROTATION;	// 1ビームの計測時間(ms)
+		const float scan_span = beam_period * (urg.n_data - 1);				// 最初から最後のビームまでの時間(ms)
+		unsigned long scan_time = timeGetTime() - URG_DELAY;	// 最後のビームを計測した時刻(ms)
+		updateFrameStatistics(scan_time);
+		float tilt_first = tilt.getAngle(scan_time, -scan_span);
+		float tilt_last  = tilt.getAngle(scan_time);
+		int n = urg.TranslateCartesian(tilt_first, length, &xyz, (tilt_last - tilt_first) / (urg.n_data - 1));
+		float tilt_angle = tilt_last;		// deg
+
+		float odo_x = 0, odo_y = 0, odo_the = 0;	// スキャンの時刻のオドメトリ
+		if (rover) rover->getOdometoryAt(scan_time, &odo_x, &odo_y, &odo_the);
+		if (scanLogger::isOpen()){			// 生データをバイナリで保存（点毎のテキスト出力はしない）
+			scanLogger::WriteScan(scan_time, tilt_first, tilt_last, odo_x, odo_y, odo_the, length, intensity, urg.n_data);
 		}
-	}
-	ReleaseMutex(mutex);					// mutexの終了
-
-	// Logに書き出し
-	LOG("tilt_angle:%f\n", tilt_angle);
-	LOG("\n");								// 時間を表示するため 
-	for(int i = 0; i < num ;i ++){
-		LOG_WITHOUT_TIME("urg:(%d,%d,%d),intensity:%d\n",
-			upos_inten[i].pos.x, upos_inten[i].pos.y, upos_inten[i].pos.z, upos_inten[i].intensity); 
+
+		// スキャン中のロボットの移動を補正（最初のビームの時刻から最後のビームの時刻までの移動を線形に配分）
+		float mx, my, mthe;
+		getMotion(scan_time - (unsigned long)(scan_span + 0.5f), scan_time, &mx, &my, &mthe);
+		if ((mx != 0)||(my != 0)||(mthe != 0)){
+			for(int i = 0; i < n; i ++){
+				if ((xyz.x[i] == 0)&&(xyz.y[i] == 0)&&(xyz.z[i] == 0)) continue;
+				float f = (float)(n - 1 - i) / (n - 1);	// 最初のビームで1，最後のビームで0
+				float x = xyz.x[i], y = xyz.y[i];
+				xyz.x[i] = x - f * mthe * y + f * mx;		// 回転量は小さいので1次の近似
+				xyz.y[i] = y + f * mthe * x + f * my;
+			}
+		}
+		ground.addPoints(odo_x, odo_y, odo_the, xyz.x, xyz.y, xyz.z, n, height, label);	// 地面からの高さで分類
+		voxel_map.integrate(scan_time, odo_x, odo_y, odo_the, xyz.x, xyz.y, xyz.z, label, n);	// 分類と共にボクセル地図に積算
+		safety.check(xyz.x, xyz.y, label, n, scan_time);	// OnTimerを待たずに停止領域を調べる
+
+		WaitForSingleObject(mutex, INFINITE);	// mutexの開始
+		for(int i = 0; (i < n)&&(num < MAX_NUM);i ++){
+			pos q;
+			q.x = (int)xyz.x[i], q.y = (int)xyz.y[i], q.z = (int)xyz.z[i];
+			if ((q.x != 0)||(q.y != 0)||(q.z != 0)){
+				upos_inten[num].pos       = q;
+				upos_inten[num].intensity = intensity[i];
+				upos_height[num]          = height[i];
+				upos_label [num]          = label[i];
+				upos_time [num ++]        = scan_time;
+			}
+		}
+		ReleaseMutex(mutex);					// mutexの終了
+
+		// Logに書き出し（点群はscanLoggerで保存）スキャン毎に１回
+		LOG("tilt_angle:%f\n", tilt_angle);
 	}
 
-	RSStartGetAngle(hComm);					// tilt角度の取得を開始
+	// 返信を受信したら次のtilt角度の取得を開始（返信が無い場合はタイムアウト後に再送）
+	long elapsed = (long)(timeGetTime() - angle_request_time);
+	if (((!is_angle_waiting)&&(elapsed >= ANGLE_PERIOD))||(elapsed >= ANGLE_TIMEOUT)){
+		RSStartGetAngle(hComm);
+		angle_request_time = timeGetTime();
+		is_angle_waiting = 1;
+	}
 	
 	return 0;
 }
 
+/*!
+ * @brief フレーム間隔の統計を更新
+ * STAT_FRAMES毎に平均，標準偏差（ジッタ），最大値，欠落したフレーム数を求めてLogに書き出す．
+ *
+ * @param[in] time スキャンの時刻(ms)
+ *
+ * @return 0
+ */
+int urg3D::updateFrameStatistics(unsigned long time)
+{
+	if (last_scan_time != 0){
+		float interval = (float)(long)(time - last_scan_time);
+		int dropped = (int)(interval / SCAN_PERIOD + 0.5f) - 1;	// 受信できなかったスキャンの数
+		stat_sum  += interval;
+		stat_sum2 += interval * interval;
+		if (interval > stat_max) stat_max = interval;
+		if (dropped > 0) stat_dropped += dropped;
+		stat_count ++;
+		if (stat_count >= STAT_FRAMES){
+			float mean = stat_sum / stat_count;
+			float var  = stat_sum2 / stat_count - mean * mean;
+			WaitForSingleObject(mutex, INFINITE);
+			frame_mean    = mean;
+			frame_jitter  = (var > 0) ? sqrt(var) : 0.0f;
+			frame_max     = stat_max;
+			frame_dropped = stat_dropped;
+			ReleaseMutex(mutex);
+			LOG("urg_frame_interval:mean %f, jitter %f, max %f, dropped %d\n", frame_mean, frame_jitter, frame_max, frame_dropped);
+			stat_count = stat_dropped = 0;
+			stat_sum = stat_sum2 = stat_max = 0;
+		}
+	}
+	last_scan_time = time;
+
+	return 0;
+}
+
+/*!
+ * @brief ボクセル地図を取得
+ * 地図はスキャン毎に更新される．問い合わせは排他処理されているため，どのスレッドからでも使用できる．
+ *
+ * @return ボクセル地図
+ */
+voxelMap *urg3D::getVoxelMap()
+{
+	return &voxel_map;
+}
+
+/*!
+ * @brief フレーム間隔の統計を取得
+ * 直近のSTAT_FRAMESフレームの統計を返す．
+ *
+ * @param[out] mean         フレーム間隔の平均(ms)
+ * @param[out] jitter       フレーム間隔の標準偏差(ms)
+ * @param[out] max_interval フレーム間隔の最大値(ms)
+ * @param[out] dropped      欠落したフレーム数
+ *
+ * @return 0
+ */
+int urg3D::getFrameStatistics(float *mean, float *jitter, float *max_interval, int *dropped)
+{
+	WaitForSingleObject(mutex, INFINITE);
+	*mean         = frame_mean;
+	*jitter       = frame_jitter;
+	*max_interval = frame_max;
+	*dropped      = frame_dropped;
+	ReleaseMutex(mutex);
+
+	return 0;
+}
+
+/*!
+ * @brief 時刻fromのロボット座標系から時刻toのロボット座標系への変換を求める
+ * 時刻fromに計測した点pは，時刻toのロボット座標系で R(dthe)p + (dx,dy) となる．
+ * オドメトリが設定されていない場合は移動無しとする．
+ *
+ * @param[in]  from 変換元の時刻(ms)
+ * @param[in]  to   変換先の時刻(ms)
+ * @param[out] dx   並進のx成分(mm)
+ * @param[out] dy   並進のy成分(mm)
+ * @param[out] dthe 回転角度(rad)
+ *
+ * @return 0:補正あり，-1:補正無し
+ */
+int urg3D::getMotion(unsigned long from, unsigned long to, float *dx, float *dy, float *dthe)
+{
+	*dx = *dy = *dthe = 0;
+	if ((rover == NULL)||(from == to)) return -1;
+	if (rover->getOdometoryDelta(to, from, dx, dy, dthe)) return -1;	// 時刻toの座標系での時刻fromの位置
+	*dx *= 1000.0f, *dy *= 1000.0f;
+
+	return 0;
+}
+
+/*!
+ * @brief 計測時刻の位置を求めるためのオドメトリを設定
+ * 設定すると，スキャン中の移動の補正と，Get3SelectedDataでの時刻合わせ，スキャン毎の停止領域の監視を行う．
+ *
+ * @param[in] rover オドメトリを取得するクラスのポインタ
+ *
+ * @return 0
+ */
+int urg3D::setOdometorySource(megaRover *rover)
+{
+	this->rover = rover;
+	safety.setRover(rover);
+
+	return 0;
+}
+
 /*!
  * @brief URG3Dのデータをクリアする．
+ * ボクセル地図もオドメトリの座標系なので，オドメトリをクリアする前に消去する．
  * 
  * @return 0
  */
@@ -336,6 +529,7 @@ int urg3D::ClearData()
 	WaitForSingleObject(mutex, INFINITE); 
 	num = 0;
 	ReleaseMutex(mutex);
+	voxel_map.clear();
 	
 	return 0;
 }
\ No newline at end of file
@@ -2,16 +2,44 @@
 #include <vector>
 #include "URG.h"
 #include "rs405cb.h"
+#include "megaRover.h"
+#include "tiltTimeline.h"
+#include "voxelMap.h"
+#include "estimateGround.h"
+#include "safetyMonitor.h"
 
 class urg3D
 {
 private:
 	static const int SERVO_OFFSET = -5;		// サーボのオフセット(取付け角度を見ながら設定)
 	static const int MAX_NUM = 100000;		// (1081点 * 20回)/秒 - 現時点で5秒程度のデータを保存可能な領域
+	static const int SCAN_PERIOD = 25;		// URGが1回転する時間(ms)
+	static const int STEPS_PER_ROTATION = 1440;	// URGの1回転のステップ数
+	static const int URG_DELAY = 2;			// 最後のビームを計測してから受信するまでの時間(ms)
+	static const int DATA_TIMEOUT = 100;	// URGのデータを待つ最大時間(ms)
+	static const int ANGLE_PERIOD = 10;		// チルト角度を取得する最小の周期(ms)
+	static const int ANGLE_TIMEOUT = 50;	// チルト角度の返信を待つ最大時間(ms)
+	static const int STAT_FRAMES = 40;		// フレーム間隔の統計を求めるフレーム数（約1秒）
 
 	CURG urg;								// URGのクラス
 	int num;
-	pos_inten upos_inten[MAX_NUM];
+	pos_inten upos_inten[MAX_NUM];			// 計測したスキャンの最後のビームの時刻のロボット座標系での位置
+	unsigned long upos_time[MAX_NUM];		// 計測したスキャンの最後のビームの時刻(ms)
+	short upos_height[MAX_NUM];				// 推定した地面からの高さ(mm)
+	unsigned char upos_label[MAX_NUM];		// 点の分類(estimateGround::LABEL_*)
+	megaRover *rover;						// 計測時刻の位置を求めるためのオドメトリ（NULLの場合は補正しない）
+	tiltTimeline tilt;						// チルト角度の時系列（ビーム毎のチルト角度を求める）
+	voxelMap voxel_map;						// スキャンを積算した3次元のボクセル地図（オドメトリの座標系）
+	estimateGround ground;					// 掃引毎に地面を推定して点を分類する
+	safetyMonitor safety;					// スキャン毎に停止領域を調べて前進を止める
+	int getMotion(unsigned long from, unsigned long to, float *dx, float *dy, float *dthe);
+											// 時刻fromのロボット座標系から時刻toのロボット座標系への変換を求める
+	unsigned long last_scan_time;			// 前のスキャンの時刻(ms)
+	int stat_count, stat_dropped;			// 統計を求めている途中のフレーム数，欠落したフレーム数
+	float stat_sum, stat_sum2, stat_max;	// 統計を求めている途中のフレーム間隔の和，2乗和，最大値(ms)
+	float frame_mean, frame_jitter, frame_max;	// 直近のフレーム間隔の平均，標準偏差，最大値(ms)
+	int frame_dropped;						// 直近の統計で欠落したフレーム数
+	int updateFrameStatistics(unsigned long time);	// フレーム間隔の統計を更新
 	HANDLE hComm;
 	HANDLE mutex;
 	int tilt_low, tilt_high;
@@ -19,7 +47,7 @@ private:
 	int terminate;
 	static DWORD WINAPI ThreadFunc(LPVOID lpParameter);	// スレッドのエントリーポイント
 	DWORD WINAPI ExecThread();				// 別スレッドで動作する関数
-	int Update();							// 定期的(50ms)に呼び出される関数
+	int Update();							// URGのデータを受信する毎に呼び出される関数
 
 public:
 	urg3D();								// コンストラクタ
@@ -34,9 +62,13 @@ public:
 											// ２つの高さを指定してurgのデカルト座標系での障害物データを取得
 	int Get3SelectedData(int low1, int high1, pos *p1, int *no1, int max_no1,
 		int low2, int high2, pos *p2, int *no2, int max_no2,
-		int low3, int high3, pos_inten *p3, int *no3, int max_no3, int min_intensity);
-											// ３つの高さを指定してurgのデカルト座標系での障害物データを取得
+		int low3, int high3, pos_inten *p3, int *no3, int max_no3, int min_intensity,
+		unsigned long align_time = 0);		// ３つの高さを指定してurgのデカルト座標系での障害物データを取得（２つ目は地面からの高さ）
 	int SetTiltAngle(int low, int high, float period);
 											// チルトアングルの動きの設定
 	int ClearData();						// データをクリアする
+	int setOdometorySource(megaRover *rover);	// 計測時刻の位置を求めるためのオドメトリを設定
+	int getFrameStatistics(float *mean, float *jitter, float *max_interval, int *dropped);
+											// フレーム間隔の統計を取得
+	voxelMap *getVoxelMap();				// ボクセル地図を取得
 };
@@ -0,0 +1,518 @@
+﻿/*!
+ * @file  voxelMap.cpp
+ * @brief ロボットを中心とした3次元のボクセル地図
+ *
+ * チルトするURGのスキャンを積算して，ロボットの周囲の占有状態を保持する．
+ * ボクセルはオドメトリの座標系で固定し，ハッシュテーブルで必要な分だけ保存する．
+ * 各ボクセルは点を計測した回数(hit)とビームが通過した回数(miss)を持ち，
+ * 移動物体が去った後の空間はビームの通過(ray carving)で空きに戻る．
+ * 回数は小さい上限で止めるため，長く止まっていた人でも数回の通過で消える．
+ * 障害物の確からしさは計測回数から経過時間に応じて減らし，通過が無い場所でも時間で消える．
+ * 点の分類(estimateGround)も数え，障害物のボクセルをcostmapに渡す．
+ */
+
+#include "stdafx.h"
+#include "voxelMap.h"
+#include "estimateGround.h"
+#include <math.h>
+#include <mmsystem.h>
+#include "logger.h"
+
+/*!
+ * @class voxelMap
+ * @brief 3次元のボクセル地図のクラス
+ */
+
+/*!
+ * @brief コンストラクタ
+ */
+voxelMap::voxelMap():
+table_no(0), entry_num(0), center_ix(0), center_iy(0), scan_count(0)
+{
+	mutex = CreateMutex(NULL, FALSE, NULL);
+	clear();
+}
+
+/*!
+ * @brief デストラクタ
+ */
+voxelMap::~voxelMap()
+{
+	CloseHandle(mutex);
+}
+
+/*!
+ * @brief 地図をクリアする
+ *
+ * @return 0
+ */
+int voxelMap::clear()
+{
+	WaitForSingleObject(mutex, INFINITE);
+	for(int i = 0; i < TABLE_SIZE; i ++) table[table_no][i].key = EMPTY_KEY;
+	entry_num = 0;
+	ReleaseMutex(mutex);
+
+	return 0;
+}
+
+/*!
+ * @brief 座標からボクセルの番号を求める
+ *
+ * @param[in] v 座標(mm)
+ *
+ * @return ボクセルの番号
+ */
+int voxelMap::toIndex(float v)
+{
+	return (int)floor(v / VOXEL_SIZE);
+}
+
+/*!
+ * @brief 時刻をボクセルに保存する値にする
+ *
+ * @param[in] time 時刻(ms)
+ *
+ * @return STAMP_UNIT単位の時刻の下位8bit
+ */
+unsigned char voxelMap::toStamp(unsigned long time)
+{
+	return (unsigned char)(time / STAMP_UNIT);
+}
+
+/*!
+ * @brief ボクセルのキーを求める
+ * x,yはXY_BITSで一周するが，保存する範囲はそれより十分に狭いため重ならない．
+ *
+ * @param[in] ix x方向のボクセルの番号
+ * @param[in] iy y方向のボクセルの番号
+ * @param[in] iz z方向のボクセルの番号(0～Z_LEVELS-1)
+ *
+ * @return キー
+ */
+unsigned long voxelMap::makeKey(int ix, int iy, int iz)
+{
+	const int mask = (1 << XY_BITS) - 1;
+	return ((unsigned long)(ix & mask) << (XY_BITS + 6)) | ((unsigned long)(iy & mask) << 6) | (unsigned long)iz;
+}
+
+/*!
+ * @brief キーからボクセルの位置を求める
+ * 範囲の中心に最も近い位置として求める．
+ *
+ * @param[in]  key キー
+ * @param[out] ix  x方向のボクセルの番号
+ * @param[out] iy  y方向のボクセルの番号
+ * @param[out] iz  z方向のボクセルの番号
+ *
+ * @return 0
+ */
+int voxelMap::unwrap(unsigned long key, int *ix, int *iy, int *iz)
+{
+	const int size = 1 << XY_BITS, mask = size - 1;
+	int dx = ((int)(key >> (XY_BITS + 6)) - center_ix) & mask;
+	int dy = ((int)(key >> 6)             - center_iy) & mask;
+	if (dx >= size / 2) dx -= size;
+	if (dy >= size / 2) dy -= size;
+	*ix = center_ix + dx;
+	*iy = center_iy + dy;
+	*iz = (int)(key & 0x3f);
+
+	return 0;
+}
+
+/*!
+ * @brief ボクセルを探す
+ *
+ * @param[in] key キー
+ *
+ * @return ボクセル（無い場合はNULL）
+ */
+struct voxelMap::voxel_T *voxelMap::find(unsigned long key)
+{
+	struct voxel_T *t = table[table_no];
+	unsigned long h = ((key * 2654435761UL) & 0xffffffff) >> (32 - TABLE_BITS);
+
+	while(t[h].key != EMPTY_KEY){				// 線形探査
+		if (t[h].key == key) return &t[h];
+		h = (h + 1) & (TABLE_SIZE - 1);
+	}
+	return NULL;
+}
+
+/*!
+ * @brief ボクセルを探す（無ければ追加）
+ *
+ * @param[in] key キー
+ *
+ * @return ボクセル（登録できない場合はNULL）
+ */
+struct voxelMap::voxel_T *voxelMap::insert(unsigned long key)
+{
+	struct voxel_T *t = table[table_no];
+	unsigned long h = ((key * 2654435761UL) & 0xffffffff) >> (32 - TABLE_BITS);
+
+	while(t[h].key != EMPTY_KEY){
+		if (t[h].key == key) return &t[h];
+		h = (h + 1) & (TABLE_SIZE - 1);
+	}
+	if (entry_num >= MAX_ENTRY) return NULL;	// 一杯の場合は追加しない（呼び出し側でテーブルを整理する）
+	t[h].key  = key;
+	t[h].hit  = t[h].miss = t[h].obstacle = 0;
+	t[h].stamp = 0;
+	entry_num ++;
+	return &t[h];
+}
+
+/*!
+ * @brief 保存する範囲内か
+ *
+ * @param[in] ix x方向のボクセルの番号
+ * @param[in] iy y方向のボクセルの番号
+ * @param[in] iz z方向のボクセルの番号
+ *
+ * @return 1:範囲内, 0:範囲外
+ */
+int voxelMap::isInWindow(int ix, int iy, int iz)
+{
+	const int w = WINDOW / VOXEL_SIZE;
+	return ((abs(ix - center_ix) <= w)&&(abs(iy - center_iy) <= w)&&(iz >= 0)&&(iz < Z_LEVELS)) ? 1 : 0;
+}
+
+/*!
+ * @brief 占有されているか
+ * 計測した回数がMIN_HIT以上で，通過した回数より重みを付けた計測の回数が多い場合に占有とする．
+ *
+ * @param[in] v ボクセル
+ *
+ * @return 1:占有, 0:空き
+ */
+int voxelMap::isOccupied(const struct voxel_T *v)
+{
+	return ((v->hit >= MIN_HIT)&&(v->hit * HIT_WEIGHT > v->miss)) ? 1 : 0;
+}
+
+/*!
+ * @brief 障害物か
+ * 占有されていて，計測した点の半分以上が障害物に分類され，確からしさがMIN_HIT以上の場合に障害物とする．
+ * 確からしさは計測回数からDECAY_STAMPS毎に1ずつ減らしたもので，計測回数が少ないボクセルほど早く消える．
+ * ビームが通過しない場所（背後に何も無い場合など）で立ち去った物体はこれで消える（最長HOLD_STAMPS）．
+ *
+ * @param[in] v     ボクセル
+ * @param[in] stamp 現在の時刻(toStampの値)
+ *
+ * @return 1:障害物, 0:障害物ではない
+ */
+int voxelMap::isObstacle(const struct voxel_T *v, unsigned char stamp)
+{
+	int age = (unsigned char)(stamp - v->stamp);
+	return (isOccupied(v)&&(v->obstacle * 2 >= v->hit)&&(v->hit - age / DECAY_STAMPS >= MIN_HIT)) ? 1 : 0;
+}
+
+/*!
+ * @brief 不要なボクセルを除いてもう一方のテーブルに移す
+ * 範囲外のボクセル，空きのボクセル，HOLD_STAMPSより古く障害物に分類されていないボクセルを削除する．
+ * 移すボクセルは元の数以下なので，移す途中で一杯になることは無い．
+ * 時刻は8bitで一周するため，HOLD_STAMPSより古いボクセルは経過時間がHOLD_STAMPSになるように時刻を進めて，
+ * 一周した後に新しく計測したように見えないようにする．
+ * 範囲の中心の移動時，テーブルが一杯になった時，COMPACT_SCANS毎に呼び出す（ロボットが止まっていても整理する）．
+ *
+ * @param[in] ix    新しい範囲の中心のx方向のボクセルの番号
+ * @param[in] iy    新しい範囲の中心のy方向のボクセルの番号
+ * @param[in] stamp 現在の時刻(toStampの値)
+ *
+ * @return 削除したボクセルの数
+ */
+int voxelMap::rebuild(int ix, int iy, unsigned char stamp)
+{
+	struct voxel_T *src = table[table_no];
+	int old_ix = center_ix, old_iy = center_iy, old_num = entry_num;
+	table_no ^= 1;
+	for(int i = 0; i < TABLE_SIZE; i ++) table[table_no][i].key = EMPTY_KEY;
+	entry_num = 0;
+
+	for(int i = 0; i < TABLE_SIZE; i ++){
+		if (src[i].key == EMPTY_KEY) continue;
+		if (src[i].hit * HIT_WEIGHT <= src[i].miss) continue;	// 空きのボクセルは削除
+		int stale = ((unsigned char)(stamp - src[i].stamp) >= HOLD_STAMPS) ? 1 : 0;
+		if (stale && (src[i].obstacle * 2 < src[i].hit)) continue;	// 古い障害物以外のボクセルは削除（再び計測すれば追加される）
+		int vx, vy, vz;
+		center_ix = old_ix, center_iy = old_iy;
+		unwrap(src[i].key, &vx, &vy, &vz);
+		center_ix = ix, center_iy = iy;
+		if (!isInWindow(vx, vy, vz)) continue;
+		struct voxel_T *v = insert(src[i].key);
+		v->hit = src[i].hit, v->miss = src[i].miss, v->obstacle = src[i].obstacle;
+		v->stamp = stale ? (unsigned char)(stamp - HOLD_STAMPS) : src[i].stamp;
+	}
+	center_ix = ix, center_iy = iy;
+
+	return old_num - entry_num;
+}
+
+/*!
+ * @brief 範囲の中心を移動する
+ * ロボットがRECENTER_DISTより移動したら，もう一方のテーブルに範囲内のボクセルだけを移す．
+ *
+ * @param[in] ix    ロボットのx方向のボクセルの番号
+ * @param[in] iy    ロボットのy方向のボクセルの番号
+ * @param[in] stamp 現在の時刻(toStampの値)
+ *
+ * @return 1:移動した, 0:移動していない
+ */
+int voxelMap::recenter(int ix, int iy, unsigned char stamp)
+{
+	const int d = RECENTER_DIST / VOXEL_SIZE;
+	if ((abs(ix - center_ix) <= d)&&(abs(iy - center_iy) <= d)) return 0;
+
+	rebuild(ix, iy, stamp);
+	scan_count = 0;
+
+	return 1;
+}
+
+/*!
+ * @brief ビームが通過したボクセルを空きに近づける
+ * センサから計測点までのボクセルを3D DDAで辿り，登録されているボクセルのmissをMISS_MAXまで増やす．
+ * 計測点のボクセルは含まない．新しいボクセルは追加しない．
+ *
+ * @param[in] ox,oy,oz センサの位置(mm)
+ * @param[in] px,py,pz 計測点の位置(mm)
+ *
+ * @return 辿ったボクセルの数
+ */
+int voxelMap::carve(float ox, float oy, float oz, float px, float py, float pz)
+{
+	const float big = 1.0e30f;
+	float dx = px - ox, dy = py - oy, dz = pz - oz;
+	float len = sqrt(dx * dx + dy * dy + dz * dz);
+	if (len < VOXEL_SIZE) return 0;
+	if (len > CARVE_RANGE){						// 遠い部分は削らない
+		float r = CARVE_RANGE / len;
+		dx *= r, dy *= r, dz *= r;
+		px = ox + dx, py = oy + dy, pz = oz + dz;
+	}
+
+	int ix = toIndex(ox), iy = toIndex(oy), iz = toIndex(oz - Z_MIN);
+	int ex = toIndex(px), ey = toIndex(py), ez = toIndex(pz - Z_MIN);
+	int n = abs(ex - ix) + abs(ey - iy) + abs(ez - iz);
+	int sx = (dx > 0) ? 1 : -1, sy = (dy > 0) ? 1 : -1, sz = (dz > 0) ? 1 : -1;
+	float adx = fabs(dx), ady = fabs(dy), adz = fabs(dz);
+	float tdx = (adx > 0) ? VOXEL_SIZE / adx : big;	// 1ボクセル進むときの媒介変数の変化
+	float tdy = (ady > 0) ? VOXEL_SIZE / ady : big;
+	float tdz = (adz > 0) ? VOXEL_SIZE / adz : big;
+	float zo = oz - Z_MIN;
+	float tmx = (adx > 0) ? ((sx > 0) ? (ix + 1) * VOXEL_SIZE - ox : ox - ix * VOXEL_SIZE) / adx : big;
+	float tmy = (ady > 0) ? ((sy > 0) ? (iy + 1) * VOXEL_SIZE - oy : oy - iy * VOXEL_SIZE) / ady : big;
+	float tmz = (adz > 0) ? ((sz > 0) ? (iz + 1) * VOXEL_SIZE - zo : zo - iz * VOXEL_SIZE) / adz : big;
+
+	for(int k = 0; k < n; k ++){
+		if (isInWindow(ix, iy, iz)){
+			struct voxel_T *v = find(makeKey(ix, iy, iz));
+			if (v != NULL){
+				if (v->miss < MISS_MAX) v->miss ++;
+			}
+		}
+		if ((tmx < tmy)&&(tmx < tmz)) ix += sx, tmx += tdx;
+		else if (tmy < tmz)           iy += sy, tmy += tdy;
+		else                          iz += sz, tmz += tdz;
+	}
+	return n;
+}
+
+/*!
+ * @brief 1スキャン分の点を追加する
+ * センサはロボット座標系の原点にあるものとする．
+ * hitがHIT_MAXに達した後の計測はmissを減らし，障害物の回数は分類に応じて増減する（最近の計測の比にする）．
+ * テーブルが一杯で追加できない場合は１スキャンに１回まで整理してやり直し，それでも追加できなかった点の数を記録する．
+ *
+ * @param[in] time     スキャンの時刻(ms)
+ * @param[in] x,y,the スキャンの時刻のオドメトリ(m, rad)
+ * @param[in] px,py,pz ロボット座標系での点の位置(mm) 全て0の点は無効
+ * @param[in] label    点の分類(estimateGround::LABEL_*)
+ * @param[in] n        点の数
+ *
+ * @return 追加した点の数
+ */
+int voxelMap::integrate(unsigned long time, float x, float y, float the, const float *px, const float *py, const float *pz,
+						const unsigned char *label, int n)
+{
+	float ox = x * 1000.0f, oy = y * 1000.0f;
+	float c = cos(the), s = sin(the);
+	unsigned char stamp = toStamp(time);
+	int no = 0, refused = 0, compacted = 0;
+
+	WaitForSingleObject(mutex, INFINITE);
+	recenter(toIndex(ox), toIndex(oy), stamp);
+	for(int i = 0; i < n; i ++){
+		if ((px[i] == 0)&&(py[i] == 0)&&(pz[i] == 0)) continue;
+		float wx = ox + c * px[i] - s * py[i];
+		float wy = oy + s * px[i] + c * py[i];
+		float wz = pz[i];
+		if ((i % CARVE_BEAM_STEP) == 0) carve(ox, oy, 0.0f, wx, wy, wz);
+
+		int ix = toIndex(wx), iy = toIndex(wy), iz = toIndex(wz - Z_MIN);
+		if (!isInWindow(ix, iy, iz)) continue;
+		struct voxel_T *v = insert(makeKey(ix, iy, iz));
+		if ((v == NULL)&&!compacted){
+			compacted = rebuild(center_ix, center_iy, stamp) + 1;
+			v = insert(makeKey(ix, iy, iz));
+		}
+		if (v == NULL){
+			refused ++;
+			continue;
+		}
+		int full = (v->hit >= HIT_MAX) ? 1 : 0;
+		if (!full) v->hit ++;
+		else v->miss = (v->miss > HIT_WEIGHT) ? v->miss - HIT_WEIGHT : 0;
+		if (label[i] == estimateGround::LABEL_OBSTACLE){
+			if (v->obstacle < v->hit) v->obstacle ++;
+		}
+		else if (full && (v->obstacle > 0)) v->obstacle --;
+		v->stamp = stamp;
+		no ++;
+	}
+	if (++ scan_count >= COMPACT_SCANS){
+		scan_count = 0;
+		rebuild(center_ix, center_iy, stamp);
+	}
+	int entry = entry_num;
+	ReleaseMutex(mutex);
+	if (compacted) LOG("voxel_compact:removed %d, entry %d, refused %d\n", compacted - 1, entry, refused);
+
+	return no;
+}
+
+/*!
+ * @brief 指定した位置の占有されている最も高いボクセルの高さ
+ *
+ * @param[in]  x,y 位置(mm) オドメトリの座標系
+ * @param[out] z   占有されている最も高いボクセルの上端の高さ(mm)
+ *
+ * @return 1:占有されているボクセルがある, 0:無い
+ */
+int voxelMap::getColumnMaxHeight(int x, int y, int *z)
+{
+	int ix = toIndex((float)x), iy = toIndex((float)y), ret = 0;
+
+	WaitForSingleObject(mutex, INFINITE);
+	if (isInWindow(ix, iy, 0)){
+		for(int iz = Z_LEVELS - 1; iz >= 0; iz --){
+			struct voxel_T *v = find(makeKey(ix, iy, iz));
+			if ((v != NULL)&&isOccupied(v)){
+				*z = Z_MIN + (iz + 1) * VOXEL_SIZE;
+				ret = 1;
+				break;
+			}
+		}
+	}
+	ReleaseMutex(mutex);
+
+	return ret;
+}
+
+/*!
+ * @brief 指定した箱の中の占有されているボクセルの数
+ *
+ * @param[in] x0,y0,z0 箱の一方の角(mm) オドメトリの座標系
+ * @param[in] x1,y1,z1 箱のもう一方の角(mm)
+ *
+ * @return 占有されているボクセルの数
+ */
+int voxelMap::getOccupiedNum(int x0, int y0, int z0, int x1, int y1, int z1)
+{
+	int ix0 = toIndex((float)min(x0, x1)), ix1 = toIndex((float)max(x0, x1));
+	int iy0 = toIndex((float)min(y0, y1)), iy1 = toIndex((float)max(y0, y1));
+	int iz0 = max(toIndex((float)(min(z0, z1) - Z_MIN)), 0);
+	int iz1 = min(toIndex((float)(max(z0, z1) - Z_MIN)), Z_LEVELS - 1);
+	int no = 0;
+
+	WaitForSingleObject(mutex, INFINITE);
+	for(int ix = ix0; ix <= ix1; ix ++){
+		for(int iy = iy0; iy <= iy1; iy ++){
+			if (!isInWindow(ix, iy, 0)) continue;
+			for(int iz = iz0; iz <= iz1; iz ++){
+				struct voxel_T *v = find(makeKey(ix, iy, iz));
+				if ((v != NULL)&&isOccupied(v)) no ++;
+			}
+		}
+	}
+	ReleaseMutex(mutex);
+
+	return no;
+}
+
+/*!
+ * @brief 指定した高さの占有されているボクセルの位置
+ *
+ * @param[in]  z      高さ(mm)
+ * @param[out] p      ボクセルの中心の位置(mm) オドメトリの座標系
+ * @param[in]  max_no 取得する最大数
+ *
+ * @return ボクセルの数
+ */
+int voxelMap::getSlice(int z, pos *p, int max_no)
+{
+	int iz = toIndex((float)(z - Z_MIN)), no = 0;
+	if ((iz < 0)||(iz >= Z_LEVELS)) return 0;
+
+	WaitForSingleObject(mutex, INFINITE);
+	const struct voxel_T *t = table[table_no];
+	for(int i = 0; (i < TABLE_SIZE)&&(no < max_no); i ++){
+		if ((t[i].key == EMPTY_KEY)||((int)(t[i].key & 0x3f) != iz)||!isOccupied(&t[i])) continue;
+		int vx, vy, vz;
+		unwrap(t[i].key, &vx, &vy, &vz);
+		p[no].x = vx * VOXEL_SIZE + VOXEL_SIZE / 2;
+		p[no].y = vy * VOXEL_SIZE + VOXEL_SIZE / 2;
+		p[no].z = Z_MIN + vz * VOXEL_SIZE + VOXEL_SIZE / 2;
+		no ++;
+	}
+	ReleaseMutex(mutex);
+
+	return no;
+}
+
+/*!
+ * @brief 指定した範囲の障害物のボクセルの位置
+ * 地面とロボットより高い物体を除いた占有ボクセルのうち，確からしさが残っているものを高さに関係なく全て戻す．
+ *
+ * @param[in]  x0,y0  範囲の一方の角(mm) オドメトリの座標系
+ * @param[in]  x1,y1  範囲のもう一方の角(mm)
+ * @param[out] p      ボクセルの中心の位置(mm) オドメトリの座標系
+ * @param[in]  max_no 取得する最大数
+ *
+ * @return ボクセルの数
+ */
+int voxelMap::getObstacles(int x0, int y0, int x1, int y1, pos *p, int max_no)
+{
+	int ix0 = toIndex((float)min(x0, x1)), ix1 = toIndex((float)max(x0, x1));
+	int iy0 = toIndex((float)min(y0, y1)), iy1 = toIndex((float)max(y0, y1));
+	int no = 0;
+	unsigned char stamp = toStamp(timeGetTime());
+
+	WaitForSingleObject(mutex, INFINITE);
+	const struct voxel_T *t = table[table_no];
+	for(int i = 0; (i < TABLE_SIZE)&&(no < max_no); i ++){
+		if ((t[i].key == EMPTY_KEY)||!isObstacle(&t[i], stamp)) continue;
+		int vx, vy, vz;
+		unwrap(t[i].key, &vx, &vy, &vz);
+		if ((vx < ix0)||(vx > ix1)||(vy < iy0)||(vy > iy1)) continue;
+		p[no].x = vx * VOXEL_SIZE + VOXEL_SIZE / 2;
+		p[no].y = vy * VOXEL_SIZE + VOXEL_SIZE / 2;
+		p[no].z = Z_MIN + vz * VOXEL_SIZE + VOXEL_SIZE / 2;
+		no ++;
+	}
+	ReleaseMutex(mutex);
+
+	return no;
+}
+
+/*!
+ * @brief 登録しているボクセルの数
+ *
+ * @return 登録しているボクセルの数
+ */
+int voxelMap::getEntryNum()
+{
+	return entry_num;
+}
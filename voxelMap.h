@@ -0,0 +1,92 @@
+﻿#pragma once
+#include "dataType.h"
+
+class voxelMap
+{
+public:
+	voxelMap();										// コンストラクタ
+	virtual ~voxelMap();							// デストラクタ
+
+	static const int VOXEL_SIZE = 100;				//! ボクセルの一辺(mm)
+	static const int Z_MIN = -2000;					//! 保存する最小の高さ(mm) URGの高さが基準
+	static const int Z_LEVELS = 64;					//! 高さ方向のボクセル数（Z_MINから6.4m）
+	static const int WINDOW = 10000;				//! ロボットを中心として保存する範囲(mm)
+
+private:
+	static const int TABLE_BITS = 17;				//! ハッシュテーブルの大きさ(2^TABLE_BITS)
+	static const int TABLE_SIZE = 1 << TABLE_BITS;	//! ハッシュテーブルの大きさ
+	static const int MAX_ENTRY = TABLE_SIZE / 2;	//! 登録するボクセルの最大数（使用率を50%以下にする）
+	static const int XY_BITS = 10;					//! キーのx,y方向のビット数（1024ボクセルで一周）
+	static const unsigned long EMPTY_KEY = 0xffffffff;	//! 空きのキー
+	static const int RECENTER_DIST = 2000;			//! 範囲の中心を移動するロボットの移動距離(mm)
+	static const int CARVE_RANGE = 8000;			//! 空間を削る最大距離(mm)
+	static const int CARVE_BEAM_STEP = 2;			//! 空間を削るビームの間隔
+	static const int MIN_HIT = 2;					//! 占有とする最小の計測回数
+	static const int HIT_MAX = 4;					//! 計測回数の上限（小さくして数回の通過で空きに戻す）
+	static const int HIT_WEIGHT = 2;				//! 占有の判定での計測の重み（通過の何回分か）
+	static const int MISS_MAX = HIT_MAX * HIT_WEIGHT;	//! 通過回数の上限（これに達すると計測回数に関係なく空き）
+	static const int STAMP_UNIT = 100;				//! 計測した時刻を保存する単位(ms) 8bitで約25秒で一周する
+	static const int DECAY_STAMPS = 5;				//! 計測が無いときに確からしさを1減らす時間(STAMP_UNIT)
+	static const int HOLD_STAMPS = (HIT_MAX - MIN_HIT + 1) * DECAY_STAMPS;
+													//! 計測が無くても障害物として保持する最長の時間(STAMP_UNIT) 1.5s
+	static const int COMPACT_SCANS = 40;			//! テーブルを整理する間隔（スキャン数，約1秒）
+
+	/*!
+	 * @struct voxel_T
+	 * @brief ハッシュテーブルの要素
+	 */
+	struct voxel_T{
+		unsigned long key;							//!< ボクセルのキー（EMPTY_KEYで空き）
+		unsigned char hit;							//!< 点を計測した回数（HIT_MAXまで）
+		unsigned char miss;							//!< ビームが通過した回数（MISS_MAXまで，上限の後の計測で減る）
+		unsigned char obstacle;						//!< 障害物に分類された点の回数（hitまで）
+		unsigned char stamp;						//!< 最後に点を計測した時刻(STAMP_UNIT単位の下位8bit)
+	};
+	struct voxel_T table[2][TABLE_SIZE];			//! ハッシュテーブル（中心の移動時に入れ替える）
+	int table_no;									//! 使用しているテーブルの番号
+	int entry_num;									//! 登録しているボクセルの数
+	int center_ix, center_iy;						//! 範囲の中心のボクセル
+	int scan_count;									//! 前にテーブルを整理してからのスキャン数
+	HANDLE mutex;									//! 排他処理
+
+	static unsigned long makeKey(int ix, int iy, int iz);		// ボクセルのキーを求める
+	int unwrap(unsigned long key, int *ix, int *iy, int *iz);	// キーからボクセルの位置を求める
+	struct voxel_T *find(unsigned long key);		// ボクセルを探す
+	struct voxel_T *insert(unsigned long key);		// ボクセルを探す（無ければ追加）
+	int isInWindow(int ix, int iy, int iz);			// 保存する範囲内か
+	int isOccupied(const struct voxel_T *v);		// 占有されているか
+	int isObstacle(const struct voxel_T *v, unsigned char stamp);	// 障害物か
+	int rebuild(int ix, int iy, unsigned char stamp);	// 不要なボクセルを除いてもう一方のテーブルに移す
+	int recenter(int ix, int iy, unsigned char stamp);	// 範囲の中心を移動する
+	int carve(float ox, float oy, float oz, float px, float py, float pz);
+													// ビームが通過したボクセルを空きに近づける
+	static int toIndex(float v);					// 座標からボクセルの番号を求める
+	static unsigned char toStamp(unsigned long time);	// 時刻をボクセルに保存する値にする
+
+public:
+	int clear();									// 地図をクリアする
+	int integrate(unsigned long time, float x, float y, float the, const float *px, const float *py, const float *pz,
+		const unsigned char *label, int n);			// 1スキャン分の点を追加する
+	int getColumnMaxHeight(int x, int y, int *z);	// 指定した位置の占有されている最も高いボクセルの高さ
+	int getOccupiedNum(int x0, int y0, int z0, int x1, int y1, int z1);
+													// 指定した箱の中の占有されているボクセルの数
+	int getSlice(int z, pos *p, int max_no);		// 指定した高さの占有されているボクセルの位置
+	int getObstacles(int x0, int y0, int x1, int y1, pos *p, int max_no);
+													// 指定した範囲の障害物のボクセルの位置
+	int getEntryNum();								// 登録しているボクセルの数
+};
+
+/*
+ * 使い方
+ * 1) URGのスレッドでスキャン毎にintegrate(時刻, オドメトリ, 点群, ラベル)を呼び出す．
+ *    点はロボット座標系(mm)，オドメトリはスキャンの時刻の値(m, rad)，ラベルはestimateGroundの分類．
+ *    空間はビーム毎に3次元で削るため，低い障害物の上を通過したビームではその障害物は消えない．
+ *    テーブルは約1秒毎と一杯になった時に整理する（空きと古いボクセルを削除）．整理しても追加できない場合はvoxel_compactをログに残す．
+ * 2) 他のスレッドから，オドメトリの座標系(mm)で問い合わせる．
+ *    getColumnMaxHeight(x, y, &z)  : 柱の最も高い占有ボクセル
+ *    getOccupiedNum(箱)             : 箱の中の占有ボクセルの数
+ *    getSlice(z, p, max_no)         : 高さzの断面
+ *    getObstacles(範囲, p, max_no)  : 障害物（地面とロボットより高い物体を除く）のボクセル．costmapはこれで更新する
+ *                                     計測が無い障害物はDECAY_STAMPS毎に確からしさが下がり，最長HOLD_STAMPSで消える
+ *                                     背後をビームが通過すれば，立ち去った人は次の掃引（MISS_MAX回の通過）で消える
+ */
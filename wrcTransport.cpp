@@ -0,0 +1,121 @@
+﻿/*!
+ * @file  wrcTransport.cpp
+ * @brief WRC003LVHIDのライブラリでMega Roverのボードと通信する
+ */
+
+#include "stdafx.h"
+#include "wrcTransport.h"
+#include "Library/WRC003LVHID.h"
+
+#pragma	comment(lib,"Library/CWRC003LVHID.lib")
+
+/*!
+ * @class wrcTransport
+ * @brief 実機のボードのメモリマップを読み書きするクラス
+ */
+
+/*!
+ * @brief コンストラクタ
+ */
+wrcTransport::wrcTransport()
+{
+}
+
+/*!
+ * @brief デストラクタ
+ */
+wrcTransport::~wrcTransport()
+{
+}
+
+/*!
+ * @brief ボードに接続する
+ *
+ * @return 0:成功，-1:失敗
+ */
+int wrcTransport::connect()
+{
+	return CWRC_Connect() ? 0 : -1;
+}
+
+/*!
+ * @brief ボードとの接続を切る
+ *
+ * @return 0
+ */
+int wrcTransport::disconnect()
+{
+	CWRC_Disconnect();
+
+	return 0;
+}
+
+/*!
+ * @brief ボードのメモリマップを読み込む
+ *
+ * @param[in] address 先頭のアドレス
+ * @param[in] size    バイト数
+ *
+ * @return 0
+ */
+int wrcTransport::read(int address, int size)
+{
+	CWRC_ReadMemMap(address, size);
+	CWRC_ReadExecute();
+
+	return 0;
+}
+
+/*!
+ * @brief 設定した値をボードに書き込む
+ *
+ * @return 0
+ */
+int wrcTransport::write()
+{
+	CWRC_WriteExecute(FALSE);
+
+	return 0;
+}
+
+/*!
+ * @brief 書き込む値（バイト）を設定
+ *
+ * @param[in] address アドレス
+ * @param[in] value   値
+ *
+ * @return 0
+ */
+int wrcTransport::setByte(int address, unsigned char value)
+{
+	SetMem_UByte(address, value);
+
+	return 0;
+}
+
+/*!
+ * @brief 書き込む値（ワード）を設定
+ *
+ * @param[in] address アドレス
+ * @param[in] value   値
+ *
+ * @return 0
+ */
+int wrcTransport::setWord(int address, short value)
+{
+	SetMem_SWord(address, value);
+
+	return 0;
+}
+
+/*!
+ * @brief 読み込んだ値（ワード）を取得
+ *
+ * @param[in] address アドレス
+ *
+ * @return 値
+ */
+short wrcTransport::getWord(int address)
+{
+	return GetMem_SWord(address);
+}
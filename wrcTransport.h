@@ -0,0 +1,17 @@
+﻿#pragma once
+#include "roverTransport.h"
+
+class wrcTransport : public roverTransport
+{
+public:
+	wrcTransport();										// コンストラクタ
+	virtual ~wrcTransport();							// デストラクタ
+
+	int connect();										// ボードに接続する
+	int disconnect();									// ボードとの接続を切る
+	int read(int address, int size);					// ボードのメモリマップを読み込む
+	int write();										// 設定した値をボードに書き込む
+	int setByte(int address, unsigned char value);		// 書き込む値（バイト）を設定
+	int setWord(int address, short value);				// 書き込む値（ワード）を設定
+	short getWord(int address);							// 読み込んだ値（ワード）を取得
+};